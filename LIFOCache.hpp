@@ -6,6 +6,7 @@
 #include <cassert>
 #include <stdlib.h>
 #include <memory>
+#include <atomic>
 #include <sched.h>
 #include <semaphore.h>
 #include <FireLog.h>
@@ -132,7 +133,7 @@ template <class T> class LIFOCache {
             if (valueIndex >= 2) {				
                 valueIndex = 1; // overwrite existing		
             }							
-            values[valueIndex] = value;	
+            values[valueIndex] = std::move(value);
             writeCount++;			
             if (syncCount > 0) {
                 syncCount--;
@@ -160,55 +161,514 @@ template <class T> class LIFOCache {
         }
 };
 
+/**
+ * Counting event that lets one thread sleep until any of the caches it watches is
+ * posted or consumed. A waiter samples getCount() before scanning its caches and then
+ * calls wait() with that sample, so a notify() that races with the scan is never lost.
+ */
+class CacheEvent {
+    private:
+        pthread_mutex_t eventMutex;
+    private:
+        pthread_cond_t eventCond;
+    private:
+        std::atomic<long> count;
+
+    public:
+        CacheEvent() {
+            count.store(0);
+            pthread_condattr_t attr;
+            pthread_condattr_init(&attr);
+            pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+            int rc_eventCond = pthread_cond_init(&eventCond, &attr);
+            assert(rc_eventCond == 0);
+            pthread_condattr_destroy(&attr);
+            int rc_eventMutex = pthread_mutex_init(&eventMutex, NULL);
+            assert(rc_eventMutex == 0);
+        }
+
+    public:
+        ~CacheEvent() {
+            pthread_cond_destroy(&eventCond);
+            pthread_mutex_destroy(&eventMutex);
+        }
+
+    public:
+        long getCount() {
+            return count.load();
+        }
+
+    public:
+        void notify() {
+            /////////////// CRITICAL SECTION BEGIN ///////////////
+            pthread_mutex_lock(&eventMutex);
+            count.fetch_add(1);
+            pthread_cond_broadcast(&eventCond);
+            pthread_mutex_unlock(&eventMutex);
+            /////////////// CRITICAL SECTION END /////////////////
+        }
+
+        /**
+         * Wait until the event count differs from seenCount or msTimeout elapses.
+         * Return TRUE if an event occurred.
+         */
+    public:
+        bool wait(long seenCount, int msTimeout) {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            long long int ns = ts.tv_nsec;
+            ns += msTimeout * 1000000ll;
+            ts.tv_nsec = ns % 1000000000l;
+            ts.tv_sec += ns / 1000000000l;
+            /////////////// CRITICAL SECTION BEGIN ///////////////
+            pthread_mutex_lock(&eventMutex);
+            int rc = 0;
+            while (count.load() == seenCount && rc == 0) {
+                rc = pthread_cond_timedwait(&eventCond, &eventMutex, &ts);
+            }
+            bool signaled = count.load() != seenCount;
+            pthread_mutex_unlock(&eventMutex);
+            /////////////// CRITICAL SECTION END /////////////////
+            return signaled;
+        }
+};
+
+/**
+ * Lock-free variant of LIFOCache for caches that are peeked far more often than posted
+ * (e.g., every stat() of a FireREST file). Readers never block: peek() and get() pin
+ * the current slot with an atomic counter, copy its value and unpin. Writers never
+ * overwrite a current or pinned slot. Posts are serialized by writerMutex so that
+ * multiple FUSE threads may safely post to the same cache.
+ */
+#define LOCKFREE_SLOTS 4
+template <class T> class LockFreeLIFOCache {
+    private:
+        std::atomic<long> readCount;
+    private:
+        std::atomic<long> writeCount;
+    private:
+        std::atomic<long> syncCount;
+    private:
+        std::atomic<int> current;
+    private:
+        std::atomic<int> pins[LOCKFREE_SLOTS];
+    private:
+        long seqs[LOCKFREE_SLOTS];
+    private:
+        struct timespec stamps[LOCKFREE_SLOTS]; // CLOCK_REALTIME of each post()
+    private:
+        T values[LOCKFREE_SLOTS];
+    private:
+        pthread_mutex_t writerMutex;
+    private:
+        pthread_cond_t postCond; // broadcast by post() for wait_post()
+    private:
+        sem_t getSem;
+    private:
+        std::atomic<CacheEvent *> pEvent;
+
+    private:
+        inline void notify() {
+            CacheEvent *pNotify = pEvent.load();
+            if (pNotify) {
+                pNotify->notify();
+            }
+        }
+
+    private:
+        T read(long *pSeq, struct timespec *pStamp=NULL) {
+            for (;;) {
+                int slot = current.load();
+                pins[slot].fetch_add(1);
+                if (current.load() == slot) {
+                    T result = values[slot];
+                    *pSeq = seqs[slot];
+                    if (pStamp) {
+                        *pStamp = stamps[slot];
+                    }
+                    pins[slot].fetch_sub(1);
+                    return result;
+                }
+                pins[slot].fetch_sub(1); // writer moved on; retry with new slot
+            }
+        }
+
+    public:
+        LockFreeLIFOCache() {
+            readCount.store(0);
+            writeCount.store(0);
+            syncCount.store(0);
+            current.store(0);
+            pEvent.store(NULL);
+            struct timespec created;
+            clock_gettime(CLOCK_REALTIME, &created);
+            for (int i = 0; i < LOCKFREE_SLOTS; i++) {
+                pins[i].store(0);
+                seqs[i] = 0;
+                stamps[i] = created;
+            }
+            int rc_writerMutex = pthread_mutex_init(&writerMutex, NULL);
+            assert(rc_writerMutex == 0);
+            int rc_postCond = pthread_cond_init(&postCond, NULL);
+            assert(rc_postCond == 0);
+            int rc_getSem = sem_init(&getSem, 0, 0);
+            assert(rc_getSem == 0);
+        }
+
+    public:
+        ~LockFreeLIFOCache() {
+            int rc = pthread_mutex_destroy(&writerMutex);
+            assert(rc == 0);
+            rc = pthread_cond_destroy(&postCond);
+            assert(rc == 0);
+        }
+
+        // Notify the given event on every post() and on every get() that consumes a fresh value
+    public:
+        void setEvent(CacheEvent *pEvent) {
+            this->pEvent.store(pEvent);
+        }
+
+    public:
+        T peek() {
+            long seq;
+            return read(&seq);
+        }
+
+        // Peek at current value and the write count that posted it
+    public:
+        T peek(long *pWriteCount) {
+            return read(pWriteCount);
+        }
+
+        // Peek at current value, the write count that posted it and the time it was posted
+    public:
+        T peek(long *pWriteCount, struct timespec *pModified) {
+            return read(pWriteCount, pModified);
+        }
+
+        // Cached get
+    public:
+        T get() {
+            long seq;
+            T result = read(&seq);
+            long count = readCount.load();
+            while (count < seq) {
+                if (readCount.compare_exchange_weak(count, seq)) {
+                    notify();
+                    break;
+                }
+                // another reader advanced readCount; retry unless it is already current
+            }
+            return result;
+        }
+
+    public:
+        T get_sync(int msTimeout=0) {
+            syncCount.fetch_add(1);
+            long count = writeCount.load();
+            if (readCount.exchange(count) != count) {
+                notify(); // wake producer before blocking
+            }
+            struct timespec ts;
+            int rc = sem_trywait(&getSem);
+            if (rc) {
+                LOGDEBUG1("LockFreeLIFOCache::get_sync() Waiting for queue input. timeout:%dms", msTimeout);
+                if (msTimeout==0 || clock_gettime(CLOCK_REALTIME, &ts) == -1) {
+                    rc = sem_wait(&getSem);
+                    if (rc) {
+                        throw "get_sync() sem_wait failed";
+                    }
+                } else {
+                    long long int ns = ts.tv_nsec;
+                    ns += msTimeout * 1000000l;
+                    ts.tv_nsec = ns % 1000000000l;
+                    ts.tv_sec += ns / 1000000000l;
+                    rc = sem_timedwait(&getSem, &ts);
+                    if (rc) {
+                        LOGERROR1("get_sync() %dms TIMEOUT EXCEEDED", msTimeout);
+                    }
+                }
+            } else {
+                LOGWARN1("LockFreeLIFOCache::get_sync(%d) succeeded immediately", msTimeout);
+            }
+
+            T result = get();
+            return result;
+        }
+
+        // Block until a value newer than the given write count is posted or msTimeout expires.
+        // Unlike get_sync(), waiting does not consume the current value.
+    public:
+        bool wait_post(long count, int msTimeout) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            long long int ns = ts.tv_nsec;
+            ns += msTimeout * 1000000l;
+            ts.tv_nsec = ns % 1000000000l;
+            ts.tv_sec += ns / 1000000000l;
+            int rc = 0;
+            /////////////// CRITICAL SECTION BEGIN ///////////////
+            pthread_mutex_lock(&writerMutex);
+            while (rc == 0 && writeCount.load() <= count) {
+                rc = pthread_cond_timedwait(&postCond, &writerMutex, &ts);
+            }
+            bool posted = writeCount.load() > count;
+            pthread_mutex_unlock(&writerMutex);
+            /////////////// CRITICAL SECTION END /////////////////
+            return posted;
+        }
+
+    public:
+        void post(T value) {
+            /////////////// CRITICAL SECTION BEGIN ///////////////
+            pthread_mutex_lock(&writerMutex);
+            int slot = current.load();
+            for (;;) {
+                int i;
+                for (i = 1; i < LOCKFREE_SLOTS; i++) {
+                    int candidate = (slot + i) % LOCKFREE_SLOTS;
+                    if (pins[candidate].load() == 0) {
+                        slot = candidate;
+                        break;
+                    }
+                }
+                if (i < LOCKFREE_SLOTS) {
+                    break;
+                }
+                sched_yield(); // all other slots are pinned by readers
+            }
+            long seq = writeCount.load() + 1;
+            values[slot] = std::move(value);
+            seqs[slot] = seq;
+            clock_gettime(CLOCK_REALTIME, &stamps[slot]);
+            writeCount.store(seq);
+            current.store(slot);
+            for (int i = 0; i < LOCKFREE_SLOTS; i++) { // release stale values
+                if (i != slot && pins[i].load() == 0) {
+                    values[i] = T();
+                }
+            }
+            long waiters = syncCount.exchange(0); // concurrent get_sync() callers all see this value
+            pthread_cond_broadcast(&postCond);
+            pthread_mutex_unlock(&writerMutex);
+            /////////////// CRITICAL SECTION END /////////////////
+            for (long i = 0; i < waiters; i++) {
+                sem_post(&getSem);
+            }
+            notify();
+        }
+
+    public:
+        bool isFresh() {
+            long count = writeCount.load();
+            return count && count != readCount.load();
+        }
+
+    public:
+        long getWriteCount() {
+            return writeCount.load();
+        }
+    public:
+        long getReadCount() {
+            return readCount.load();
+        }
+};
+
+/**
+ * Size-class pool of recycled memory blocks for large, frequently replaced buffers
+ * such as camera images. Each size class is a power of two and retains at most
+ * BUFFERPOOL_DEPTH free blocks. Blocks are NOT zero-filled. Requests larger than the
+ * largest size class are passed through to malloc()/free().
+ */
+#define BUFFERPOOL_MIN_SHIFT 12 /* 4KB smallest size class */
+#define BUFFERPOOL_CLASSES 12   /* 4KB...8MB */
+#define BUFFERPOOL_DEPTH 4      /* free blocks retained per size class */
+class BufferPool {
+    private:
+        pthread_mutex_t poolMutex;
+    private:
+        void * freeBlocks[BUFFERPOOL_CLASSES][BUFFERPOOL_DEPTH];
+    private:
+        int freeCount[BUFFERPOOL_CLASSES];
+    private:
+        std::atomic<long> hits;
+    private:
+        std::atomic<long> misses;
+
+    private:
+        static int sizeClass(size_t bytes) {
+            for (int iClass = 0; iClass < BUFFERPOOL_CLASSES; iClass++) {
+                if (bytes <= ((size_t) 1 << (iClass + BUFFERPOOL_MIN_SHIFT))) {
+                    return iClass;
+                }
+            }
+            return -1;
+        }
+
+    public:
+        BufferPool() {
+            hits.store(0);
+            misses.store(0);
+            for (int iClass = 0; iClass < BUFFERPOOL_CLASSES; iClass++) {
+                freeCount[iClass] = 0;
+            }
+            int rc = pthread_mutex_init(&poolMutex, NULL);
+            assert(rc == 0);
+        }
+
+    public:
+        ~BufferPool() {
+            for (int iClass = 0; iClass < BUFFERPOOL_CLASSES; iClass++) {
+                while (freeCount[iClass] > 0) {
+                    free(freeBlocks[iClass][--freeCount[iClass]]);
+                }
+            }
+            int rc = pthread_mutex_destroy(&poolMutex);
+            assert(rc == 0);
+        }
+
+        /**
+         * Process-wide pool shared by all SmartPointer POOL allocations.
+         * The pool is never destroyed: global caches (e.g., BackgroundWorker worker)
+         * are constructed before it and release their POOL blocks during exit.
+         */
+    public:
+        static BufferPool & instance() {
+            static BufferPool *pPool = new BufferPool();
+            return *pPool;
+        }
+
+        /**
+         * Return an uninitialized block of at least the given size.
+         * Throw if memory is exhausted.
+         */
+    public:
+        void * allocate(size_t bytes) {
+            int iClass = sizeClass(bytes);
+            if (iClass < 0) {
+                misses++;
+                return allocate_block(bytes);
+            }
+            void * pBlock = NULL;
+            pthread_mutex_lock(&poolMutex);
+            /////////////// CRITICAL SECTION BEGIN ///////////////
+            if (freeCount[iClass] > 0) {
+                pBlock = freeBlocks[iClass][--freeCount[iClass]];
+            }
+            /////////////// CRITICAL SECTION END ///////////////
+            pthread_mutex_unlock(&poolMutex);
+            if (pBlock) {
+                hits++;
+                return pBlock;
+            }
+            misses++;
+            return allocate_block((size_t) 1 << (iClass + BUFFERPOOL_MIN_SHIFT));
+        }
+
+    private:
+        static void * allocate_block(size_t bytes) {
+            void * pBlock = malloc(bytes);
+            if (pBlock == NULL) {
+                LOGERROR1("BufferPool::allocate(%ld) out of memory", (long) bytes);
+                throw "BufferPool::allocate() out of memory";
+            }
+            return pBlock;
+        }
+
+        /**
+         * Return a block obtained from allocate(bytes) to the pool
+         */
+    public:
+        void release(void * pBlock, size_t bytes) {
+            int iClass = sizeClass(bytes);
+            if (iClass >= 0) {
+                pthread_mutex_lock(&poolMutex);
+                /////////////// CRITICAL SECTION BEGIN ///////////////
+                if (freeCount[iClass] < BUFFERPOOL_DEPTH) {
+                    freeBlocks[iClass][freeCount[iClass]++] = pBlock;
+                    pBlock = NULL;
+                }
+                /////////////// CRITICAL SECTION END ///////////////
+                pthread_mutex_unlock(&poolMutex);
+            }
+            if (pBlock) {
+                free(pBlock);
+            }
+        }
+
+    public:
+        long getHits() {
+            return hits.load();
+        }
+    public:
+        long getMisses() {
+            return misses.load();
+        }
+};
+
 template <class T> class SmartPointer {
     private:
         class ReferencedPointer {
             private:
-                volatile int references;
+                std::atomic<int> references;
             private:
                 T* volatile ptr;
             private:
                 size_t length;
             private:
                 size_t allocated_length;
+            private:
+                bool pooled;
 
             public:
                 inline ReferencedPointer() {
                     this->ptr = NULL;
-                    this->references = 0;
+                    this->references.store(0);
                     this->length = 0;
                     this->allocated_length = 0;
+                    this->pooled = FALSE;
                 }
 
             public:
-                inline ReferencedPointer(T* aPtr, size_t length) {
+                inline ReferencedPointer(T* aPtr, size_t length, bool pooled=FALSE) {
                     ptr = aPtr;
-                    references = 1;
+                    references.store(1);
                     this->length = length;
                     this->allocated_length = length;
+                    this->pooled = pooled;
                     LOGTRACE1("ReferencedPointer(%0lx) managing allocated memory", (ulong) ptr);
                 }
 
+                // Return TRUE if this was the last reference
             public:
-                inline void decref() {
-                    references--;
-                    if (references < 0) {
+                inline bool decref() {
+                    int refs = references.fetch_sub(1, std::memory_order_acq_rel) - 1;
+                    if (refs < 0) {
                         LOGERROR1("ReferencedPointer::decref(%0lx) extra derefence", (ulong) ptr);
                         throw "ReferencedPointer::decref() extra dereference";
                     }
-                    if (ptr && references == 0) {
+                    if (refs > 0) {
+                        return FALSE;
+                    }
+                    if (ptr) {
                         LOGTRACE1("ReferencedPointer::decref(%0lx) free", (ulong) ptr);
                         // Comment out the following to determine if memory is accessed after being freed
                         ///////////// FREE BEGIN
                         * (char *) ptr = 0; // mark as deleted
-                        free(ptr);
+                        if (pooled) {
+                            BufferPool::instance().release(ptr, allocated_length);
+                        } else {
+                            free(ptr);
+                        }
                         ///////////// FREE END
                     }
+                    return TRUE;
                 }
 
             public:
                 inline void incref() {
-                    references++;
+                    references.fetch_add(1, std::memory_order_relaxed);
                 }
             public:
                 inline T* data() {
@@ -224,7 +684,7 @@ template <class T> class SmartPointer {
                 }
             public:
                 inline int getReferences() const {
-                    return references;
+                    return references.load();
                 }
             public:
                 inline void setSize(size_t value) {
@@ -236,13 +696,13 @@ template <class T> class SmartPointer {
         };
 
     public:
-        enum { MANAGE, ALLOCATE };
+        enum { MANAGE, ALLOCATE, POOL };
     private:
         ReferencedPointer *pPointer;
     private:
         inline void decref() {
-            if (pPointer) {
-                pPointer->decref();
+            if (pPointer && pPointer->decref()) {
+                delete pPointer;
                 //LOGTRACE2("SmartPointer(%0lx) decref:%d", pPointer->data(), pPointer->getReferences());
             }
         }
@@ -264,7 +724,7 @@ template <class T> class SmartPointer {
          *
          * @param aPtr pointer to data. If ptr is null, count must be number of objects to calloc and zero-fill
          * @param count number of T objects to calloc for data copied from ptr
-         * @param flags ALLOCATE new memory or MANAGE memory to free()
+         * @param flags ALLOCATE new memory, MANAGE memory to free() or take uninitialized memory from BufferPool (POOL)
          * @param blockSize byte data increment for self-describing data (ALLOCATE)
          * @param blockPad block byte fill value (ALLOCATE)
          */
@@ -283,6 +743,13 @@ template <class T> class SmartPointer {
                 }
                 LOGTRACE3("SmartPointer(%0lx,%ld) calloc:%0lx", (ulong) aPtr, (ulong) count, (ulong) pData);
                 pPointer = new ReferencedPointer(pData, blockBytes);
+            } else if (count && flags == POOL) {
+                T* pData = (T*) BufferPool::instance().allocate(length);
+                if (aPtr) {
+                    memcpy(pData, aPtr, length);
+                }
+                LOGTRACE3("SmartPointer(%0lx,%ld) pool:%0lx", (ulong) aPtr, (ulong) count, (ulong) pData);
+                pPointer = new ReferencedPointer(pData, length, TRUE);
             } else {
                 LOGTRACE2("SmartPointer(%0lx,%ld)", (ulong) aPtr, (ulong) count);
                 pPointer = aPtr ? new ReferencedPointer(aPtr, length) : NULL;
@@ -300,16 +767,38 @@ template <class T> class SmartPointer {
             incref();
         }
 
+        // Hand off ownership without touching the reference count
+    public:
+        inline SmartPointer(SmartPointer &&that) {
+            pPointer = that.pPointer;
+            that.pPointer = NULL;
+        }
+
     public:
         inline ~SmartPointer() {
             decref();
         }
 
     public:
-        inline SmartPointer& operator=( SmartPointer that ) {
-            that.incref();
-            decref();
-            pPointer = that.pPointer;
+        inline SmartPointer& operator=( const SmartPointer &that ) {
+            if (pPointer != that.pPointer) {
+                ReferencedPointer *pOld = pPointer;
+                pPointer = that.pPointer;
+                incref();
+                if (pOld && pOld->decref()) {
+                    delete pOld;
+                }
+            }
+            return *this;
+        }
+
+    public:
+        inline SmartPointer& operator=( SmartPointer &&that ) {
+            if (this != &that) {
+                decref();
+                pPointer = that.pPointer;
+                that.pPointer = NULL;
+            }
             return *this;
         }
 
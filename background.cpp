@@ -8,18 +8,21 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <setjmp.h>
+#include <jpeglib.h>
 #include "firefuse.h"
 #include "version.h"
 
 #include "opencv2/highgui/highgui.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
 
 using namespace cv;
 using namespace firesight;
 
 #define CAPTURE_MSTIMEOUT 500
 
-#define STATUS_BUFFER_SIZE 1024
-static char status_buffer[STATUS_BUFFER_SIZE];
+#define STATUS_BUFFER_SIZE 4096
+static __thread char status_buffer[STATUS_BUFFER_SIZE]; // per FUSE thread
 
 BackgroundWorker worker;
 
@@ -39,7 +42,7 @@ const void* firepick_holes(FuseDataBuffer *pJPG) {
 const char* firepick_status() {
     time_t current_time = time(NULL);
     char timebuf[70];
-    strcpy(timebuf, ctime(&current_time));
+    ctime_r(&current_time, timebuf);
     timebuf[strlen(timebuf)-1] = 0;
 
     const char *errorOrWarn = firelog_lastMessage(FIRELOG_WARN);
@@ -47,14 +50,40 @@ const char* firepick_status() {
         return errorOrWarn;
     }
 
-    sprintf(status_buffer,
+    string cameraFrames;
+    vector<string> cameraNames = worker.getCameraNames();
+    for (int i = 0; i < cameraNames.size(); i++) {
+        CameraNode &camera = worker.camera(cameraNames[i]);
+        char framesBuf[255];
+        snprintf(framesBuf, sizeof(framesBuf), "%s  '%s':{'decoded':%ld,'skipped':%ld}",
+                 i ? ",\n" : "", cameraNames[i].c_str(), camera.get_frames_decoded(), camera.get_frames_skipped());
+        cameraFrames += framesBuf;
+    }
+
+    string cveTimes;
+    vector<string> cveNames = worker.getCveNames();
+    for (int i = 0; i < cveNames.size(); i++) {
+        CVE &cve = worker.cve(cveNames[i]);
+        char timesBuf[255];
+        snprintf(timesBuf, sizeof(timesBuf), "%s  '%s':{'queue':%0.3f,'exec':%0.3f}",
+                 i ? ",\n" : "", cveNames[i].c_str(), cve.getQueueSeconds(), cve.getExecSeconds());
+        cveTimes += timesBuf;
+    }
+
+    snprintf(status_buffer, sizeof(status_buffer),
             "{\n"
             " 'timestamp':'%s'\n"
             " 'message':'FirePick OK!',\n"
-            " 'version':'FireFUSE version %d.%d'\n"
+            " 'version':'FireFUSE version %d.%d',\n"
+            " 'bufferPool':{'hits':%ld,'misses':%ld},\n"
+            " 'camera':{\n%s\n },\n"
+            " 'cve':{\n%s\n }\n"
             "}\n",
             timebuf,
-            FireFUSE_VERSION_MAJOR, FireFUSE_VERSION_MINOR);
+            FireFUSE_VERSION_MAJOR, FireFUSE_VERSION_MINOR,
+            BufferPool::instance().getHits(), BufferPool::instance().getMisses(),
+            cameraFrames.c_str(),
+            cveTimes.c_str());
     return status_buffer;
 }
 
@@ -91,15 +120,58 @@ SmartPointer<char> loadFile(const char *path, int suffixBytes) {
 
 /////////////////////////// CameraNode ///////////////////////////////////
 
-CameraNode::CameraNode() {
+/**
+ * Return canonical camera path. E.g.:
+ *   /dev/firefuse/sync/cv/1/gray/cve/calc-offset/save.fire => /cv/1
+ *
+ * Return empty string if path does not name a camera
+ */
+string CameraNode::camera_path(const char *pPath) {
+    if (pPath == NULL) {
+        return string();
+    }
+    const char *pCv = strstr(pPath, "/cv/");
+    if (!pCv || pCv[4] == 0 || pCv[4] == '/') {
+        return string();
+    }
+    const char *pSlash = strchr(pCv+4, '/');
+    return pSlash ? string(pCv, pSlash-pCv) : string(pCv);
+}
+
+CameraNode::CameraNode(string name) {
+    this->name = name;
+    width = 800;
+    height = 200;
+    source_name = "raspistill";
+    source_fps = 0;
+    pSource = NULL;
+    camera_seconds = 0;
     output_seconds = 0;
     monitor_duration = 3;
 	set_min_capture_ms();
     camera_idle_capture_seconds = 600; // idle image capture rate
+    for (int i = 0; i < FRAME_RING_SIZE; i++) {
+        frameRing[i].sequence = 0;
+        frameRing[i].bgrDecoded = FALSE;
+        frameRing[i].grayDecoded = FALSE;
+    }
+    ring_frame = 0;
+    decoded_frame.store(0);
+    frames_decoded.store(0);
+    frames_skipped.store(0);
+    rois_decoded.store(0);
+    ASSERTZERO(pthread_mutex_init(&ringMutex, NULL));
+    ASSERTZERO(pthread_cond_init(&ringCond, NULL));
+    ASSERTZERO(pthread_mutex_init(&decodeMutex, NULL));
+    ASSERTZERO(pthread_mutex_init(&captureMutex, NULL));
+    ASSERTZERO(pthread_mutex_init(&batchMutex, NULL));
+    const char *emptyJson = "{}";
+    src_batch_fire.post(SmartPointer<char>((char *)emptyJson, strlen(emptyJson)));
     clear();
 }
 
 CameraNode::~CameraNode() {
+    delete pSource;
     if (raspistillPID > 0) {
         LOGINFO1("CameraNode::~CameraNode() shutting down raspistill PID:%d", raspistillPID);
         ASSERTZERO(kill(raspistillPID, SIGKILL));
@@ -118,43 +190,91 @@ bool CameraNode::isCapturing() {
 	return true;
 }
 
+/**
+ * Ask BackgroundWorker to capture a frame. Serial reader and gcode threads must
+ * not call capture(), which sleeps for min_capture_ms and active captures.
+ */
+void CameraNode::request_capture() {
+    capture_requested.store(TRUE);
+    worker.event.notify();
+}
+
+long CameraNode::get_capture_wait_ms() {
+    if (!capture_requested.load()) {
+        return -1;
+    }
+    return max(0L, msCapture.load() - millis());
+}
+
 void CameraNode::endCapture() {
-	LOGDEBUG1("CameraNode::endCapture() captureActive %d->0", captureActive);
+	LOGDEBUG1("CameraNode::endCapture() captureActive %d->0", (int) captureActive.load());
     captureActive = FALSE;
 }
 
 void CameraNode::clear() {
+    pthread_mutex_lock(&batchMutex);
+    pendingBatch = BatchRequest(); // its CVEs are being deleted
+    pthread_mutex_unlock(&batchMutex);
     raspistillPID = 0;
 	captureActive = FALSE;
 	msCapture = 0;
+    capture_requested.store(FALSE);
+}
+
+void CameraNode::configure(int width, int height, string sourceName, string sourceConfig, string sourceFormat, double sourceFps) {
+    this->width = width;
+    this->height = height;
+    source_name = sourceName;
+    source_config = sourceConfig;
+    source_format = sourceFormat;
+    source_fps = sourceFps;
+    LOGINFO4("CameraNode::configure(%s) %dx%d source:%s", name.c_str(), width, height, source_name.c_str());
+    LOGINFO2("CameraNode::configure(%s) config:%s", name.c_str(), source_config.c_str());
 }
 
 void CameraNode::init() {
-    int status = 0;
-    char widthBuf[20];
-    char heightBuf[20];
-    snprintf(widthBuf, sizeof(widthBuf), "%d", cameraWidth);
-    snprintf(heightBuf, sizeof(heightBuf), "%d", cameraHeight);
+    if (pSource) {
+        delete pSource;
+        pSource = NULL;
+    }
+    if (source_name.compare("v4l2") == 0) {
+        pSource = new V4L2Source(this, source_config, source_format);
+    } else if (source_name.compare("replay") == 0) {
+        pSource = new ReplaySource(this, source_config, source_fps);
+    }
+    if (pSource) {
+        int rc = pSource->start(width, height);
+        if (rc) {
+            LOGWARN3("CameraNode::init(%s) %s camera source is unavailable:%s",
+                     name.c_str(), source_name.c_str(), source_config.c_str());
+            delete pSource;
+            pSource = NULL;
+        }
+        return;
+    }
     const char *raspistill_sh = "/usr/local/bin/raspistill.sh";
-    bool isRaspistill  = cameraSourceName.compare("raspistill") == 0;
+    bool isRaspistill  = source_name.compare("raspistill") == 0;
     if (isRaspistill) {
         struct stat buffer;
         if (0 == stat(raspistill_sh, &buffer)) {
             SmartPointer<char> jpg = loadFile("/var/firefuse/no-image.png");
             accept_new_image(jpg);
         } else {
-            LOGWARN1("CameraNode::init() raspistill camera source is unavailable:%s",
-                     raspistill_sh);
+            LOGWARN2("CameraNode::init(%s) raspistill camera source is unavailable:%s",
+                     name.c_str(), raspistill_sh);
             isRaspistill = FALSE;
             raspistillPID = -ENOENT;
         }
     }
     if (isRaspistill) {
+        string pidName(name.substr(1)); // one PID file per camera, e.g., /var/firefuse/raspistill-cv-1.PID
+        replace(pidName.begin(), pidName.end(), '/', '-');
+        string pidPath = "/var/firefuse/raspistill-" + pidName + ".PID";
+        const char *path_pid = pidPath.c_str();
         char cmd[255];
-        snprintf(cmd, sizeof(cmd), "%s --launch %s", raspistill_sh, cameraSourceConfig.c_str());
+        snprintf(cmd, sizeof(cmd), "RASPISTILL_PID=%s %s --launch %s", path_pid, raspistill_sh, source_config.c_str());
         LOGINFO1("CameraNode::init() %s", cmd);
         ASSERTZERO(BackgroundWorker::callSystem(cmd));
-        const char *path_pid = "/var/firefuse/raspistill.PID";
 
         LOGINFO1("CameraNode::init() fopen(%s)", path_pid);
         FILE *fpid = fopen(path_pid, "r");
@@ -192,8 +312,10 @@ void CameraNode::set_min_capture_ms(int value) {
 
 bool CameraNode::capture() {
 	long now = millis();
+	/////////////// CRITICAL SECTION BEGIN ///////////////
+	pthread_mutex_lock(&captureMutex);
 	long  msWait = msCapture - now;
-	LOGTRACE3("CameraNode::capture() msWait:%ld msCapture:%ld millis:%ld", msWait, msCapture, now);
+	LOGTRACE3("CameraNode::capture() msWait:%ld msCapture:%ld millis:%ld", msWait, msCapture.load(), now);
 	if (msWait > 0) {
 		LOGDEBUG2("CameraNode::capture() Delaying request by %ldms. maxfps:%g", msWait, 1000.0/min_capture_ms);
 		usleep(msWait * 1000);
@@ -206,7 +328,16 @@ bool CameraNode::capture() {
 		LOGWARN("CameraNode::capture() PREVIOUS CAPTURE INCOMPLETE: Proceeding with next capture");
 	}
     SmartPointer<char> jpg = src_camera_jpg.get(); // discard current
+    if (pSource) {
+        LOGDEBUG1("CameraNode::capture() %s request", name.c_str());
+        msCapture = millis() + min_capture_ms;
+        captureActive = TRUE;
+        pSource->request(); // may post and endCapture() at once
+        pthread_mutex_unlock(&captureMutex);
+        return TRUE;
+    }
     if (raspistillPID <= 0) {
+		pthread_mutex_unlock(&captureMutex);
 		return FALSE; // raspistill is configured but unavailable
 	}
 
@@ -235,23 +366,30 @@ bool CameraNode::capture() {
 
 	msCapture = millis() + min_capture_ms;
 	captureActive = TRUE;
+	pthread_mutex_unlock(&captureMutex);
+	/////////////// CRITICAL SECTION END /////////////////
 	return TRUE;
 }
 
 int CameraNode::async_update_camera_jpg() {
     int processed = 0;
     double now = BackgroundWorker::seconds();
+    if (get_capture_wait_ms() == 0) { // requested capture need not wait for min_capture_ms
+        capture_requested.store(FALSE);
+        camera_seconds = now;
+        LOGTRACE1("async_update_camera_jpg(%s) requested capture", name.c_str());
+        capture();
+        return 01;
+    }
     double elapsed = now - camera_seconds;
+    bool isDecoded = src_camera_jpg.getWriteCount() == decoded_frame.load();
     if (elapsed >= camera_idle_capture_seconds &&
-            ( !src_camera_jpg.isFresh() ||
-              !src_camera_mat_bgr.isFresh() ||
-              !src_camera_mat_gray.isFresh())) {
+            ( !src_camera_jpg.isFresh() || isDecoded) &&
+            !isCapturing()) { // capture() would wait and stall the other cameras
         camera_seconds = now;
         processed |= 01;
-        LOGTRACE3("async_update_camera_jpg() acquiring image (fresh jpg:%d bgr:%d gray:%d)",
-                  src_camera_jpg.isFresh(),
-                  src_camera_mat_bgr.isFresh(),
-                  src_camera_mat_gray.isFresh());
+        LOGTRACE2("async_update_camera_jpg() acquiring image (fresh jpg:%d decoded:%d)",
+                  src_camera_jpg.isFresh(), isDecoded);
 
 		capture();
     }
@@ -259,36 +397,482 @@ int CameraNode::async_update_camera_jpg() {
     return processed;
 }
 
-int CameraNode::accept_new_image(SmartPointer<char> jpg) {
-    int processed = 0;
-    src_camera_jpg.post(jpg);
-    if (src_camera_mat_bgr.isFresh() && src_camera_mat_gray.isFresh()) {
-        // proactively update all decoded images to eliminate post-idle refresh lag
-        src_camera_mat_bgr.get(); // discard current
-        src_camera_mat_gray.get(); // discard current
+/**
+ * Post jpg to src_camera_jpg and add it to frameRing, overwriting the oldest frame.
+ * Decoded Mats of the oldest frame are kept as storage for decoding this one.
+ * Return the sequence number of the new frame.
+ */
+long CameraNode::post_frame(SmartPointer<char> jpg, const struct timespec *pCaptured, Mat bgr) {
+    struct timespec captured;
+    if (pCaptured) {
+        captured = *pCaptured;
     } else {
-        // To eliminate unnecessary conversion we will only update active Mat
+        clock_gettime(CLOCK_REALTIME, &captured);
+    }
+    long frame = src_camera_jpg.getWriteCount();
+    if (frame && frame != decoded_frame.load()) {
+        frames_skipped++;
+    }
+    pthread_mutex_lock(&ringMutex);
+    /////////////// CRITICAL SECTION BEGIN ///////////////
+    src_camera_jpg.post(jpg);
+    src_camera_jpg.peek(&frame);
+    CameraFrame &slot = frameRing[frame % FRAME_RING_SIZE];
+    slot.sequence = frame;
+    slot.captured = captured;
+    slot.jpg = jpg;
+    slot.bgrDecoded = bgr.rows && bgr.cols;
+    if (slot.bgrDecoded) {
+        slot.bgr = bgr;
+        decoded_frame.store(frame);
     }
-    LOGDEBUG3("CameraNode::accept_new_image() src_camera_jpg.post(%ldB) %0lx [0]:%0x",
-              (ulong) jpg.size(), (ulong) jpg.data(), (int) *jpg.data());
+    slot.grayDecoded = FALSE;
+    ring_frame = frame;
+    pthread_cond_broadcast(&ringCond);
+    /////////////// CRITICAL SECTION END /////////////////
+    pthread_mutex_unlock(&ringMutex);
+    return frame;
+}
+
+int CameraNode::accept_new_image(SmartPointer<char> jpg, const struct timespec *pCaptured) {
+    long frame = post_frame(jpg, pCaptured, Mat());
+    LOGDEBUG4("CameraNode::accept_new_image() frame:%ld src_camera_jpg.post(%ldB) %0lx [0]:%0x",
+              frame, (ulong) jpg.size(), (ulong) jpg.data(), (int) *jpg.data());
+
+    return 0; // decoding is deferred to get_mat_bgr() and get_mat_gray()
+}
 
-    std::vector<uchar> vJPG((uchar *)jpg.data(), (uchar *)jpg.data() + jpg.size());
-    if (!src_camera_mat_bgr.isFresh()) {
-        processed |= 02;
-        Mat image = imdecode(vJPG, CV_LOAD_IMAGE_COLOR);
-        src_camera_mat_bgr.post(image);
-        LOGTRACE2("CameraNode::accept_new_image() src_camera_mat_bgr.post(%dx%d)",
-                  image.rows, image.cols);
+int CameraNode::accept_new_mat(Mat bgr, const struct timespec *pCaptured) {
+    vector<uchar> jpgBuf;
+    vector<int> param = vector<int>(2);
+    param[0] = CV_IMWRITE_JPEG_QUALITY;
+    param[1] = 95; // 0..100; default 95
+    imencode(".jpg", bgr, jpgBuf, param); // camera.jpg and monitor.jpg readers
+    SmartPointer<char> jpg((char *)jpgBuf.data(), jpgBuf.size(), SmartPointer<char>::POOL);
+
+    long frame = post_frame(jpg, pCaptured, bgr); // get_mat_bgr() need not decode jpg
+    LOGTRACE3("CameraNode::accept_new_mat(%dx%d) frame:%ld", bgr.rows, bgr.cols, frame);
+
+    return 0;
+}
+
+/**
+ * Return TRUE if image pixels are also referenced elsewhere (e.g., by a running pipeline)
+ * and must not be overwritten by decoding
+ */
+static bool isShared(const Mat &image) {
+    return image.refcount && *image.refcount > 1;
+}
+
+Mat CameraNode::decode_frame(long frame, bool color) {
+    CameraFrame &slot = frameRing[frame % FRAME_RING_SIZE];
+    Mat image;
+    Mat bgr;
+    SmartPointer<char> jpg;
+    bool decode = FALSE;
+    pthread_mutex_lock(&ringMutex);
+    /////////////// CRITICAL SECTION BEGIN ///////////////
+    if (frame && slot.sequence == frame) {
+        Mat &decoded = color ? slot.bgr : slot.gray;
+        image = decoded;
+        if (!(color ? slot.bgrDecoded : slot.grayDecoded)) {
+            decoded = Mat(); // image now holds the only slot reference to the storage
+            jpg = slot.jpg;
+            if (slot.bgrDecoded) {
+                bgr = slot.bgr;
+            }
+            decode = TRUE;
+        }
     }
-    if (!src_camera_mat_gray.isFresh()) {
-        processed |= 04;
-        Mat image = imdecode(vJPG, CV_LOAD_IMAGE_GRAYSCALE);
-        src_camera_mat_gray.post(image);
-        LOGTRACE2("CameraNode::accept_new_image() src_camera_mat_gray.post(%dx%d)",
-                  image.rows, image.cols);
+    /////////////// CRITICAL SECTION END /////////////////
+    pthread_mutex_unlock(&ringMutex);
+    if (!decode) {
+        return image;
     }
 
-    return processed;
+    if (isShared(image)) {
+        image.release(); // an older frame is still in use, so decode into new storage
+    }
+    if (!color && bgr.rows && bgr.cols) {
+        cvtColor(bgr, image, CV_BGR2GRAY);
+    } else if (jpg.size()) {
+        // decode directly from the SmartPointer bytes into the reused storage
+        Mat jpgMat(1, (int) jpg.size(), CV_8UC1, jpg.data());
+        imdecode(jpgMat, color ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE, &image); // grayscale decodes luma only
+        if (decoded_frame.exchange(frame) != frame) {
+            frames_decoded++;
+        }
+    }
+
+    pthread_mutex_lock(&ringMutex);
+    /////////////// CRITICAL SECTION BEGIN ///////////////
+    if (slot.sequence == frame) {
+        if (color) {
+            slot.bgr = image;
+            slot.bgrDecoded = TRUE;
+        } else {
+            slot.gray = image;
+            slot.grayDecoded = TRUE;
+        }
+    }
+    /////////////// CRITICAL SECTION END /////////////////
+    pthread_mutex_unlock(&ringMutex);
+    LOGTRACE4("CameraNode::decode_frame(%ld,%d) %dx%d", frame, color, image.rows, image.cols);
+    return image;
+}
+
+Mat CameraNode::get_frame_mat(long frame, bool color) {
+    pthread_mutex_lock(&decodeMutex);
+    /////////////// CRITICAL SECTION BEGIN ///////////////
+    Mat image = decode_frame(frame, color);
+    /////////////// CRITICAL SECTION END /////////////////
+    pthread_mutex_unlock(&decodeMutex);
+    return image;
+}
+
+#ifdef HAVE_JPEG_SKIP_SCANLINES
+typedef struct JpegError {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+} JpegError;
+
+static void jpeg_output_message(j_common_ptr cinfo) {
+    char buffer[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, buffer);
+    LOGWARN1("decode_jpeg_roi() %s", buffer);
+}
+
+static void jpeg_error_exit(j_common_ptr cinfo) {
+    (*cinfo->err->output_message)(cinfo);
+    longjmp(((JpegError *) cinfo->err)->jump, 1); // libjpeg would exit()
+}
+
+/**
+ * Decode only the part of jpg that covers roi with libjpeg-turbo: rows above roi
+ * are skipped, rows below it are never read, and only the iMCU columns that
+ * hold roi are decoded. roi is clipped to the image. image belongs to the
+ * caller so that nothing which needs destruction lives in this setjmp() frame.
+ * Return FALSE if jpg could not be decoded or roi is outside the image.
+ */
+static bool decode_jpeg_roi(SmartPointer<char> &jpg, bool color, Rect &roi, Mat &image) {
+    struct jpeg_decompress_struct cinfo;
+    JpegError jerr;
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit;
+    jerr.pub.output_message = jpeg_output_message;
+    if (setjmp(jerr.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        return FALSE;
+    }
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char *) jpg.data(), jpg.size());
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = color ? JCS_EXT_BGR : JCS_GRAYSCALE; // grayscale decodes luma only
+    jpeg_start_decompress(&cinfo);
+    roi &= Rect(0, 0, cinfo.output_width, cinfo.output_height);
+    if (roi.area() == 0) {
+        jpeg_destroy_decompress(&cinfo);
+        return FALSE;
+    }
+    JDIMENSION xoffset = roi.x;
+    JDIMENSION width = roi.width;
+    jpeg_crop_scanline(&cinfo, &xoffset, &width); // widened to iMCU boundaries
+    jpeg_skip_scanlines(&cinfo, roi.y);
+    image.create(roi.height, cinfo.output_width, color ? CV_8UC3 : CV_8UC1);
+    while (cinfo.output_scanline < (JDIMENSION) (roi.y + roi.height)) {
+        JSAMPROW row = image.ptr(cinfo.output_scanline - roi.y);
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_destroy_decompress(&cinfo); // rows below roi are not decoded
+    image = image.colRange(roi.x - xoffset, roi.x - xoffset + roi.width);
+    if (!image.isContinuous()) {
+        image = image.clone(); // pipeline ops may expect continuous rows
+    }
+    return TRUE;
+}
+#endif
+
+/**
+ * Return roi of frame in a Mat of its own. If the frame has been decoded, roi is
+ * copied from it. Otherwise only roi is decoded, so the cost scales with roi and
+ * not with the camera resolution. Without libjpeg-turbo the whole frame is
+ * decoded and roi is copied from it. roi is clipped to the frame.
+ * Return an empty Mat if the frame has been overwritten.
+ */
+Mat CameraNode::get_frame_roi(long frame, bool color, Rect roi) {
+    CameraFrame slot;
+    if (!get_frame(frame, &slot)) {
+        return Mat();
+    }
+    Mat decoded;
+    if (color ? slot.bgrDecoded : slot.grayDecoded) {
+        decoded = color ? slot.bgr : slot.gray;
+    } else if (slot.bgrDecoded) {
+        decoded = slot.bgr; // converted to gray below
+    }
+    Mat image;
+    if (decoded.rows && decoded.cols) {
+        roi &= Rect(0, 0, decoded.cols, decoded.rows);
+        if (!color && decoded.channels() == 3) {
+            cvtColor(decoded(roi), image, CV_BGR2GRAY);
+        } else {
+            image = decoded(roi).clone();
+        }
+#ifdef HAVE_JPEG_SKIP_SCANLINES
+    } else if (decode_jpeg_roi(slot.jpg, color, roi, image)) {
+        rois_decoded++;
+#endif
+    } else { // decode everything, which also reports errors the usual way
+        decoded = get_frame_mat(frame, color);
+        roi &= Rect(0, 0, decoded.cols, decoded.rows);
+        image = decoded(roi).clone();
+    }
+    LOGTRACE4("CameraNode::get_frame_roi(%ld,%d) %dx%d", frame, color, image.cols, image.rows);
+    return image;
+}
+
+long CameraNode::newest_frame() {
+    pthread_mutex_lock(&ringMutex);
+    long frame = ring_frame;
+    pthread_mutex_unlock(&ringMutex);
+    return frame;
+}
+
+Mat CameraNode::get_mat_bgr() {
+    return get_frame_mat(newest_frame(), TRUE);
+}
+
+Mat CameraNode::get_mat_gray() {
+    return get_frame_mat(newest_frame(), FALSE);
+}
+
+bool CameraNode::get_frame(long frame, CameraFrame *pFrame) {
+    pthread_mutex_lock(&ringMutex);
+    /////////////// CRITICAL SECTION BEGIN ///////////////
+    CameraFrame &slot = frameRing[frame % FRAME_RING_SIZE];
+    bool found = frame && slot.sequence == frame;
+    if (found) {
+        *pFrame = slot;
+    }
+    /////////////// CRITICAL SECTION END /////////////////
+    pthread_mutex_unlock(&ringMutex);
+    return found;
+}
+
+/**
+ * Return the sequence number of the earliest frame in frameRing captured at or after
+ * the given CLOCK_REALTIME, waiting up to msTimeout for it to arrive. Return 0 on timeout.
+ */
+long CameraNode::frame_after(const struct timespec &after, int msTimeout) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += msTimeout / 1000;
+    ts.tv_nsec += (msTimeout % 1000) * 1000000L;
+    ts.tv_sec += ts.tv_nsec / 1000000000L;
+    ts.tv_nsec %= 1000000000L;
+    long frame = 0;
+    int rc = 0;
+    pthread_mutex_lock(&ringMutex);
+    /////////////// CRITICAL SECTION BEGIN ///////////////
+    for (;;) {
+        for (int i = 0; i < FRAME_RING_SIZE; i++) {
+            CameraFrame &slot = frameRing[i];
+            if (slot.sequence && (frame == 0 || slot.sequence < frame) &&
+                    (slot.captured.tv_sec > after.tv_sec ||
+                     (slot.captured.tv_sec == after.tv_sec && slot.captured.tv_nsec >= after.tv_nsec))) {
+                frame = slot.sequence;
+            }
+        }
+        if (frame || rc == ETIMEDOUT) {
+            break;
+        }
+        rc = pthread_cond_timedwait(&ringCond, &ringMutex, &ts);
+    }
+    /////////////// CRITICAL SECTION END /////////////////
+    pthread_mutex_unlock(&ringMutex);
+    LOGTRACE2("CameraNode::frame_after(%s) -> %ld", name.c_str(), frame);
+    return frame;
+}
+
+long CameraNode::frame_after_ack(DCE &dce, long ack, int msTimeout) {
+    struct timespec acked;
+    if (!dce.ack_time(ack, &acked, msTimeout)) {
+        return 0;
+    }
+    return frame_after(acked, msTimeout);
+}
+
+static void post_json(LockFreeLIFOCache<SmartPointer<char> > &cache, json_t *pJson) {
+    char *pJsonStr = json_dumps(pJson, JSON_PRESERVE_ORDER|JSON_COMPACT|JSON_INDENT(0));
+    size_t len = pJsonStr ? strlen(pJsonStr) : 0;
+    cache.post(SmartPointer<char>(pJsonStr, len, SmartPointer<char>::ALLOCATE, max(MIN_PROCESS_SIZE, len), ' '));
+    free(pJsonStr);
+}
+
+/**
+ * Process one camera frame with every CVE named in the JSON array request.
+ * Names are relative to the camera (e.g., ["bgr/calc-offset","gray/locate-part"])
+ * or canonical CVE paths. A sync batch captures a new frame, otherwise the newest
+ * frame is used. The frame is decoded once per color before the CVEs process it
+ * as see() requests, in parallel on the CVE threads. The combined result is
+ * posted to batch.fire, e.g.:
+ *   {"status":"DONE", "frame":42, "cve":{"bgr/calc-offset":{...}, "gray/locate-part":{...}}}
+ * A sync batch waits for the result. An async batch posts {"status":"ACTIVE"} and
+ * returns at once. async_batch_fire() posts its result when the last CVE completes.
+ * Return the number of CVEs that completed (sync) or were queued (async), or 0 on error.
+ */
+int CameraNode::batch(BackgroundWorker *pWorker, SmartPointer<char> request, bool sync) {
+    BatchRequest batch;
+    batch.started_seconds = BackgroundWorker::seconds();
+    string requestString(request.data(), request.size());
+    json_error_t jerr;
+    json_t *pRequest = json_loads(requestString.c_str(), 0, &jerr);
+    const char *errMsg = NULL;
+    if (!json_is_array(pRequest) || json_array_size(pRequest) == 0) {
+        errMsg = "batch.fire expects a JSON array of CVE names";
+    }
+    for (int i = 0; !errMsg && i < json_array_size(pRequest); i++) {
+        const char *pName = json_string_value(json_array_get(pRequest, i));
+        const char *pSlash = pName ? strchr(pName, '/') : NULL;
+        string cvePath;
+        if (pName && *pName == '/') {
+            cvePath = CVE::cve_path(pName);
+        } else if (pSlash) { // profile/name
+            cvePath = name + "/" + string(pName, pSlash-pName) + FIREREST_CVE + pSlash;
+        }
+        CVEPtr pCve = NULL;
+        try {
+            pCve = cvePath.empty() ? NULL : &pWorker->cve(cvePath);
+        } catch (string ex) {
+            pCve = NULL;
+        }
+        if (pCve == NULL || &pCve->getCamera() != this) {
+            LOGERROR2("CameraNode::batch(%s) unknown CVE: %s", name.c_str(), pName ? pName : "(not a string)");
+            errMsg = "batch.fire names a CVE that is not configured for this camera";
+        } else {
+            batch.names.push_back(pName);
+            batch.cves.push_back(pCve);
+        }
+    }
+    json_decref(pRequest);
+
+    batch.frame = 0;
+    CameraFrame cameraFrame;
+    if (!errMsg) {
+        long before = src_camera_jpg.getWriteCount();
+        if (sync) {
+            capture();
+            src_camera_jpg.get_sync(CAMERA_MSTIMEOUT);
+        }
+        batch.frame = newest_frame();
+        if (sync && batch.frame <= before) {
+            errMsg = "batch.fire camera capture timed out";
+        } else if (!get_frame(batch.frame, &cameraFrame)) {
+            errMsg = "batch.fire has no camera frame";
+        }
+    }
+    if (errMsg) {
+        LOGERROR2("CameraNode::batch(%s) %s", name.c_str(), errMsg);
+        json_t *pResult = json_object();
+        json_object_set_new(pResult, "error", json_string(errMsg));
+        post_json(src_batch_fire, pResult);
+        json_decref(pResult);
+        return 0;
+    }
+
+    bool color = FALSE;
+    bool gray = FALSE;
+    for (int i = 0; i < batch.cves.size(); i++) {
+        if (!batch.cves[i]->isCropped()) { // cropped CVEs decode their own region
+            color = color || batch.cves[i]->isColor();
+            gray = gray || !batch.cves[i]->isColor();
+        }
+    }
+    Mat bgr = color ? get_frame_mat(batch.frame, TRUE) : Mat(); // gray is then converted, not decoded
+    Mat grayMat = gray ? get_frame_mat(batch.frame, FALSE) : Mat();
+
+    if (!sync) {
+        json_t *pActive = json_object();
+        json_object_set_new(pActive, "status", json_string("ACTIVE"));
+        json_object_set_new(pActive, "frame", json_integer(batch.frame));
+        post_json(src_batch_fire, pActive);
+        json_decref(pActive);
+        pthread_mutex_lock(&batchMutex);
+        /////////////// CRITICAL SECTION BEGIN ///////////////
+        if (pendingBatch.frame) {
+            LOGWARN2("CameraNode::batch(%s) frame:%ld batch replaced", name.c_str(), pendingBatch.frame);
+        }
+        pendingBatch = batch;
+        /////////////// CRITICAL SECTION END /////////////////
+        pthread_mutex_unlock(&batchMutex);
+    }
+    for (int i = 0; i < batch.cves.size(); i++) {
+        batch.cves[i]->see(cameraFrame.captured); // frame_after() selects this frame
+    }
+    pWorker->event.notify();
+    if (!sync) {
+        return batch.cves.size();
+    }
+    return post_batch(batch, PROCESS_MSTIMEOUT);
+}
+
+/**
+ * Wait up to msTimeout for each CVE of batch to complete its see() request and
+ * post the combined result to batch.fire. Return the number of CVEs that completed.
+ */
+int CameraNode::post_batch(BatchRequest &batch, int msTimeout) {
+    int completed = 0;
+    json_error_t jerr;
+    json_t *pCves = json_object();
+    for (int i = 0; i < batch.cves.size(); i++) {
+        SmartPointer<char> cveResult;
+        json_t *pCveJson = NULL;
+        if (batch.cves[i]->await_see(msTimeout, &cveResult)) {
+            string cveString(cveResult.data(), cveResult.size());
+            pCveJson = json_loads(cveString.c_str(), 0, &jerr);
+            completed++;
+        }
+        if (pCveJson == NULL) {
+            pCveJson = json_object();
+            json_object_set_new(pCveJson, "error", json_string("no process.fire result"));
+        }
+        json_object_set_new(pCves, batch.names[i].c_str(), pCveJson);
+    }
+    json_t *pResult = json_object();
+    json_object_set_new(pResult, "status", json_string("DONE"));
+    json_object_set_new(pResult, "frame", json_integer(batch.frame));
+    json_object_set_new(pResult, "cve", pCves);
+    post_json(src_batch_fire, pResult);
+    json_decref(pResult);
+    LOGDEBUG4("CameraNode::batch(%s) frame:%ld CVEs:%d %0.3fs",
+              name.c_str(), batch.frame, completed, BackgroundWorker::seconds() - batch.started_seconds);
+    return completed;
+}
+
+/**
+ * Post the result of the pending async batch once all of its CVEs have
+ * completed, or once PROCESS_MSTIMEOUT has passed. Return 0200 if posted.
+ */
+int CameraNode::async_batch_fire() {
+    pthread_mutex_lock(&batchMutex);
+    /////////////// CRITICAL SECTION BEGIN ///////////////
+    bool ready = pendingBatch.frame != 0;
+    bool expired = ready && BackgroundWorker::seconds() - pendingBatch.started_seconds > PROCESS_MSTIMEOUT/1000.0;
+    for (int i = 0; ready && !expired && i < pendingBatch.cves.size(); i++) {
+        ready = !pendingBatch.cves[i]->isSeePending();
+    }
+    BatchRequest batch;
+    if (ready) {
+        batch = pendingBatch;
+        pendingBatch = BatchRequest();
+    }
+    /////////////// CRITICAL SECTION END /////////////////
+    pthread_mutex_unlock(&batchMutex);
+    if (!ready) {
+        return 0;
+    }
+    post_batch(batch, 0);
+    return 0200;
 }
 
 void CameraNode::setOutput(Mat image) {
@@ -303,7 +887,7 @@ void CameraNode::setOutput(Mat image) {
     param[0] = CV_IMWRITE_PNG_COMPRESSION;
     param[1] = 95; // 0..100; default 95
     imencode(".jpg", image, jpgBuf, param);
-    SmartPointer<char> jpg((char *)jpgBuf.data(), jpgBuf.size());
+    SmartPointer<char> jpg((char *)jpgBuf.data(), jpgBuf.size(), SmartPointer<char>::POOL);
     src_output_jpg.post(jpg);
     src_monitor_jpg.get(); // discard stale image
     LOGTRACE1("CameraNode::setOutput(%ldB)", (ulong)jpg.size());
@@ -318,15 +902,22 @@ int CameraNode::async_update_monitor_jpg() {
 
     const char *fmt;
     SmartPointer<char> jpg;
+    int source;
     if (BackgroundWorker::seconds() - output_seconds < monitor_duration) {
         jpg = src_output_jpg.get();
-        processed |= 01000;
+        source = 01000;
         fmt = "async_update_monitor_jpg() src_output_jpg.get(%ldB) %0lx [0]:%0lx";
     } else {
         jpg = src_camera_jpg.get();
-        processed |= 02000;
+        source = 02000;
         fmt = "async_update_monitor_jpg() src_camera_jpg.get(%ldB) %0lx [0]:%0lx";
     }
+    if (jpg.data() == src_monitor_jpg.peek().data()) {
+        // Reposting the same image would wake next/monitor.jpg readers for no new frame.
+        // monitor.jpg stays consumed and is posted as soon as its source changes.
+        return processed;
+    }
+    processed |= source;
     src_monitor_jpg.post(jpg);
 
     char *pData = jpg.data();
@@ -340,9 +931,18 @@ int CameraNode::async_update_monitor_jpg() {
 BackgroundWorker::BackgroundWorker() {
     idle_seconds = BackgroundWorker::seconds(); // set time of last idle() execution to current second count
     idle_period = 15; // minimum seconds between idle() execution
+    cve_threads = 0; // execute CVEs on the worker thread
+    pool_threads = 0;
+    gcode_threaded = FALSE;
+    started.store(FALSE);
+    ASSERTZERO(pthread_mutex_init(&cveQueueMutex, NULL));
+    ASSERTZERO(pthread_cond_init(&cveQueueCond, NULL));
 }
 
 BackgroundWorker::~BackgroundWorker() {
+    for (std::map<string,CameraNodePtr>::iterator it=cameraMap.begin(); it!=cameraMap.end(); ++it) {
+        delete it->second;
+    }
 }
 
 //Execute a system shell command
@@ -377,13 +977,23 @@ void BackgroundWorker::clear() {
     for (std::map<string,DCEPtr>::iterator it=dceMap.begin(); it!=dceMap.end(); ++it) {
         delete it->second;
     }
-    for (int i=0; i < MAX_CAMERAS; i++) {
-        cameras[i].clear();
+    for (std::map<string,CameraNodePtr>::iterator it=cameraMap.begin(); it!=cameraMap.end(); ++it) {
+        it->second->clear();
     }
     dceMap.clear();
     serialMap.clear();
 }
 
+vector<string> BackgroundWorker::getCameraNames() {
+    vector<string> result;
+
+    for (std::map<string,CameraNodePtr>::iterator it=cameraMap.begin(); it!=cameraMap.end(); ++it) {
+        result.push_back(it->first);
+    }
+
+    return result;
+}
+
 vector<string> BackgroundWorker::getCveNames() {
     vector<string> result;
 
@@ -413,7 +1023,8 @@ DCE& BackgroundWorker::dce(string path, bool create) {
         LOGERROR1("%s", err.c_str());
         throw err;
     }
-    DCEPtr pDce = dceMap[dcePath];
+    std::map<string,DCEPtr>::iterator it = dceMap.find(dcePath); // no insert: FUSE threads look up concurrently
+    DCEPtr pDce = it == dceMap.end() ? NULL : it->second;
     if (!pDce) {
         if (!create) {
             string err("BackgroundWorkder::dce(");
@@ -422,12 +1033,54 @@ DCE& BackgroundWorker::dce(string path, bool create) {
             LOGERROR1("%s", err.c_str());
             throw err;
         }
+        if (started.load()) { // maps are read by worker and FUSE threads without locks
+            string err("BackgroundWorkder::dce(");
+            err += path;
+            err += ") cannot be configured after BackgroundWorker has started";
+            LOGERROR1("%s", err.c_str());
+            throw err;
+        }
         pDce = new DCE(dcePath);
+        pDce->snk_gcode_fire.setEvent(&event);
         dceMap[dcePath] = pDce;
     }
     return *pDce;
 }
 
+CameraNode& BackgroundWorker::camera(string path, bool create) {
+    string cameraPath = CameraNode::camera_path(path.c_str());
+    if (cameraPath.empty()) {
+        string err("BackgroundWorkder::camera(");
+        err += path;
+        err += ") invalid camera path";
+        LOGERROR1("%s", err.c_str());
+        throw err;
+    }
+    std::map<string,CameraNodePtr>::iterator it = cameraMap.find(cameraPath); // no insert: FUSE threads look up concurrently
+    CameraNodePtr pCamera = it == cameraMap.end() ? NULL : it->second;
+    if (!pCamera) {
+        if (!create) {
+            string err("BackgroundWorkder::camera(");
+            err += path;
+            err += ") camera has not been configured";
+            LOGERROR1("%s", err.c_str());
+            throw err;
+        }
+        if (started.load()) { // maps are read by worker and FUSE threads without locks
+            string err("BackgroundWorkder::camera(");
+            err += path;
+            err += ") cannot be configured after BackgroundWorker has started";
+            LOGERROR1("%s", err.c_str());
+            throw err;
+        }
+        pCamera = new CameraNode(cameraPath);
+        pCamera->src_camera_jpg.setEvent(&event);
+        pCamera->src_monitor_jpg.setEvent(&event);
+        cameraMap[cameraPath] = pCamera;
+    }
+    return *pCamera;
+}
+
 CVE& BackgroundWorker::cve(string path, bool create) {
     string cvePath = CVE::cve_path(path.c_str());
     if (cvePath.empty()) {
@@ -437,7 +1090,8 @@ CVE& BackgroundWorker::cve(string path, bool create) {
         LOGERROR1("%s", err.c_str());
         ASSERTFAIL("invalid CVE path");
     }
-    CVEPtr pCve = cveMap[cvePath];
+    std::map<string,CVEPtr>::iterator it = cveMap.find(cvePath); // no insert: FUSE threads look up concurrently
+    CVEPtr pCve = it == cveMap.end() ? NULL : it->second;
     if (!pCve) {
         if (!create) {
             string err("BackgroundWorkder::cve(");
@@ -446,7 +1100,16 @@ CVE& BackgroundWorker::cve(string path, bool create) {
             LOGERROR1("%s", err.c_str());
             throw err;
         }
-        pCve = new CVE(cvePath);
+        if (started.load()) { // maps are read by worker and FUSE threads without locks
+            string err("BackgroundWorkder::cve(");
+            err += path;
+            err += ") cannot be configured after BackgroundWorker has started";
+            LOGERROR1("%s", err.c_str());
+            throw err;
+        }
+        pCve = new CVE(cvePath, &camera(cvePath, TRUE));
+        pCve->src_save_fire.setEvent(&event);
+        pCve->src_process_fire.setEvent(&event);
         cveMap[cvePath] = pCve;
     }
     return *pCve;
@@ -457,13 +1120,18 @@ void BackgroundWorker::idle() {
     idle_seconds = BackgroundWorker::seconds();
     //it consumes any fresh monitor.jpg and therefore makes the monitor queue be stale.
     //It is a signal to downstream sync methods to wait for the fresh
-    SmartPointer<char> discard = cameras[0].src_monitor_jpg.get();
+    for (std::map<string,CameraNodePtr>::iterator it=cameraMap.begin(); it!=cameraMap.end(); ++it) {
+        SmartPointer<char> discard = it->second->src_monitor_jpg.get();
+        LOGINFO3("BackgroundWorker::idle(%s) src_monitor_jpg.get() -> %ldB@%0lx discarded",
+                 it->first.c_str(), (ulong) discard.size(), (ulong) discard.data());
+    }
     idle_seconds = BackgroundWorker::seconds();
-    LOGINFO2("BackgroundWorker::idle() src_monitor_jpg.get() -> %ldB@%0lx discarded", (ulong) discard.size(), (ulong) discard.data());
 }
 
 void BackgroundWorker::processInit() {
-    cameras[0].init();
+    for (std::map<string,CameraNodePtr>::iterator it=cameraMap.begin(); it!=cameraMap.end(); ++it) {
+        it->second->init();
+    }
 }
 
 int BackgroundWorker::async_gcode_fire() {
@@ -485,10 +1153,9 @@ int BackgroundWorker::async_process_fire() {
     int mask = 010;
     for (std::map<string,CVEPtr>::iterator it=cveMap.begin(); it!=cveMap.end(); ++it) {
         CVEPtr pCve = it->second;
-        if (!pCve->src_process_fire.isFresh()) {
-            processed |= mask;
+        if (!pCve->src_process_fire.isFresh() || pCve->isSeePending()) {
             LOGTRACE1("BackgroundWorker::async_process_fire(%s)", it->first.c_str());
-            pCve->process(this);
+            processed |= dispatch_cve(pCve, mask);
         }
     }
     return processed;
@@ -500,14 +1167,124 @@ int BackgroundWorker::async_save_fire() {
     for (std::map<string,CVEPtr>::iterator it=cveMap.begin(); it!=cveMap.end(); ++it) {
         CVEPtr pCve = it->second;
         if (!pCve->src_save_fire.isFresh()) {
-            processed |= mask;
             LOGTRACE1("BackgroundWorker::async_save_fire(%s)", it->first.c_str());
-            pCve->save(this);
+            processed |= dispatch_cve(pCve, mask);
         }
     }
     return processed;
 }
 
+/**
+ * Execute the CVE save (020) or process (010) request on the worker thread,
+ * or queue it for a CVE thread. Return mask if the request was dispatched or
+ * 0 if the CVE is still busy with a previous request.
+ */
+int BackgroundWorker::dispatch_cve(CVEPtr pCve, int mask) {
+    if (!pCve->claim()) {
+        return 0;
+    }
+    CVEJob job;
+    job.pCve = pCve;
+    job.mask = mask;
+    job.queued_seconds = BackgroundWorker::seconds();
+    if (pool_threads == 0) {
+        run_cve_job(job);
+    } else {
+        pthread_mutex_lock(&cveQueueMutex);
+        /////////////// CRITICAL SECTION BEGIN ///////////////
+        cveQueue.push_back(job);
+        pthread_cond_signal(&cveQueueCond);
+        /////////////// CRITICAL SECTION END /////////////////
+        pthread_mutex_unlock(&cveQueueMutex);
+    }
+    return mask;
+}
+
+/**
+ * Run a claimed CVE job and release the CVE, even if the job throws.
+ */
+void BackgroundWorker::run_cve_job(CVEJob &job) {
+    double sStart = BackgroundWorker::seconds();
+    try {
+        if (job.mask == 020) {
+            job.pCve->save(this);
+        } else {
+            job.pCve->process(this);
+        }
+    } catch (const char * ex) {
+        LOGERROR2("BackgroundWorker::run_cve_job(%s) EXCEPTION: %s", job.pCve->getName().c_str(), ex);
+    } catch (string ex) {
+        LOGERROR2("BackgroundWorker::run_cve_job(%s) EXCEPTION: %s", job.pCve->getName().c_str(), ex.c_str());
+    } catch (...) {
+        LOGERROR1("BackgroundWorker::run_cve_job(%s) UNKNOWN EXCEPTION", job.pCve->getName().c_str());
+    }
+    double sEnd = BackgroundWorker::seconds();
+    job.pCve->setTimes(sStart - job.queued_seconds, sEnd - sStart);
+    job.pCve->release();
+    event.notify(); // requests that arrived while the CVE was busy
+    LOGDEBUG4("BackgroundWorker::run_cve_job(%s,%o) queue:%0.3fs exec:%0.3fs",
+              job.pCve->getName().c_str(), job.mask, sStart - job.queued_seconds, sEnd - sStart);
+}
+
+void * BackgroundWorker::cve_thread(void *arg) {
+    BackgroundWorker *pWorker = (BackgroundWorker *) arg;
+    for (;;) {
+        pthread_mutex_lock(&pWorker->cveQueueMutex);
+        /////////////// CRITICAL SECTION BEGIN ///////////////
+        while (pWorker->cveQueue.empty()) {
+            pthread_cond_wait(&pWorker->cveQueueCond, &pWorker->cveQueueMutex);
+        }
+        CVEJob job = pWorker->cveQueue.front();
+        pWorker->cveQueue.pop_front();
+        /////////////// CRITICAL SECTION END /////////////////
+        pthread_mutex_unlock(&pWorker->cveQueueMutex);
+        pWorker->run_cve_job(job);
+    }
+    return NULL;
+}
+
+void * BackgroundWorker::gcode_thread(void *arg) {
+    BackgroundWorker *pWorker = (BackgroundWorker *) arg;
+    LOGINFO("BackgroundWorker::gcode_thread() start");
+    for (;;) {
+        long events = pWorker->event.getCount();
+        if (pWorker->async_gcode_fire() == 0) {
+            pWorker->event.wait(events, MAX_WORKER_WAIT_MS);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Start the CVE thread pool and gcode_thread. Windowed serial streaming waits
+ * for acks in DCE::await_window(), so a DCE with a serial window always gets
+ * gcode_thread and never stalls the cameras and CVEs serviced by processLoop().
+ */
+void BackgroundWorker::startThreads() {
+    int rc = 0;
+    pthread_t tid;
+    started.store(TRUE);
+    for (int i=0; i < cve_threads; i++) {
+        LOGRC(rc, "pthread_create(cve_thread) -> ", pthread_create(&tid, NULL, &cve_thread, this));
+        if (rc == 0) {
+            pthread_detach(tid);
+            pool_threads++;
+        }
+    }
+    bool windowed = FALSE;
+    for (std::map<string,DCEPtr>::iterator it=dceMap.begin(); it!=dceMap.end(); ++it) {
+        windowed = windowed || it->second->get_serial_window() > 0;
+    }
+    if (pool_threads || windowed) {
+        LOGRC(rc, "pthread_create(gcode_thread) -> ", pthread_create(&tid, NULL, &gcode_thread, this));
+        if (rc == 0) {
+            pthread_detach(tid);
+            gcode_threaded = TRUE;
+        }
+    }
+    LOGINFO2("BackgroundWorker::startThreads() cve_threads:%d gcode_thread:%d", pool_threads, gcode_threaded);
+}
+
 double BackgroundWorker::seconds() {
     int64 ticks = getTickCount();
     double ticksPerSecond = getTickFrequency();
@@ -517,11 +1294,18 @@ double BackgroundWorker::seconds() {
 
 int BackgroundWorker::processLoop() {
     int processed = 0;
-    processed |= async_gcode_fire();
-    processed |= cameras[0].async_update_camera_jpg();
+    if (!gcode_threaded) {
+        processed |= async_gcode_fire();
+    }
+    for (std::map<string,CameraNodePtr>::iterator it=cameraMap.begin(); it!=cameraMap.end(); ++it) {
+        processed |= it->second->async_update_camera_jpg();
+    }
     processed |= async_save_fire();
     processed |= async_process_fire();
-    processed |= cameras[0].async_update_monitor_jpg();
+    for (std::map<string,CameraNodePtr>::iterator it=cameraMap.begin(); it!=cameraMap.end(); ++it) {
+        processed |= it->second->async_batch_fire();
+        processed |= it->second->async_update_monitor_jpg();
+    }
 
     if (idle_period && processed == 0 && (BackgroundWorker::seconds() - idle_seconds >= idle_period)) {
         idle();
@@ -533,13 +1317,43 @@ int BackgroundWorker::processLoop() {
     return processed;
 }
 
+/**
+ * Return milliseconds until the next timed duty (idle capture or idle()).
+ * Cache posts and consumption wake the worker earlier via event.
+ */
+int BackgroundWorker::next_wait_ms() {
+    double now = BackgroundWorker::seconds();
+    double wait = MAX_WORKER_WAIT_MS/1000.0;
+    double deadline;
+    for (std::map<string,CameraNodePtr>::iterator it=cameraMap.begin(); it!=cameraMap.end(); ++it) {
+        deadline = it->second->get_next_capture_seconds();
+        if (now < deadline && deadline - now < wait) {
+            wait = deadline - now;
+        }
+        long msRequested = it->second->get_capture_wait_ms();
+        if (msRequested >= 0 && msRequested/1000.0 < wait) {
+            wait = msRequested/1000.0;
+        }
+    }
+    if (idle_period) {
+        deadline = idle_seconds + idle_period;
+        if (now < deadline && deadline - now < wait) {
+            wait = deadline - now;
+        }
+    }
+    return (int) (wait * 1000 + 1);
+}
+
 void BackgroundWorker::process() {
     try {
         processInit();
+        startThreads();
 
         for (;;) {
-            processLoop();
-            sched_yield();
+            long events = event.getCount();
+            if (processLoop() == 0) {
+                event.wait(events, next_wait_ms());
+            }
         }
 
         LOGINFO("BackgroundWorker::process() exiting");
@@ -74,3 +74,187 @@ bool SpiralIterator::next() {
 }
 
 /////////////////////////////////////////////////////////////////////////
+
+////////////////////////////// CalibrateJob /////////////////////
+
+CalibrateJob::CalibrateJob(CVE *pCve) {
+  this->pCve = pCve;
+  this->pDce = NULL;
+  this->joinable = FALSE;
+  this->running = FALSE;
+  this->cancelled.store(FALSE);
+  this->positions = 0;
+  this->start_seconds = 0;
+  ASSERTZERO(pthread_mutex_init(&jobMutex, NULL));
+  ASSERTZERO(pthread_cond_init(&jobCond, NULL));
+}
+
+CalibrateJob::~CalibrateJob() {
+  cancel();
+  if (joinable) {
+    pthread_join(tidJob, NULL);
+  }
+  pthread_cond_destroy(&jobCond);
+  pthread_mutex_destroy(&jobMutex);
+}
+
+int CalibrateJob::start(DCE &dce, SpiralIterator spiral, string moveTemplate) {
+  int rc = 0;
+  pthread_mutex_lock(&jobMutex);
+  /////////////// CRITICAL SECTION BEGIN ///////////////
+  if (running) {
+    rc = -EAGAIN;
+  } else {
+    if (joinable) {
+      pthread_join(tidJob, NULL); // previous job has finished
+      joinable = FALSE;
+    }
+    this->pDce = &dce;
+    this->spiral = spiral;
+    this->move_template = moveTemplate;
+    cancelled.store(FALSE);
+    results.clear();
+    positions = 0;
+    start_seconds = BackgroundWorker::seconds();
+    running = TRUE;
+    post("ACTIVE");
+    LOGRC(rc, "pthread_create(CalibrateJob::calibrate_thread) -> ", pthread_create(&tidJob, NULL, &calibrate_thread, this));
+    if (rc) {
+      running = FALSE;
+      post("ERROR");
+    } else {
+      joinable = TRUE;
+    }
+  }
+  /////////////// CRITICAL SECTION END /////////////////
+  pthread_mutex_unlock(&jobMutex);
+  return rc;
+}
+
+void CalibrateJob::wait() {
+  pthread_mutex_lock(&jobMutex);
+  while (running) {
+    pthread_cond_wait(&jobCond, &jobMutex);
+  }
+  pthread_mutex_unlock(&jobMutex);
+}
+
+void CalibrateJob::cancel() {
+  cancelled.store(TRUE);
+}
+
+bool CalibrateJob::isRunning() {
+  pthread_mutex_lock(&jobMutex);
+  bool result = running;
+  pthread_mutex_unlock(&jobMutex);
+  return result;
+}
+
+/**
+ * Post {"status":..., "positions":..., "seconds":..., "results":[...]} to calibrate.fire
+ */
+void CalibrateJob::post(const char *status) {
+  char header[200];
+  snprintf(header, sizeof(header), "{\"status\":\"%s\",\"positions\":%d,\"seconds\":%.3f,\"results\":[",
+    status, positions, BackgroundWorker::seconds() - start_seconds);
+  string json(header);
+  json += results;
+  json += "]}";
+  pCve->src_calibrate_fire.post(SmartPointer<char>((char *)json.c_str(), json.size()));
+}
+
+/**
+ * Send move to (x,y) and have the camera capture on its serial_ack.
+ * Return the serial_ack number or 0 if the move will not be acknowledged.
+ */
+long CalibrateJob::send_move(float x, float y, struct timespec *pSent) {
+  string gcode(move_template);
+  char value[32];
+  size_t pos;
+  snprintf(value, sizeof(value), "%g", x);
+  while ((pos = gcode.find("{x}")) != string::npos) {
+    gcode.replace(pos, 3, value);
+  }
+  snprintf(value, sizeof(value), "%g", y);
+  while ((pos = gcode.find("{y}")) != string::npos) {
+    gcode.replace(pos, 3, value);
+  }
+  clock_gettime(CLOCK_REALTIME, pSent);
+  long ack = pDce->send_gcode(gcode);
+  pDce->capture_on_ack(ack, pCve->getCamera());
+  LOGDEBUG2("CalibrateJob::send_move(%s) ack:%ld", gcode.c_str(), ack);
+  return ack;
+}
+
+void CalibrateJob::run() {
+  CameraNode &camera = pCve->getCamera();
+  while (!pCve->await_claim(100)) { // wait for BackgroundWorker to finish with CVE
+    if (cancelled.load()) {
+      return;
+    }
+  }
+
+  struct timespec sent;
+  float x = spiral.getX();
+  float y = spiral.getY();
+  long ack = send_move(x, y, &sent);
+  bool more = TRUE;
+  while (more && !cancelled.load()) {
+    json_t *pResult = json_object();
+    json_object_set_new(pResult, "x", json_real(x));
+    json_object_set_new(pResult, "y", json_real(y));
+    struct timespec acked = sent;
+    long frame = 0;
+    if (ack && !pDce->ack_time(ack, &acked, SERIAL_TIMEOUT_SECS*1000)) {
+      json_object_set_new(pResult, "error", json_string("move was not acknowledged"));
+      more = FALSE;
+    } else {
+      frame = camera.frame_after(acked, CAMERA_MSTIMEOUT);
+      if (frame == 0) {
+        json_object_set_new(pResult, "error", json_string("no camera frame after move"));
+      }
+      json_object_set_new(pResult, "frame", json_integer(frame));
+      more = spiral.next();
+      if (more) { // move while processing
+        x = spiral.getX();
+        y = spiral.getY();
+        ack = send_move(x, y, &sent);
+      }
+    }
+    if (frame) {
+      try {
+        Mat image = pCve->frame_mat(frame, TRUE); // ring frame is shared
+        json_object_set_new(pResult, "model", pCve->process_mat(image));
+      } catch (const char * ex) {
+        json_object_set_new(pResult, "error", json_string(ex));
+      } catch (string ex) {
+        json_object_set_new(pResult, "error", json_string(ex.c_str()));
+      } catch (...) {
+        json_object_set_new(pResult, "error", json_string("UNKNOWN EXCEPTION"));
+      }
+    }
+    char *pResultStr = json_dumps(pResult, JSON_PRESERVE_ORDER|JSON_COMPACT|JSON_INDENT(0));
+    if (positions++) {
+      results += ",";
+    }
+    results += pResultStr;
+    free(pResultStr);
+    json_decref(pResult);
+    post("ACTIVE");
+  }
+  pCve->release();
+}
+
+void * CalibrateJob::calibrate_thread(void *arg) {
+  CalibrateJob *pJob = (CalibrateJob *) arg;
+  pJob->run();
+  pthread_mutex_lock(&pJob->jobMutex);
+  /////////////// CRITICAL SECTION BEGIN ///////////////
+  pJob->post(pJob->cancelled.load() ? "CANCELLED" : "DONE");
+  pJob->running = FALSE;
+  pthread_cond_broadcast(&pJob->jobCond);
+  /////////////// CRITICAL SECTION END /////////////////
+  pthread_mutex_unlock(&pJob->jobMutex);
+  LOGINFO2("CalibrateJob::calibrate_thread(%s) positions:%d", pJob->pCve->getName().c_str(), pJob->positions);
+  return NULL;
+}
@@ -8,6 +8,9 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include "firefuse.h"
 #include "version.h"
 
@@ -22,10 +25,10 @@ bool is_cnc_path(const char *path) {
     return FALSE;
 }
 
-int cnc_getattr(const char *path, struct stat *stbuf) {
+int cnc_getattr(const FireNode *pNode, const char *path, struct stat *stbuf) {
     int res = 0;
-    if (firefuse_isFile(path, FIREREST_GCODE_FIRE)) {
-        res = firefuse_getattr_file(path, stbuf, worker.dce(path).src_gcode_fire.peek().size(), 0666);
+    if (pNode->kind == FIRENODE_GCODE_FIRE) {
+        res = firenode_getattr(pNode, path, stbuf);
     } else {
         res = firerest_getattr_default(path, stbuf);
     }
@@ -35,16 +38,16 @@ int cnc_getattr(const char *path, struct stat *stbuf) {
     return res;
 }
 
-int cnc_open(const char *path, struct fuse_file_info *fi) {
+int cnc_open(const FireNode *pNode, const char *path, struct fuse_file_info *fi) {
     int result = 0;
 
-    if (firefuse_isFile(path, FIREREST_GCODE_FIRE)) {
+    if (pNode->kind == FIRENODE_GCODE_FIRE) {
         if (verifyOpenRW(path, fi, &result)) {
-            if ((fi->flags&3) == O_WRONLY && worker.dce(path).snk_gcode_fire.isFresh()) {
+            if ((fi->flags&3) == O_WRONLY && pNode->pDce->snk_gcode_fire.isFresh()) {
                 LOGTRACE("snk_gcode_fire.isFresh()");
                 result = -EAGAIN;
             } else {
-                fi->fh = (uint64_t) (size_t) new SmartPointer<char>(worker.dce(path).src_gcode_fire.get());
+                fi->fh = (uint64_t) (size_t) new FireHandle(pNode, fi->flags, pNode->pDce->src_gcode_fire.get());
             }
         }
     }
@@ -57,19 +60,9 @@ int cnc_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offse
 }
 
 int cnc_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
-    size_t sizeOut = size;
-    size_t len;
-    (void) fi;
-
-    if (firefuse_isFile(path, FIREREST_GCODE_FIRE) ||
-            firefuse_isFile(path, FIREREST_PROPERTIES_JSON) ||
-            FALSE) {
-        SmartPointer<char> *pData = (SmartPointer<char> *) fi->fh;
-        sizeOut = firefuse_readBuffer(buf, (char *)pData->data(), size, offset, pData->size());
-    } else {
-        LOGERROR2("cnc_read(%s, %ldB) ENOENT", path, size);
-        return -ENOENT;
-    }
+    FireHandle *pHandle = (FireHandle *) fi->fh;
+    SmartPointer<char> &data = pHandle->data;
+    size_t sizeOut = firefuse_readBuffer(buf, (char *)data.data(), size, offset, data.size());
 
     LOGTRACE3("cnc_read(%s, %ldB) -> %ldB", path, size, sizeOut);
     return sizeOut;
@@ -80,10 +73,10 @@ int cnc_write(const char *path, const char *buf, size_t bytes, off_t offset, str
     assert(buf != NULL);
     assert(bytes >= 0);
     SmartPointer<char> data((char *) buf, bytes);
-    if (firefuse_isFile(path, FIREREST_GCODE_FIRE)) {
-		DCE &dce = worker.dce(path);
-		dce.setSync(FireREST::isSync(path));
-		dce.send_request(data);
+    const FireNode *pNode = ((FireHandle *) fi->fh)->pNode;
+    if (pNode->kind == FIRENODE_GCODE_FIRE) {
+		DCE &dce = *pNode->pDce;
+		dce.send_request(data, pNode->sync);
         string cmd(buf, bytes);
 		// ignore offset because we're writing to a raw output-only device that is not random-access
         LOGTRACE3("DCE::cnc_write(%s) offset:%ld sync:%d", cmd.c_str(), (long) offset, dce.isSync());
@@ -91,7 +84,7 @@ int cnc_write(const char *path, const char *buf, size_t bytes, off_t offset, str
         json_object_set(response, "status", json_string("ACTIVE"));
         json_object_set(response, "gcode", json_string(cmd.c_str()));
         char *responseStr = json_dumps(response, JSON_PRESERVE_ORDER|JSON_COMPACT|JSON_INDENT(0));
-        worker.dce(path).src_gcode_fire.post(
+        dce.src_gcode_fire.post(
 			SmartPointer<char>(responseStr, strlen(responseStr), SmartPointer<char>::MANAGE));
         json_decref(response);
     } else {
@@ -103,18 +96,14 @@ int cnc_write(const char *path, const char *buf, size_t bytes, off_t offset, str
 }
 
 int cnc_release(const char *path, struct fuse_file_info *fi) {
-    int result = 0;
     LOGTRACE1("cnc_release(%s)", path);
-    if (firefuse_isFile(path, FIREREST_GCODE_FIRE)) {
-        if (fi->fh) {
-            free( (SmartPointer<char> *) fi->fh);
-        }
-    }
+    delete (FireHandle *) fi->fh;
+    fi->fh = 0;
     return 0;
 }
 
 
-int cnc_truncate(const char *path, off_t size) {
+int cnc_truncate(const FireNode *pNode, const char *path, off_t size) {
     int result = 0;
     return result;
 }
@@ -127,30 +116,51 @@ int cnc_truncate(const char *path, off_t size) {
 
 DCE::DCE(string name) {
     this->name = name;
-	this->is_sync = FALSE;
+	this->is_sync.store(FALSE);
+    pthread_mutex_init(&requestMutex, NULL);
     this->serial_fd = -1;
+    this->shutdown_fd = -1;
+    this->reader_active = FALSE;
+    this->serial_window = 0;
+    this->streaming = FALSE;
+    this->activeRequests = 0;
+    this->acks = 0;
+    this->sends = 0;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ackCond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&ackMutex, NULL);
     this->jsonBuf = (char*)malloc(JSONMAX+3); // +nl, cr, EOS
     this->inbuf = (char*)malloc(INBUFMAX+1); // +EOS
-	LOGTRACE2("DCE::DCE(%s) isSync:%d", name.c_str(), is_sync);
+	LOGTRACE2("DCE::DCE(%s) isSync:%d", name.c_str(), isSync());
     init();
 }
 
 DCE::~DCE() {
+    serial_shutdown();
     if (jsonBuf) {
         free(jsonBuf);
     }
     if (inbuf) {
         free(inbuf);
     }
+    pthread_cond_destroy(&ackCond);
+    pthread_mutex_destroy(&ackMutex);
+    pthread_mutex_destroy(&requestMutex);
 }
 
 void DCE::setSync(bool value) {
-	if (value != is_sync) {
+	if (value != isSync()) {
+		pthread_mutex_lock(&ackMutex);
 		if (activeRequests > 0) {
 			LOGWARN2("DCE::setSync(%d) clearing activeRequests:%d", value, activeRequests);
 			activeRequests = 0;
+			pthread_cond_broadcast(&ackCond);
 		} 
-		is_sync = value;
+		pthread_mutex_unlock(&ackMutex);
+		is_sync.store(value);
 		LOGINFO1("DCE::setSync(%d)", value);
 	}
 }
@@ -159,36 +169,99 @@ void DCE::init() {
     LOGINFO1("DCE::init(%s)", name.c_str());
     const char *emptyJson = "{}";
     src_gcode_fire.post(SmartPointer<char>((char *)emptyJson, strlen(emptyJson)));
-    if (serial_fd >= 0) {
-        LOGINFO2("DCE::init(%s) close serial port: %s", name.c_str(), serial_path.c_str());
-        close(serial_fd);
-        serial_fd = -1;
-    }
+    serial_shutdown();
     jsonLen = 0;
     jsonDepth = 0;
     inbuflen = 0;
     inbufEmptyLine = 0;
+    pthread_mutex_lock(&ackMutex);
     activeRequests = 0;
+    acks = 0;
+    sends = 0;
+    sees.clear();
+    seen.clear();
+    pthread_cond_broadcast(&ackCond);
+    pthread_mutex_unlock(&ackMutex);
+}
+
+void DCE::serial_shutdown() {
+    if (reader_active) {
+        LOGINFO1("DCE::serial_shutdown(%s) stopping serial_reader_thread", name.c_str());
+        uint64_t one = 1;
+        if (write(shutdown_fd, &one, sizeof(one)) != sizeof(one)) {
+            LOGERROR1("DCE::serial_shutdown(%s) eventfd write failed", name.c_str());
+        }
+        pthread_join(tidReader, NULL);
+        reader_active = FALSE;
+    }
+    if (shutdown_fd >= 0) {
+        close(shutdown_fd);
+        shutdown_fd = -1;
+    }
+    if (serial_fd >= 0) {
+        LOGINFO2("DCE::serial_shutdown(%s) close serial port: %s", name.c_str(), serial_path.c_str());
+        close(serial_fd);
+        serial_fd = -1;
+    }
 }
 
-void DCE::send_request(SmartPointer<char> &data) {
+void DCE::send_request(SmartPointer<char> &data, bool sync) {
+	/////////////// CRITICAL SECTION BEGIN ///////////////
+	pthread_mutex_lock(&requestMutex);
+	setSync(sync);
 	long msStart = millis();
 	snk_gcode_fire.post(data);
-	if (is_sync) {
-		double seconds = 0;
-		while (snk_gcode_fire.isFresh() || activeRequests > 0) {
-			seconds = (millis() - msStart)/1000.0;
-			if (seconds > SERIAL_TIMEOUT_SECS) {
-				break;
-			}
-			usleep(100*1000);
+	if (sync) {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		ts.tv_sec += SERIAL_TIMEOUT_SECS;
+		int rc = 0;
+		pthread_mutex_lock(&ackMutex);
+		// woken by the final serial_ack rather than by polling
+		while ((snk_gcode_fire.isFresh() || streaming || activeRequests > 0) && rc == 0) {
+			rc = pthread_cond_timedwait(&ackCond, &ackMutex, &ts);
+		}
+		int active = activeRequests;
+		vector<CVEPtr> awaited;
+		awaited.swap(seen);
+		if (!sees.empty()) {
+			LOGERROR1("DCE::send_request() %d process.fire requests not acknowledged", (int) sees.size());
+			sees.clear();
+		}
+		pthread_mutex_unlock(&ackMutex);
+		for (int i = 0; i < awaited.size(); i++) { // return after the CVEs have seen the move
+			awaited[i]->await_see(PROCESS_MSTIMEOUT);
 		}
-		if (activeRequests > 0 && seconds > SERIAL_TIMEOUT_SECS) {
+		double seconds = (millis() - msStart)/1000.0;
+		if (rc == ETIMEDOUT) {
 			LOGERROR1("DCE::send_request() SERIAL TIMEOUT:%ds", SERIAL_TIMEOUT_SECS);
 		} else {
-			LOGDEBUG2("DCE::send_request() complete:%gs activeRequests:%d", seconds, activeRequests);
+			LOGDEBUG2("DCE::send_request() complete:%gs activeRequests:%d", seconds, active);
 		}
 	}
+	pthread_mutex_unlock(&requestMutex);
+	/////////////// CRITICAL SECTION END /////////////////
+}
+
+/**
+ * Block until fewer than serial_window lines are unacknowledged
+ */
+void DCE::await_window() {
+	if (serial_window <= 0) {
+		return;
+	}
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_sec += SERIAL_TIMEOUT_SECS;
+	int rc = 0;
+	pthread_mutex_lock(&ackMutex);
+	while (activeRequests >= serial_window && rc == 0) {
+		rc = pthread_cond_timedwait(&ackCond, &ackMutex, &ts);
+	}
+	pthread_mutex_unlock(&ackMutex);
+	if (rc == ETIMEDOUT) {
+		LOGERROR2("DCE::await_window(%d) SERIAL TIMEOUT:%ds", serial_window, SERIAL_TIMEOUT_SECS);
+	}
 }
 
 /**
@@ -289,7 +362,14 @@ int DCE::serial_init() {
         }
         LOGINFO1("DCE::serial_init(%s) opened for write", path);
 
+        shutdown_fd = eventfd(0, EFD_CLOEXEC);
+        if (shutdown_fd < 0) {
+            rc = errno;
+            LOGERROR2("DCE::serial_init(%s) eventfd failed -> %d", path, rc);
+            return rc;
+        }
         LOGRC(rc, "pthread_create(serial_reader_thread) -> ", pthread_create(&tidReader, NULL, &serial_reader_thread, this));
+        reader_active = rc == 0;
         LOGINFO("DCE::serial_init() yielding to serial_reader_thread");
 		usleep(500*1000);
 
@@ -338,28 +418,180 @@ vector<string> DCE::gcode_lines(const string &gcode) {
 
 int DCE::gcode(BackgroundWorker *pWorker) {
     if (snk_gcode_fire.isFresh()) {
+        pthread_mutex_lock(&ackMutex);
+        streaming = TRUE;
+        pthread_mutex_unlock(&ackMutex);
         SmartPointer<char> request = snk_gcode_fire.get();
         string gcode(request.data(), request.size());
         vector<string> lines(gcode_lines(gcode));
 
         for (int i = 0; i < lines.size(); i++) {
+            await_window(); // refilled as acks arrive
             json_t *response = json_object();
             json_object_set(response, "status", json_string("ACTIVE"));
             json_t *json_cmd = json_string(lines[i].c_str());
             json_object_set(response, "gcode", json_cmd);
 
-            send_line(lines[i], response);
+            if (lines[i].compare(0, strlen(FIREREST_GCODE_SEE), FIREREST_GCODE_SEE) == 0) {
+                gcode_see(pWorker, lines[i], response);
+            } else {
+                send_line(lines[i], response);
+            }
 
             char * responseStr = json_dumps(response, JSON_PRESERVE_ORDER|JSON_COMPACT|JSON_INDENT(0));
             LOGTRACE2("DCE::gcode(%s) -> %s", json_string_value(json_cmd), responseStr);
             src_gcode_fire.post(SmartPointer<char>(responseStr, strlen(responseStr), SmartPointer<char>::MANAGE));
             json_decref(response);
         }
+        pthread_mutex_lock(&ackMutex);
+        streaming = FALSE;
+        pthread_cond_broadcast(&ackCond);
+        pthread_mutex_unlock(&ackMutex);
     }
 
     return 0;
 }
 
+long DCE::getAcks() {
+    pthread_mutex_lock(&ackMutex);
+    long result = acks;
+    pthread_mutex_unlock(&ackMutex);
+    return result;
+}
+
+long DCE::reader_cpu_micros() {
+    clockid_t clock;
+    struct timespec ts;
+    if (!reader_active || pthread_getcpuclockid(tidReader, &clock) || clock_gettime(clock, &ts)) {
+        return -1;
+    }
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+/**
+ * Wait up to msTimeout for serial_ack number ack (1-based since init()) and return its time.
+ * Return FALSE on timeout or if the ack is too old to be remembered.
+ */
+bool DCE::ack_time(long ack, struct timespec *pTime, int msTimeout) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_sec += msTimeout / 1000;
+	ts.tv_nsec += (msTimeout % 1000) * 1000000L;
+	ts.tv_sec += ts.tv_nsec / 1000000000L;
+	ts.tv_nsec %= 1000000000L;
+	int rc = 0;
+	pthread_mutex_lock(&ackMutex);
+	/////////////// CRITICAL SECTION BEGIN ///////////////
+	while (acks < ack && rc == 0) {
+		rc = pthread_cond_timedwait(&ackCond, &ackMutex, &ts);
+	}
+	long count = acks;
+	bool found = ack > 0 && ack <= count && count - ack < DCE_ACK_HISTORY;
+	if (found) {
+		*pTime = ackTimes[ack % DCE_ACK_HISTORY];
+	}
+	/////////////// CRITICAL SECTION END /////////////////
+	pthread_mutex_unlock(&ackMutex);
+	if (!found) {
+		LOGDEBUG2("DCE::ack_time(%ld) unavailable acks:%ld", ack, count);
+	}
+	return found;
+}
+
+/**
+ * Have the CVE process the first frame captured after acked and remember it for sync requests
+ */
+void DCE::see(CVEPtr pCve, const struct timespec &acked) {
+	pCve->see(acked);
+	if (std::find(seen.begin(), seen.end(), pCve) == seen.end()) {
+		seen.push_back(pCve);
+	}
+}
+
+/**
+ * Handle a FIREREST_GCODE_SEE line (e.g., ";process.fire /cv/1/gray/cve/calc-offset").
+ * The line is not sent. Instead, the CVE camera captures as soon as the serial_ack
+ * for the preceding line arrives and the CVE processes that frame.
+ */
+void DCE::gcode_see(BackgroundWorker *pWorker, const string &line, json_t *response) {
+	string cvePath = CVE::cve_path(line.c_str() + strlen(FIREREST_GCODE_SEE));
+	CVEPtr pCve = NULL;
+	if (!cvePath.empty()) {
+		try {
+			pCve = &(pWorker ? pWorker : &worker)->cve(cvePath);
+		} catch (string ex) {
+			pCve = NULL;
+		}
+	}
+	if (pCve == NULL) {
+		LOGERROR1("DCE::gcode_see(%s) unknown CVE", line.c_str());
+		json_object_set(response, "status", json_string("ERROR"));
+		json_object_set(response, "response", json_string("Unknown CVE"));
+		return;
+	}
+
+	bool isAcked = FALSE;
+	pthread_mutex_lock(&ackMutex);
+	/////////////// CRITICAL SECTION BEGIN ///////////////
+	if (sends <= acks) { // preceding move is complete (or there was none)
+		struct timespec acked;
+		if (sends > 0 && acks - sends < DCE_ACK_HISTORY) {
+			acked = ackTimes[sends % DCE_ACK_HISTORY];
+		} else {
+			clock_gettime(CLOCK_REALTIME, &acked);
+		}
+		see(pCve, acked);
+		isAcked = TRUE;
+	} else {
+		GcodeSee request;
+		request.ack = sends;
+		request.pCve = pCve;
+		request.pCamera = &pCve->getCamera();
+		sees.push_back(request);
+	}
+	/////////////// CRITICAL SECTION END /////////////////
+	pthread_mutex_unlock(&ackMutex);
+	if (isAcked) {
+		pCve->getCamera().request_capture();
+	}
+	LOGDEBUG2("DCE::gcode_see(%s) acked:%d", cvePath.c_str(), isAcked);
+}
+
+/**
+ * Send a gcode line on behalf of a FireFUSE job (e.g., CalibrateJob) instead of gcode.fire.
+ * Jobs should have exclusive use of the DCE so that serial_ack numbers match their lines.
+ * Return the number of the serial_ack that will acknowledge the line, or 0 if
+ * no serial port is open (e.g., mock) and nothing will be acknowledged.
+ */
+long DCE::send_gcode(const string &line) {
+	if (serial_fd < 0) {
+		LOGDEBUG1("DCE::send_gcode(%s) no serial port", line.c_str());
+		return 0;
+	}
+	await_window();
+	long ack = 0;
+	serial_send(line.c_str(), line.size(), &ack);
+	return ack;
+}
+
+void DCE::capture_on_ack(long ack, CameraNode &camera) {
+	pthread_mutex_lock(&ackMutex);
+	/////////////// CRITICAL SECTION BEGIN ///////////////
+	bool isAcked = ack <= acks;
+	if (!isAcked) {
+		GcodeSee request;
+		request.ack = ack;
+		request.pCve = NULL;
+		request.pCamera = &camera;
+		sees.push_back(request);
+	}
+	/////////////// CRITICAL SECTION END /////////////////
+	pthread_mutex_unlock(&ackMutex);
+	if (isAcked) {
+		camera.request_capture();
+	}
+}
+
 int DCE::post_serial_status(const char *line) {
 	bool isAck = serial_ack.compare(0,serial_ack.size(),inbuf) == 0;
 
@@ -371,10 +603,34 @@ int DCE::post_serial_status(const char *line) {
 	const char * status = "ACTIVE";
     if (isAck) { // requested action is complete
 		status = "ACK";
-		activeRequests = max(0,--activeRequests);
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME, &now); // comparable with CameraFrame::captured
+		vector<CameraNode *> cameras;
+		pthread_mutex_lock(&ackMutex);
+		activeRequests = max(0, activeRequests-1);
+		acks++;
+		ackTimes[acks % DCE_ACK_HISTORY] = now;
+		for (vector<GcodeSee>::iterator it = sees.begin(); it != sees.end(); ) {
+			if (it->ack <= acks) { // move is complete: capture at once
+				if (it->pCve) {
+					see(it->pCve, now);
+				}
+				if (std::find(cameras.begin(), cameras.end(), it->pCamera) == cameras.end()) {
+					cameras.push_back(it->pCamera);
+				}
+				it = sees.erase(it);
+			} else {
+				++it;
+			}
+		}
+		pthread_cond_broadcast(&ackCond); // refill window and wake sync writers
+		pthread_mutex_unlock(&ackMutex);
+		for (int i = 0; i < cameras.size(); i++) {
+			cameras[i]->request_capture(); // capture() would stall this serial reader thread
+		}
     }
 
-	if (!is_sync || isAck) {
+	if (!isSync() || isAck) {
 		const char *s = serial_reader_buf.c_str();
 		json_t *response = json_object();
 		json_object_set(response, "status", json_string(status));
@@ -409,7 +665,7 @@ const char * DCE::read_json() {
     return jsonBuf;
 }
 
-int DCE::serial_send(const char *buf, size_t bufsize) {
+int DCE::serial_send(const char *buf, size_t bufsize, long *pAck) {
 #define LOGBUFMAX 100
     char logmsg[LOGBUFMAX+4];
     for (; bufsize > 0; bufsize--) { // strip leading whitespace
@@ -434,8 +690,14 @@ int DCE::serial_send(const char *buf, size_t bufsize) {
     } else {
         logmsg[bufsize] = 0;
     }
+    pthread_mutex_lock(&ackMutex);
     activeRequests++;
-    LOGDEBUG4("DCE::serial_send(%s) %ldB sync:%d activeRequests:%d", logmsg, bufsize, is_sync, activeRequests);
+    sends++;
+    if (pAck) {
+        *pAck = sends;
+    }
+    pthread_mutex_unlock(&ackMutex);
+    LOGDEBUG4("DCE::serial_send(%s) %ldB sync:%d activeRequests:%d", logmsg, bufsize, isSync(), activeRequests);
     size_t rc = write(serial_fd, buf, bufsize);
     if (rc == bufsize) {
         rc = serial_send_eol(buf, bufsize);
@@ -448,7 +710,7 @@ int DCE::serial_send(const char *buf, size_t bufsize) {
 int DCE::serial_send_eol(const char *buf, size_t bufsize) {
     char lastChar = buf[bufsize-1];
     if (lastChar != '\r' && lastChar != '\n') {
-        LOGTRACE2("DCE::serial_send_eol() sync:%d activeRequests:%d", is_sync, activeRequests);
+        LOGTRACE2("DCE::serial_send_eol() sync:%d activeRequests:%d", isSync(), activeRequests);
         size_t rc = write(serial_fd, "\r", 1);
         if (rc != 1) {
             LOGERROR1("DCE::serial_send_eol() -> [%ld]", rc);
@@ -612,27 +874,53 @@ void * DCE::serial_reader_thread(void *arg) {
     LOGINFO("DCE::serial_reader_thread() listening...");
 
     if (pDce->serial_fd >= 0) {
-        char c;
+        struct pollfd fds[2];
+        fds[0].fd = pDce->serial_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = pDce->shutdown_fd;
+        fds[1].events = POLLIN;
         char loop = TRUE;
         while (loop) {
-            int rc = read(pDce->serial_fd, readbuf, READBUFLEN);
-            if (rc < 0) {
-                if (errno == EAGAIN) {
-                    sched_yield();
+            int nfds = poll(fds, 2, -1); // block until serial input or shutdown
+            if (nfds < 0) {
+                if (errno == EINTR) {
                     continue;
                 }
-                LOGERROR2("DCE::serial_reader_thread(%s) [ERRNO:%d]", pDce->inbuf, errno);
+                LOGERROR1("DCE::serial_reader_thread() poll [ERRNO:%d]", errno);
+                break;
+            }
+            if (fds[1].revents) {
+                LOGINFO("DCE::serial_reader_thread() shutdown");
                 break;
-            } else if (rc == 0) {
-                sched_yield(); // nothing available to read
-                continue;
-            } else  {
+            }
+            if (fds[0].revents & (POLLERR|POLLNVAL)) {
+                LOGERROR1("DCE::serial_reader_thread() poll revents:%x", (int) fds[0].revents);
+                break;
+            }
+            for (;;) { // drain available input
+                int rc = read(pDce->serial_fd, readbuf, READBUFLEN);
+                if (rc < 0) {
+                    if (errno != EAGAIN && errno != EINTR) {
+                        LOGERROR2("DCE::serial_reader_thread(%s) [ERRNO:%d]", pDce->inbuf, errno);
+                        loop = FALSE;
+                    }
+                    break;
+                } else if (rc == 0) { // drained (VMIN=0 tty read returns 0, not EAGAIN)
+                    break;
+                }
                 for (int i = 0; i < rc; i++) {
                     if (!pDce->serial_read_char(readbuf[i])) {
                         loop = FALSE;
                         break;
                     }
                 }
+                if (!loop || rc < READBUFLEN) {
+                    break;
+                }
+            }
+            if (loop && (fds[0].revents & POLLHUP)) {
+                LOGERROR1("DCE::serial_reader_thread(%s) [HANGUP]", pDce->inbuf);
+                loop = FALSE;
             }
         }
     }
@@ -29,8 +29,7 @@ typedef enum {UI_STILL, UI_VIDEO} UIMode;
 
 size_t MAX_SAVED_IMAGE = 3000000; // empirically chosen to handle 400x400 png images
 
-#define CAMERA_MSTIMEOUT 1000
-#define PROCESS_MSTIMEOUT 15000
+#define NEXT_MSTIMEOUT 10000
 #define SAVE_MSTIMEOUT 1000
 
 /**
@@ -99,13 +98,13 @@ static string camera_profile(const char * path) {
     return result;
 }
 
-int cve_rename(const char *path1, const char *path2) {
+int cve_rename(const FireNode *pNode1, const char *path1, const FireNode *pNode2, const char *path2) {
     int res = 0;
 
-    if ( firefuse_isFile(path2, FIREREST_CAMERA_JPG) ) {
+    if (pNode2->kind == FIRENODE_CAMERA_JPG) {
         // for raspistill we simply ignore the rename of camera.jpg~ to camera.jpg
         LOGDEBUG2("cve_rename(%s, %s)", path1, path2);
-		worker.cameras[0].endCapture();
+		pNode2->pCamera->endCapture();
     } else {
         LOGERROR2("cve_rename(%s, %s) -> -EPERM", path1, path2);
         res = -EPERM;
@@ -114,31 +113,34 @@ int cve_rename(const char *path1, const char *path2) {
     return res;
 }
 
-int cve_getattr(const char *path, struct stat *stbuf) {
+int cve_getattr(const FireNode *pNode, const char *path, struct stat *stbuf) {
     int res = 0;
 	bool trace = FALSE;
 
-    if (firefuse_isFile(path, FIREREST_CAMERA_JPG) || firefuse_isFile(path, FIREREST_CAMERA_JPG_TILDE)) {
-        res = firefuse_getattr_file(path, stbuf, worker.cameras[0].src_camera_jpg.peek().size(), 0666);
-    } else if (firefuse_isFile(path, FIREREST_PROPERTIES_JSON)) {
-        res = firefuse_getattr_file(path, stbuf, worker.cve(path).src_properties_json.peek().size(), 0666);
-    } else if (firefuse_isFile(path, FIREREST_OUTPUT_JPG)) {
-        res = firefuse_getattr_file(path, stbuf, worker.cameras[0].src_output_jpg.peek().size(), 0444);
-    } else if (firefuse_isFile(path, FIREREST_MONITOR_JPG)) {
-        res = firefuse_getattr_file(path, stbuf, worker.cameras[0].src_monitor_jpg.peek().size(), 0444);
-    } else if (firefuse_isFile(path, FIREREST_SAVED_PNG)) {
-        res = firefuse_getattr_file(path, stbuf, worker.cve(path).src_saved_png.peek().size(), 0666);
-    } else if (firefuse_isFile(path, FIREREST_SAVE_FIRE)) {
-        size_t bytes = max(MIN_SAVE_SIZE, worker.cve(path).src_save_fire.peek().size());
-        res = firefuse_getattr_file(path, stbuf, bytes, 0444);
-    } else if (firefuse_isFile(path, FIREREST_PROCESS_FIRE)) {
-        size_t bytes = max(MIN_PROCESS_SIZE, worker.cve(path).src_process_fire.peek().size());
-        res = firefuse_getattr_file(path, stbuf, bytes, 0444);
-    } else if (firefuse_isFile(path, FIREREST_FIRESIGHT_JSON)) {
-        res = firefuse_getattr_file(path, stbuf, worker.cve(path).src_firesight_json.peek().size(), 0444);
-    } else {
+    switch (pNode->kind) {
+    case FIRENODE_CAMERA_JPG:
+    case FIRENODE_CAMERA_JPG_TILDE:
+    case FIRENODE_PROPERTIES_JSON:
+    case FIRENODE_OUTPUT_JPG:
+    case FIRENODE_MONITOR_JPG:
+    case FIRENODE_NEXT_OUTPUT_JPG:
+    case FIRENODE_NEXT_MONITOR_JPG:
+    case FIRENODE_SAVED_PNG:
+    case FIRENODE_FIRESIGHT_JSON:
+        res = firenode_getattr(pNode, path, stbuf);
+        break;
+    case FIRENODE_SAVE_FIRE:
+        res = firenode_getattr(pNode, path, stbuf, MIN_SAVE_SIZE);
+        break;
+    case FIRENODE_PROCESS_FIRE:
+    case FIRENODE_CALIBRATE_FIRE:
+    case FIRENODE_BATCH_FIRE:
+        res = firenode_getattr(pNode, path, stbuf, MIN_PROCESS_SIZE);
+        break;
+    default:
 		trace = TRUE;
         res = firerest_getattr_default(path, stbuf);
+        break;
     }
 
 	if (trace) {
@@ -157,62 +159,116 @@ static SmartPointer<char> buildErrorMessage(const char* fmt, const char *path, c
     return SmartPointer<char>((char *)errMsg.c_str(), errMsg.size()+1);
 }
 
-int CVE::process(BackgroundWorker *pWorker) {
-    int result = 0;
+void CVE::clearArgMap() {
+    argMap.clear();
+    for (int i = 0; i < argMapGC.size(); i++) {
+        free(argMapGC[i]);
+    }
+    argMapGC.clear();
+    if (pArgMapJson) {
+        json_decref(pArgMapJson);
+        pArgMapJson = NULL;
+    }
+}
 
-    double sStart = BackgroundWorker::seconds();
-    LOGTRACE1("cve_process(%s) init", name.c_str());
-    string pathBuf(name);
-    const char *path = pathBuf.c_str();
+void CVE::compile() {
+    const char *path = name.c_str();
+    long firesightCount = src_firesight_json.getWriteCount();
     SmartPointer<char> pipelineJson(src_firesight_json.get());
-    char *pModelStr = NULL;
-    SmartPointer<char> jsonResult;
-    vector<void*> gc;
-    try {
-        Pipeline pipeline(pipelineJson.data(), Pipeline::JSON);
-        Mat image = _isColor ?
-                    pWorker->cameras[0].src_camera_mat_bgr.get() :
-                    pWorker->cameras[0].src_camera_mat_gray.get();
-        ArgMap argMap;
-        json_t *pProperties = NULL;
-        struct stat propertiesStat;
-        string propertiesString;
-        SmartPointer<char> properties_json(src_properties_json.get());
+    if (!pPipeline || firesightCount != pipeline_write_count) {
+        delete pPipeline;
+        pPipeline = NULL;
+        pipeline_json = pipelineJson;
+        pPipeline = new Pipeline(pipeline_json.data(), Pipeline::JSON);
+        pipeline_write_count = firesightCount;
+        LOGTRACE2("CVE::compile(%s) firesight.json #%ld", path, firesightCount);
+    }
+
+    long propertiesCount = src_properties_json.getWriteCount();
+    SmartPointer<char> properties_json(src_properties_json.get());
+    if (propertiesCount != argmap_write_count) {
+        clearArgMap();
+        crop = Rect();
+        cropped.store(FALSE);
         if (properties_json.size()) {
-            propertiesString = string(properties_json.data(), properties_json.data()+properties_json.size());
+            string propertiesString(properties_json.data(), properties_json.data()+properties_json.size());
             json_error_t jerr;
-            pProperties = json_loads(propertiesString.c_str(), 0, &jerr);
-            if (json_is_object(pProperties)) {
+            pArgMapJson = json_loads(propertiesString.c_str(), 0, &jerr);
+            if (json_is_object(pArgMapJson)) {
                 const char * key;
                 json_t *pValue;
-                json_object_foreach(pProperties, key, pValue) {
+                json_object_foreach(pArgMapJson, key, pValue) {
                     const char *valueStr = "(unknown)";
                     if (json_is_string(pValue)) {
                         valueStr = json_string_value(pValue);
                     } else {
                         valueStr = json_dumps(pValue, JSON_PRESERVE_ORDER|JSON_COMPACT|JSON_INDENT(0)|JSON_ENCODE_ANY);
-                        gc.push_back((void *) valueStr); // garbage collection list
+                        argMapGC.push_back((void *) valueStr); // garbage collection list
                     }
-                    LOGTRACE3("CVE::process(%s) argMap[%s]=\"%s\"", path, key, valueStr);
+                    LOGTRACE3("CVE::compile(%s) argMap[%s]=\"%s\"", path, key, valueStr);
                     argMap[key] = valueStr;
                 }
+                json_t *pCrop = json_object_get(pArgMapJson, "crop"); // e.g., [350,50,100,100]
+                if (pCrop) {
+                    if (json_array_size(pCrop) == 4) {
+                        crop = Rect((int) json_number_value(json_array_get(pCrop, 0)),
+                                    (int) json_number_value(json_array_get(pCrop, 1)),
+                                    (int) json_number_value(json_array_get(pCrop, 2)),
+                                    (int) json_number_value(json_array_get(pCrop, 3)));
+                    }
+                    if (crop.width <= 0 || crop.height <= 0) {
+                        crop = Rect();
+                        clearArgMap();
+                        LOGERROR2("cve_process(%s) Invalid crop: %s", path, propertiesString.c_str());
+                        throw "crop must be [x,y,width,height] with positive width and height";
+                    }
+                    cropped.store(TRUE);
+                    LOGTRACE4("CVE::compile(%s) crop %dx%d@%d", path, crop.width, crop.height, crop.x);
+                }
             } else {
-                LOGERROR2("cve_process(%s) Could not load properties: %s", name.c_str(), propertiesString.c_str());
+                clearArgMap();
+                LOGERROR2("cve_process(%s) Could not load properties: %s", path, propertiesString.c_str());
                 throw "could not load properties";
             }
         }
-        string savedPath(fuse_root);
-        savedPath += name;
-        savedPath += FIREREST_SAVED_PNG;
-        LOGTRACE3("CVE::process(%s) argMap[%s]=\"%s\"", path, "saved", savedPath.c_str());
-        argMap["saved"] = savedPath.c_str();
-
-        LOGTRACE1("cve_process(%s) process begin", path);
-        json_t *pModel = pipeline.process(image, argMap);
-        LOGTRACE1("cve_process(%s) process end", path);
-        if (pProperties) {
-            json_decref(pProperties);
+        saved_path = fuse_root;
+        saved_path += name;
+        saved_path += FIREREST_SAVED_PNG;
+        LOGTRACE3("CVE::compile(%s) argMap[%s]=\"%s\"", path, "saved", saved_path.c_str());
+        argMap["saved"] = saved_path.c_str();
+        argmap_write_count = propertiesCount;
+        LOGTRACE2("CVE::compile(%s) properties.json #%ld", path, propertiesCount);
+    }
+}
+
+int CVE::process(BackgroundWorker *pWorker) {
+    int result = 0;
+
+    double sStart = BackgroundWorker::seconds();
+    LOGTRACE1("cve_process(%s) init", name.c_str());
+    string pathBuf(name);
+    const char *path = pathBuf.c_str();
+    char *pModelStr = NULL;
+    SmartPointer<char> jsonResult;
+    pthread_mutex_lock(&seeMutex);
+    long seeRequest = see_requested > see_done ? see_requested : 0;
+    struct timespec seeAfter = see_after;
+    pthread_mutex_unlock(&seeMutex);
+    try {
+        compile();
+        long frame;
+        if (seeRequest) { // frame of see() request
+            frame = pCamera->frame_after(seeAfter, CAMERA_MSTIMEOUT);
+            if (frame == 0) {
+                throw "no camera frame captured after see() request";
+            }
+            LOGTRACE2("cve_process(%s) see frame:%ld", path, frame);
+        } else {
+            frame = pCamera->newest_frame();
         }
+        // camera Mat is shared by concurrent CVEs and by batch() CVEs
+        Mat image = frame_mat(frame, seeRequest || pWorker->hasCveThreads());
+        json_t *pModel = process_mat(image);
         int jsonIndent = 0;
         pModelStr = json_dumps(pModel, JSON_PRESERVE_ORDER|JSON_COMPACT|JSON_INDENT(0));
         size_t modelLen = pModelStr ? strlen(pModelStr) : 0;
@@ -220,7 +276,6 @@ int CVE::process(BackgroundWorker *pWorker) {
         jsonResult = SmartPointer<char>(pModelStr, modelLen, SmartPointer<char>::ALLOCATE, bytes, ' ');
         free(pModelStr);
         json_decref(pModel);
-        pWorker->cameras[0].setOutput(image);
         double sElapsed = BackgroundWorker::seconds() - sStart;
         LOGDEBUG3("cve_process(%s) -> JSON %ldB %0.3fs", path, modelLen, sElapsed);
     } catch (const char * ex) {
@@ -237,97 +292,238 @@ int CVE::process(BackgroundWorker *pWorker) {
         jsonResult = buildErrorMessage("cve_process(%s) UNKNOWN EXCEPTION: %s", path, "UNKOWN EXCEPTION");
     }
     src_process_fire.post(jsonResult);
-    for (int i = 0; i < gc.size(); i++) {
-        free(gc[i]);
+    if (seeRequest) {
+        pthread_mutex_lock(&seeMutex);
+        see_done = max(see_done, seeRequest);
+        see_result = jsonResult;
+        pthread_cond_broadcast(&seeCond);
+        pthread_mutex_unlock(&seeMutex);
     }
     return result;
 }
 
-int cve_open(const char *path, struct fuse_file_info *fi) {
+/**
+ * Return the camera frame that the pipeline processes. If properties.json has a
+ * "crop" region (e.g., "crop":[350,50,100,100]), only that region is decoded and
+ * the pipeline, saved.png and output.jpg use its coordinates. Otherwise return
+ * the whole frame, cloned if it must not be shared.
+ * Caller must have claimed the CVE. Throws like compile().
+ */
+Mat CVE::frame_mat(long frame, bool clone) {
+    compile(); // current crop
+    if (crop.area()) {
+        Mat image = pCamera->get_frame_roi(frame, _isColor, crop); // never shared
+        if (image.empty()) {
+            throw "no camera frame in crop region";
+        }
+        return image;
+    }
+    Mat image = pCamera->get_frame_mat(frame, _isColor);
+    return clone ? image.clone() : image;
+}
+
+/**
+ * Run the FireSight pipeline on image and show it as output.jpg.
+ * Caller must have claimed the CVE. Return the new model reference.
+ */
+json_t * CVE::process_mat(Mat image) {
+    compile();
+    ArgMap args(argMap); // pipeline ops may add arguments
+    LOGTRACE1("cve_process(%s) process begin", name.c_str());
+    json_t *pModel = pPipeline->process(image, args);
+    LOGTRACE1("cve_process(%s) process end", name.c_str());
+    pCamera->setOutput(image);
+    return pModel;
+}
+
+static double calibrate_number(json_t *pCalibrate, const char *key, double defaultValue) {
+    json_t *pValue = json_object_get(pCalibrate, key);
+    return json_is_number(pValue) ? json_number_value(pValue) : defaultValue;
+}
+
+/**
+ * Start a CalibrateJob configured by the "calibrate" object of properties.json, e.g.:
+ *   {"calibrate":{"dce":"/cnc/tinyg", "xSteps":21, "ySteps":21, "xScale":1, "yScale":1, "move":"G0X{x}Y{y}"}}
+ * Configuration errors are posted to calibrate.fire. Return -EAGAIN if a job is running.
+ */
+int CVE::calibrate(BackgroundWorker *pWorker) {
+    SmartPointer<char> properties = src_properties_json.peek();
+    string propertiesString(properties.data(), properties.size());
+    json_error_t jerr;
+    json_t *pProperties = json_loads(propertiesString.c_str(), 0, &jerr);
+    json_t *pCalibrateJson = json_object_get(pProperties, "calibrate");
+    const char *errMsg = NULL;
+    DCE *pDce = NULL;
+    int xSteps = (int) calibrate_number(pCalibrateJson, "xSteps", 21);
+    int ySteps = (int) calibrate_number(pCalibrateJson, "ySteps", xSteps);
+    json_t *pMove = json_object_get(pCalibrateJson, "move");
+    string moveTemplate = json_is_string(pMove) ? json_string_value(pMove) : "G0X{x}Y{y}";
+    json_t *pDcePath = json_object_get(pCalibrateJson, "dce");
+    if (!json_is_object(pCalibrateJson)) {
+        errMsg = "properties.json has no calibrate object";
+    } else if (!json_is_string(pDcePath)) {
+        errMsg = "calibrate.dce must name a DCE (e.g., /cnc/tinyg)";
+    } else if (xSteps < 1 || ySteps < 1 || (xSteps != ySteps && xSteps != 1 && ySteps != 1)) {
+        errMsg = "calibrate.xSteps and calibrate.ySteps must be equal or one of them must be 1";
+    } else {
+        try {
+            pDce = &pWorker->dce(json_string_value(pDcePath));
+        } catch (string ex) {
+            errMsg = "calibrate.dce has not been configured";
+        }
+    }
+    if (errMsg) {
+        json_decref(pProperties);
+        src_calibrate_fire.post(buildErrorMessage("CVE::calibrate(%s) %s", name.c_str(), errMsg));
+        return 0;
+    }
+    SpiralIterator spiral(xSteps, ySteps);
+    spiral.setScale(calibrate_number(pCalibrateJson, "xScale", 1), calibrate_number(pCalibrateJson, "yScale", 1));
+    spiral.setOffset(calibrate_number(pCalibrateJson, "xOffset", 0), calibrate_number(pCalibrateJson, "yOffset", 0));
+    json_decref(pProperties);
+    return pCalibrate->start(*pDce, spiral, moveTemplate);
+}
+
+int cve_open(const FireNode *pNode, const char *path, struct fuse_file_info *fi) {
     int result = 0;
-    CameraNode &camera = worker.cameras[0];
+    CameraNode &camera = *pNode->pCamera;
 
-    if (firefuse_isFile(path, FIREREST_PROPERTIES_JSON)) {
+    switch (pNode->kind) {
+    case FIRENODE_PROPERTIES_JSON:
         if (verifyOpenRW(path, fi, &result)) {
-            fi->fh = (uint64_t) (size_t) new SmartPointer<char>(worker.cve(path).src_properties_json.get());
+            fi->fh = (uint64_t) (size_t) new FireHandle(pNode, fi->flags, pNode->pCve->src_properties_json.get());
         }
-    } else if (firefuse_isFile(path, FIREREST_CAMERA_JPG) || 
-			firefuse_isFile(path, FIREREST_CAMERA_JPG_TILDE)) {
+        break;
+    case FIRENODE_CAMERA_JPG:
+    case FIRENODE_CAMERA_JPG_TILDE:
         if (verifyOpenRW(path, fi, &result)) {
             if ((fi->flags & 3 ) == O_WRONLY) {
-                SmartPointer<char> empty_buffer(NULL, MAX_SAVED_IMAGE);
+                SmartPointer<char> empty_buffer(NULL, MAX_SAVED_IMAGE, SmartPointer<char>::POOL);
                 empty_buffer.setSize(0);
-                fi->fh = (uint64_t) (size_t) new SmartPointer<char>(empty_buffer);
                 LOGDEBUG2("cve_open(%s, O_WRONLY) new:@%lx", path, (size_t) empty_buffer.data());
+                fi->fh = (uint64_t) (size_t) new FireHandle(pNode, fi->flags, std::move(empty_buffer), TRUE);
             } else { // O_RDONLY
-                if (FireREST::isSync(path)) {
+                if (pNode->sync) {
 					LOGDEBUG1("cve_open(%s,O_RDONLY) sync capture() for camera", path);
-					worker.cameras[0].capture();
+					camera.capture();
                     fi->fh = (uint64_t) (size_t) 
-						new SmartPointer<char>(camera.src_camera_jpg.get_sync(CAMERA_MSTIMEOUT));
+						new FireHandle(pNode, fi->flags, camera.src_camera_jpg.get_sync(CAMERA_MSTIMEOUT));
 					LOGDEBUG2("cve_open(%s,O_RDONLY) sync capture() peek:%ldB", 
 						path, (long) camera.src_camera_jpg.peek().size());
                 } else {
-                    fi->fh = (uint64_t) (size_t) new SmartPointer<char>(camera.src_camera_jpg.get());
+                    fi->fh = (uint64_t) (size_t) new FireHandle(pNode, fi->flags, camera.src_camera_jpg.get());
 					LOGDEBUG2("cve_open(%s,O_RDONLY) %ldB", path, (long) camera.src_camera_jpg.peek().size());
                 }
             }
         }
-    } else if (firefuse_isFile(path, FIREREST_SAVED_PNG)) {
+        break;
+    case FIRENODE_SAVED_PNG:
         if (verifyOpenRW(path, fi, &result)) {
             if ((fi->flags & 3 ) == O_WRONLY) {
-                SmartPointer<char> saved_png(worker.cve(path).src_saved_png.peek());
+                SmartPointer<char> saved_png(pNode->pCve->src_saved_png.peek());
                 if (saved_png.allocated_size() < MAX_SAVED_IMAGE) {
-                    SmartPointer<char> empty_buffer(NULL, MAX_SAVED_IMAGE);
+                    SmartPointer<char> empty_buffer(NULL, MAX_SAVED_IMAGE, SmartPointer<char>::POOL);
                     empty_buffer.setSize(0);
-                    worker.cve(path).src_saved_png.post(empty_buffer);
-                    saved_png = empty_buffer;
+                    pNode->pCve->src_saved_png.post(empty_buffer);
+                    saved_png = std::move(empty_buffer);
                     LOGTRACE3("cve_open(%s, O_WRONLY) allocated %ldB @ %lx",
                               path, saved_png.allocated_size(), (size_t) saved_png.data());
                 } else {
                     LOGTRACE3("cve_open(%s, O_WRONLY) reusing %ldB @ %lx",
                               path, saved_png.allocated_size(), (size_t) saved_png.data());
                 }
-                fi->fh = (uint64_t) (size_t) new SmartPointer<char>(saved_png);
+                fi->fh = (uint64_t) (size_t) new FireHandle(pNode, fi->flags, std::move(saved_png), TRUE);
             } else {
-                fi->fh = (uint64_t) (size_t) new SmartPointer<char>(worker.cve(path).src_saved_png.get());
+                fi->fh = (uint64_t) (size_t) new FireHandle(pNode, fi->flags, pNode->pCve->src_saved_png.get());
             }
         }
-    } else if (verifyOpenR_(path, fi, &result)) {
-        if (firefuse_isFile(path, FIREREST_PROCESS_FIRE)) {
-            if (FireREST::isSync(path)) {
+        break;
+    case FIRENODE_PROCESS_FIRE:
+        if (verifyOpenR_(path, fi, &result)) {
+            if (pNode->sync) {
                 int count = firerest.incrementProcessCount();
                 if (count == 1) {
 					LOGDEBUG1("cve_open(%s) capture() for process", path);
-					worker.cameras[0].capture();
+					camera.capture();
                     camera.src_camera_jpg.get_sync(CAMERA_MSTIMEOUT);
                     fi->fh = (uint64_t) (size_t) 
-						new SmartPointer<char>(worker.cve(path).src_process_fire.get_sync(PROCESS_MSTIMEOUT));
+						new FireHandle(pNode, fi->flags, pNode->pCve->src_process_fire.get_sync(PROCESS_MSTIMEOUT));
                 } else {
                     LOGERROR2("cve_open(%s) EAGAIN operation would block (processCount=%d)", path, count);
                     result = -EAGAIN;
                 }
                 firerest.decrementProcessCount();
             } else {
-                fi->fh = (uint64_t) (size_t) new SmartPointer<char>(worker.cve(path).src_process_fire.get());
+                fi->fh = (uint64_t) (size_t) new FireHandle(pNode, fi->flags, pNode->pCve->src_process_fire.get());
             }
-        } else if (firefuse_isFile(path, FIREREST_SAVE_FIRE)) {
-            if (FireREST::isSync(path)) {
+        }
+        break;
+    case FIRENODE_CALIBRATE_FIRE:
+        if (verifyOpenR_(path, fi, &result)) {
+            if (pNode->sync) { // run a job and return all of its results
+                result = pNode->pCve->calibrate(&worker);
+                if (result == 0) {
+                    pNode->pCve->getCalibrateJob().wait();
+                } else {
+                    LOGERROR2("cve_open(%s) EAGAIN calibration is running (%d)", path, result);
+                }
+            }
+            if (result == 0) { // results so far
+                fi->fh = (uint64_t) (size_t) new FireHandle(pNode, fi->flags, pNode->pCve->src_calibrate_fire.get());
+            }
+        }
+        break;
+    case FIRENODE_BATCH_FIRE: // O_RDWR reads the result of the batch it writes
+        if ((fi->flags & 3) == O_RDWR && !(fi->flags & O_DIRECTORY) || verifyOpenRW(path, fi, &result)) {
+            fi->fh = (uint64_t) (size_t) new FireHandle(pNode, fi->flags, camera.src_batch_fire.get());
+        }
+        break;
+    case FIRENODE_SAVE_FIRE:
+        if (verifyOpenR_(path, fi, &result)) {
+            if (pNode->sync) {
 				LOGDEBUG1("cve_open(%s) capture() for save", path);
-				worker.cameras[0].capture();
+				camera.capture();
                 camera.src_camera_jpg.get_sync(CAMERA_MSTIMEOUT);
             }
             fi->fh = (uint64_t) (size_t) 
-				new SmartPointer<char>(worker.cve(path).src_save_fire.get_sync(SAVE_MSTIMEOUT));
-        } else if (firefuse_isFile(path, FIREREST_OUTPUT_JPG)) {
-            fi->fh = (uint64_t) (size_t) new SmartPointer<char>(camera.src_output_jpg.get());
-        } else if (firefuse_isFile(path, FIREREST_MONITOR_JPG)) {
-            fi->fh = (uint64_t) (size_t) new SmartPointer<char>(camera.src_monitor_jpg.get());
-        } else if (firefuse_isFile(path, FIREREST_FIRESIGHT_JSON)) {
-            fi->fh = (uint64_t) (size_t) new SmartPointer<char>(worker.cve(path).src_firesight_json.get());
-        } else {
+				new FireHandle(pNode, fi->flags, pNode->pCve->src_save_fire.get_sync(SAVE_MSTIMEOUT));
+        }
+        break;
+    case FIRENODE_OUTPUT_JPG:
+        if (verifyOpenR_(path, fi, &result)) {
+            fi->fh = (uint64_t) (size_t) new FireHandle(pNode, fi->flags, camera.src_output_jpg.get());
+        }
+        break;
+    case FIRENODE_MONITOR_JPG:
+        if (verifyOpenR_(path, fi, &result)) {
+            fi->fh = (uint64_t) (size_t) new FireHandle(pNode, fi->flags, camera.src_monitor_jpg.get());
+        }
+        break;
+    case FIRENODE_NEXT_OUTPUT_JPG:
+    case FIRENODE_NEXT_MONITOR_JPG:
+        if (verifyOpenR_(path, fi, &result)) {
+            LockFreeLIFOCache<SmartPointer<char> > &cache = *firenode_cache(pNode);
+            long generation = FireREST::nextGeneration(path);
+            if (generation < 0) {
+                generation = cache.getWriteCount(); // wait for the frame after the current one
+            }
+            cache.get(); // let the background worker post the next monitor.jpg
+            if (!cache.wait_post(generation, NEXT_MSTIMEOUT)) {
+                LOGDEBUG2("cve_open(%s) no frame after generation %ld", path, generation);
+            }
+            fi->fh = (uint64_t) (size_t) new FireHandle(pNode, fi->flags, cache.get());
+        }
+        break;
+    case FIRENODE_FIRESIGHT_JSON:
+        if (verifyOpenR_(path, fi, &result)) {
+            fi->fh = (uint64_t) (size_t) new FireHandle(pNode, fi->flags, pNode->pCve->src_firesight_json.get());
+        }
+        break;
+    default:
+        if (verifyOpenR_(path, fi, &result)) {
             result = -ENOENT;
         }
+        break;
     }
 
     switch (-result) {
@@ -352,33 +548,9 @@ int cve_open(const char *path, struct fuse_file_info *fi) {
 
 
 int cve_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
-    size_t sizeOut = size;
-    size_t len;
-    (void) fi;
-
-    if ( firefuse_isFile(path, FIREREST_CAMERA_JPG) ){
-        SmartPointer<char> *pData = (SmartPointer<char> *) fi->fh;
-        sizeOut = firefuse_readBuffer(buf, (char *)pData->data(), size, offset, pData->size());
-    } else if ( firefuse_isFile(path, FIREREST_CAMERA_JPG_TILDE)) {
-        SmartPointer<char> *pData = (SmartPointer<char> *) fi->fh;
-        sizeOut = firefuse_readBuffer(buf, (char *)pData->data(), size, offset, pData->size());
-    } else if ( firefuse_isFile(path, FIREREST_MONITOR_JPG) ||
-                firefuse_isFile(path, FIREREST_OUTPUT_JPG) ||
-                firefuse_isFile(path, FIREREST_SAVED_PNG) ||
-                firefuse_isFile(path, FIREREST_PROCESS_FIRE) ||
-                firefuse_isFile(path, FIREREST_SAVE_FIRE) ||
-                firefuse_isFile(path, FIREREST_FIRESIGHT_JSON) ||
-                firefuse_isFile(path, FIREREST_PROPERTIES_JSON) ||
-                FALSE) {
-        SmartPointer<char> *pData = (SmartPointer<char> *) fi->fh;
-        sizeOut = firefuse_readBuffer(buf, (char *)pData->data(), size, offset, pData->size());
-    } else if (fi->fh) { // data file
-        FuseDataBuffer *pBuffer = (FuseDataBuffer *) (size_t) fi->fh;
-        sizeOut = firefuse_readBuffer(buf, pBuffer->pData, size, offset, pBuffer->length);
-    } else {
-        LOGERROR2("cve_read(%s, %ldB) ENOENT", path, size);
-        return -ENOENT;
-    }
+    FireHandle *pHandle = (FireHandle *) fi->fh;
+    SmartPointer<char> &data = pHandle->data;
+    size_t sizeOut = firefuse_readBuffer(buf, (char *)data.data(), size, offset, data.size());
 
     LOGTRACE4("cve_read(%s,%ldB,%ld) -> %ldB", path, (long) size, (long) offset, sizeOut);
     return sizeOut;
@@ -387,30 +559,25 @@ int cve_read(const char *path, char *buf, size_t size, off_t offset, struct fuse
 int cve_write(const char *path, const char *buf, size_t bufsize, off_t offset, struct fuse_file_info *fi) {
     ASSERTNONZERO(buf);
     ASSERT(bufsize >= 0);
-    if (firefuse_isFile(path, FIREREST_PROPERTIES_JSON)) { //properties.json??
+    FireHandle *pHandle = (FireHandle *) fi->fh;
+    if (pHandle->pNode->kind == FIRENODE_PROPERTIES_JSON) {
         ASSERT(offset == 0);
         SmartPointer<char> data((char *) buf, bufsize);
-        worker.cve(path).src_properties_json.post(data);
-    } else if (firefuse_isFile(path, FIREREST_CAMERA_JPG) 
-		|| firefuse_isFile(path, FIREREST_CAMERA_JPG_TILDE)) {//camera.jpg temporary file
-        SmartPointer<char> * pImage =  (SmartPointer<char> *) fi->fh;
-        if (bufsize + offset > pImage->allocated_size()) {
-            LOGWARN4("cve_write(%s,%ldB,%ld) data truncated to fit %ldB", 
-				path, bufsize, offset, pImage->allocated_size());
-        } else {
-            memcpy(pImage->data()+offset, buf, bufsize);
-            pImage->setSize(offset+bufsize);
-            LOGDEBUG4("cve_write(%s,%ldB,%ld) %ldB total", path, bufsize, offset, pImage->size());
-        }
-    } else if (firefuse_isFile(path, FIREREST_SAVED_PNG))  { //saved.png?  
-        SmartPointer<char> * pImage =  (SmartPointer<char> *) fi->fh;
-        if (bufsize + offset > pImage->allocated_size()) {
+        pHandle->pNode->pCve->src_properties_json.post(data);
+    } else if (pHandle->pNode->kind == FIRENODE_BATCH_FIRE) {
+        ASSERT(offset == 0);
+        SmartPointer<char> data((char *) buf, bufsize);
+        pHandle->pNode->pCamera->batch(&worker, data, pHandle->pNode->sync);
+        pHandle->data = pHandle->pNode->pCamera->src_batch_fire.peek(); // not the result from open
+    } else if (pHandle->buffer) { // camera.jpg, camera.jpg~ or saved.png
+        SmartPointer<char> &image = pHandle->data;
+        if (bufsize + offset > image.allocated_size()) {
             LOGWARN4("cve_write(%s,%ldB,%ld) data truncated to fit %ldB", 
-				path, bufsize, offset, pImage->allocated_size());
+				path, bufsize, offset, image.allocated_size());
         } else {
-            memcpy(pImage->data()+offset, buf, bufsize);
-            pImage->setSize(offset+bufsize);
-            LOGTRACE4("cve_write(%s,%ldB,%ld) %ldB total", path, bufsize, offset, pImage->size());
+            memcpy(image.data()+offset, buf, bufsize);
+            image.setSize(offset+bufsize);
+            LOGDEBUG4("cve_write(%s,%ldB,%ld) %ldB total", path, bufsize, offset, image.size());
         }
     } else {
         LOGERROR3("cve_write(%s,%ldB,%ld) ENOENT", path, bufsize, offset);
@@ -421,54 +588,32 @@ int cve_write(const char *path, const char *buf, size_t bufsize, off_t offset, s
 }
 
 int cve_release(const char *path, struct fuse_file_info *fi) {
-    if (!fi->fh) {
-        LOGDEBUG1("cve_release(%s) NULL", path);
-        return 0;
-    }
-    SmartPointer<char> *pSP = (SmartPointer<char> *) fi->fh;
-    if (firefuse_isFile(path, FIREREST_CAMERA_JPG)) {
-        if ((fi->flags & 3 ) == O_WRONLY) {
-            LOGDEBUG3("cve_release(%s,%lx) write:%ldB->camera_jpg", 
-				path, (size_t)pSP->data(), pSP->size());
-            //worker.cameras[0].accept_new_image(*pSP);
-        } else {
-            LOGDEBUG3("cve_release(%s,%lx) read:%ldB", path, (size_t)pSP->data(), pSP->size());
-        }
-        delete pSP;
-    } else if (firefuse_isFile(path, FIREREST_CAMERA_JPG_TILDE)) {
-        if ((fi->flags & 3 ) == O_WRONLY) {
-            LOGDEBUG3("cve_release(%s,%lx) write:%ldB->camera_jpg temp", 
-				path, (size_t)pSP->data(), pSP->size());
-            worker.cameras[0].accept_new_image(*pSP);
-        } else {
-            LOGDEBUG3("cve_release(%s,%lx) read:%ldB", path, (size_t)pSP->data(), pSP->size());
-        }
-        delete pSP;
-    } else if (
-        firefuse_isFile(path, FIREREST_PROCESS_FIRE) ||
-        firefuse_isFile(path, FIREREST_MONITOR_JPG) ||
-        firefuse_isFile(path, FIREREST_SAVED_PNG) ||
-        firefuse_isFile(path, FIREREST_OUTPUT_JPG) ||
-        firefuse_isFile(path, FIREREST_FIRESIGHT_JSON) ||
-        firefuse_isFile(path, FIREREST_PROPERTIES_JSON) ||
-        firefuse_isFile(path, FIREREST_SAVE_FIRE)) {
-        LOGDEBUG3("cve_release(%s,%lx) %ldB", path, (size_t)pSP->data(), pSP->size());
-        delete pSP;
+    FireHandle *pHandle = (FireHandle *) fi->fh;
+    SmartPointer<char> &data = pHandle->data;
+    if (pHandle->buffer && pHandle->pNode->kind == FIRENODE_CAMERA_JPG_TILDE) {
+        LOGDEBUG3("cve_release(%s,%lx) write:%ldB->camera_jpg temp", path, (size_t)data.data(), data.size());
+        pHandle->pNode->pCamera->accept_new_image(data);
+    } else if (pHandle->buffer) {
+        LOGDEBUG3("cve_release(%s,%lx) write:%ldB", path, (size_t)data.data(), data.size());
     } else {
-        LOGWARN1("cve_release(%s) UNEXPECTED PATH", path);
+        LOGDEBUG3("cve_release(%s,%lx) read:%ldB", path, (size_t)data.data(), data.size());
     }
+    delete pHandle;
+    fi->fh = 0;
     return 0;
 }
 
-int cve_truncate(const char *path, off_t size) {
+int cve_truncate(const FireNode *pNode, const char *path, off_t size) {
 	if (size != 0) {
 		LOGERROR2("cve_truncate(%s,%ldB) ignoring size", path, size);
 	}
-	CameraNode &camera = worker.cameras[0];
-    if (firefuse_isFile(path, FIREREST_SAVED_PNG)) {
+    switch (pNode->kind) {
+    case FIRENODE_SAVED_PNG:
         LOGDEBUG1("cve_truncate(%s)", path);
-        worker.cve(path).src_saved_png.peek().setSize(size);
-    } else if (firefuse_isFile(path, FIREREST_CAMERA_JPG)) {
+        pNode->pCve->src_saved_png.peek().setSize(size);
+        break;
+    case FIRENODE_CAMERA_JPG: {
+        CameraNode &camera = *pNode->pCamera;
 		if (camera.isCapturing()) {
 			LOGWARN1("cve_truncate(%s) ignored (capture in progress)", path);
 		} else {
@@ -477,26 +622,138 @@ int cve_truncate(const char *path, off_t size) {
 			camera.capture();
 			camera.src_camera_jpg.get_sync(CAMERA_MSTIMEOUT);
 		}
-    } else if (firefuse_isFile(path, FIREREST_CAMERA_JPG_TILDE)) {
+        break;
+    }
+    case FIRENODE_CAMERA_JPG_TILDE:
         LOGDEBUG1("cve_truncate(%s) camera temp file", path);
-		camera.src_camera_jpg.peek().setSize(0);
-    } else {
+		pNode->pCamera->src_camera_jpg.peek().setSize(0);
+        break;
+    default:
         LOGDEBUG2("cve_truncate(%s,%ldB) ignored", path, size);
+        break;
 	}
     return 0;
 }
 
-CVE::CVE(string name) {
+CVE::CVE(string name, CameraNode *pCamera) {
     this->name = name;
+    this->pCamera = pCamera;
     const char *firesight = "[{\"op\":\"putText\", \"text\":\"CVE::CVE()\"}]";
     src_firesight_json.post(SmartPointer<char>((char *)firesight, strlen(firesight)));
     const char *emptyJson = "{}";
     src_save_fire.post(SmartPointer<char>((char *)emptyJson, strlen(emptyJson)));
     src_process_fire.post(SmartPointer<char>((char *)emptyJson, strlen(emptyJson)));
     this->_isColor = strcmp("bgr", camera_profile(name.c_str()).c_str()) == 0;
+    this->busy.store(FALSE);
+    ASSERTZERO(pthread_mutex_init(&claimMutex, NULL));
+    ASSERTZERO(pthread_cond_init(&claimCond, NULL));
+    this->queue_seconds = 0;
+    this->exec_seconds = 0;
+    this->pPipeline = NULL;
+    this->pipeline_write_count = -1;
+    this->pArgMapJson = NULL;
+    this->argmap_write_count.store(-1);
+    this->cropped.store(FALSE);
+    this->see_requested = 0;
+    this->see_done = 0;
+    ASSERTZERO(pthread_mutex_init(&seeMutex, NULL));
+    ASSERTZERO(pthread_cond_init(&seeCond, NULL));
+    src_calibrate_fire.post(SmartPointer<char>((char *)emptyJson, strlen(emptyJson)));
+    this->pCalibrate = new CalibrateJob(this);
 }
 
 CVE::~CVE() {
+    delete pCalibrate; // stops job before the pipeline goes away
+    delete pPipeline;
+    clearArgMap();
+    pthread_cond_destroy(&seeCond);
+    pthread_mutex_destroy(&seeMutex);
+    pthread_cond_destroy(&claimCond);
+    pthread_mutex_destroy(&claimMutex);
+}
+
+void CVE::release() {
+    pthread_mutex_lock(&claimMutex);
+    /////////////// CRITICAL SECTION BEGIN ///////////////
+    busy.store(FALSE);
+    pthread_cond_broadcast(&claimCond);
+    /////////////// CRITICAL SECTION END /////////////////
+    pthread_mutex_unlock(&claimMutex);
+}
+
+/**
+ * Claim the CVE, waiting up to msTimeout for its holder to release it.
+ * Return FALSE if the CVE is still claimed.
+ */
+bool CVE::await_claim(int msTimeout) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += msTimeout / 1000;
+    ts.tv_nsec += (msTimeout % 1000) * 1000000L;
+    ts.tv_sec += ts.tv_nsec / 1000000000L;
+    ts.tv_nsec %= 1000000000L;
+    int rc = 0;
+    bool claimed;
+    pthread_mutex_lock(&claimMutex);
+    /////////////// CRITICAL SECTION BEGIN ///////////////
+    while (!(claimed = claim()) && rc == 0) {
+        rc = pthread_cond_timedwait(&claimCond, &claimMutex, &ts);
+    }
+    /////////////// CRITICAL SECTION END /////////////////
+    pthread_mutex_unlock(&claimMutex);
+    return claimed;
+}
+
+/**
+ * Request that the next process() use the first camera frame captured at or after
+ * the given CLOCK_REALTIME (e.g., a serial_ack) instead of the current frame.
+ */
+void CVE::see(const struct timespec &after) {
+    pthread_mutex_lock(&seeMutex);
+    /////////////// CRITICAL SECTION BEGIN ///////////////
+    see_requested++;
+    see_after = after;
+    /////////////// CRITICAL SECTION END /////////////////
+    pthread_mutex_unlock(&seeMutex);
+    LOGDEBUG1("CVE::see(%s)", name.c_str());
+}
+
+bool CVE::isSeePending() {
+    pthread_mutex_lock(&seeMutex);
+    bool pending = see_requested > see_done;
+    pthread_mutex_unlock(&seeMutex);
+    return pending;
+}
+
+/**
+ * Wait for process() to complete the see() requests made so far.
+ * If pResult is given, return the process.fire result of the latest one,
+ * which later process.fire requests do not replace.
+ */
+bool CVE::await_see(int msTimeout, SmartPointer<char> *pResult) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += msTimeout / 1000;
+    ts.tv_nsec += (msTimeout % 1000) * 1000000L;
+    ts.tv_sec += ts.tv_nsec / 1000000000L;
+    ts.tv_nsec %= 1000000000L;
+    int rc = 0;
+    pthread_mutex_lock(&seeMutex);
+    /////////////// CRITICAL SECTION BEGIN ///////////////
+    long requested = see_requested;
+    while (see_done < requested && rc == 0) {
+        rc = pthread_cond_timedwait(&seeCond, &seeMutex, &ts);
+    }
+    bool done = see_done >= requested;
+    if (done && pResult) {
+        *pResult = see_result;
+    }
+    /////////////// CRITICAL SECTION END /////////////////
+    pthread_mutex_unlock(&seeMutex);
+    if (!done) {
+        LOGERROR2("CVE::await_see(%s) TIMEOUT:%dms", name.c_str(), msTimeout);
+    }
+    return done;
 }
 
 
@@ -504,9 +761,12 @@ int CVE::save(BackgroundWorker *pWorker) {
     double sStart = BackgroundWorker::seconds();
     string errMsg;
 
-    Mat image = _isColor ?
-                pWorker->cameras[0].src_camera_mat_bgr.get() :
-                pWorker->cameras[0].src_camera_mat_gray.get();
+    Mat image;
+    try {
+        image = frame_mat(pCamera->newest_frame(), pWorker->hasCveThreads()); // camera Mat is shared by concurrent CVEs
+    } catch (...) {
+        LOGERROR1("CVE::save(%s) could not load properties", name.c_str());
+    }
     size_t bytes = 0;
     if (image.rows && image.cols) {
         vector<uchar> pngBuf;
@@ -515,11 +775,11 @@ int CVE::save(BackgroundWorker *pWorker) {
         param[1] = 3;//default(3)  0-9.
         imencode(".png", image, pngBuf, param);
         bytes = pngBuf.size();
-        SmartPointer<char> png((char *)pngBuf.data(), bytes);
+        SmartPointer<char> png((char *)pngBuf.data(), bytes, SmartPointer<char>::POOL);
         src_saved_png.post(png);
         putText(image, "Saved", Point(7, image.rows-6), FONT_HERSHEY_SIMPLEX, 2, Scalar(0,0,0), 3);
         putText(image, "Saved", Point(5, image.rows-8), FONT_HERSHEY_SIMPLEX, 2, Scalar(255,255,255), 3);
-        pWorker->cameras[0].setOutput(image);
+        pCamera->setOutput(image);
         LOGTRACE4("CVE::save(%s) %s image saved (%ldB) %0.3fs", name.c_str(), _isColor ? "color" : "gray", bytes, BackgroundWorker::seconds() - sStart);
     } else {
         errMsg = "CVE::save(";
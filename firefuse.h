@@ -1,6 +1,9 @@
 #ifndef FIREFUSE_HPP
 #define FIREFUSE_HPP
 #ifdef __cplusplus
+#include <atomic> // before the C bool macro below
+#include <deque>
+#include <unordered_map>
 extern "C" {
 #endif
 
@@ -25,6 +28,9 @@ extern "C" {
 #define MIN_SAVE_SIZE ((size_t) 256)
 #define MIN_PROCESS_SIZE ((size_t) 2048)
 
+#define PROCESS_MSTIMEOUT 15000 /* longest wait for process.fire results */
+#define CAMERA_MSTIMEOUT 1000 /* longest wait for a requested camera frame */
+
 #ifndef bool
 #define bool int
 #define TRUE 1
@@ -38,6 +44,7 @@ extern "C" {
     } FuseDataBuffer;
 
     extern const char * fuse_root;
+    extern long bytes_read; // total bytes returned by FUSE reads
     extern FuseDataBuffer headcam_image;     // perpetually changing image
     extern FuseDataBuffer headcam_image_fstat;  // image at time of most recent fstat()
 
@@ -56,8 +63,19 @@ extern "C" {
     int firefuse_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi);
     int firefuse_write(const char *path, const char *buf, size_t bufsize, off_t offset, struct fuse_file_info *fi);
     int firefuse_release(const char *path, struct fuse_file_info *fi);
+    int firefuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi);
+    int firefuse_truncate(const char *path, off_t size);
+    int firefuse_rename(const char *path1, const char *path2);
+    int firefuse_create(const char *path, mode_t mode, struct fuse_file_info *fi);
+    int firefuse_unlink(const char *path);
+    int firefuse_getxattr(const char *path, const char *name, char *value, size_t size);
+    void * firefuse_init(struct fuse_conn_info *conn);
+    void firefuse_destroy(void * initData);
     int firefuse_main(int argc, char *argv[]);
 
+#define LOWLEVEL_OPTION "--lowlevel" /* firefuse --lowlevel mounts the low-level FUSE front end */
+    int firefuse_lowlevel_main(int argc, char *argv[]);
+
     int firerest_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi);
     int firerest_getattr_default(const char *path, struct stat *stbuf);
     char * firerest_config(const char *path);
@@ -93,26 +111,39 @@ extern "C" {
 #define FIREREST_GCODE_FIRE "/gcode.fire"
 #define FIREREST_SAVED_PNG "/saved.png"
 #define FIREREST_SAVE_FIRE "/save.fire"
+#define FIREREST_CALIBRATE_FIRE "/calibrate.fire"
+#define FIREREST_BATCH_FIRE "/batch.fire"
+#define FIREREST_NEXT "/next" /* open blocks until a newer frame is posted */
+#define FIREREST_NEXT_GENERATION '@' /* e.g., /cv/1/next/monitor.jpg@41 waits for a frame newer than generation 41 */
+#define FIREREST_GCODE_SEE ";process.fire " /* e.g., ";process.fire /cv/1/gray/cve/calc-offset" in gcode.fire */
 
 #define FIREREST_VAR "/var/firefuse"
 
+    typedef struct FireNode FireNode; // FireREST resource resolved by configure_json()
+    extern const FireNode * firerest_node(const char *path);
+    extern const FireNode * firehandle_node(struct fuse_file_info *fi);
+    extern bool firenode_is_cv(const FireNode *pNode);
+    extern bool firenode_is_cnc(const FireNode *pNode);
+#define FIREREST_XATTR_GENERATION "user.generation" /* number of posts to a FireREST resource */
+    int firerest_getxattr(const char *path, const char *name, char *value, size_t size);
+
     bool cve_isPathSuffix(const char *path, const char *suffix);
     int cve_save(FuseDataBuffer *pBuffer, const char *path);
-    int cve_getattr(const char *path, struct stat *stbuf);
+    int cve_getattr(const FireNode *pNode, const char *path, struct stat *stbuf);
     int cve_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi);
-    int cve_open(const char *path, struct fuse_file_info *fi);
+    int cve_open(const FireNode *pNode, const char *path, struct fuse_file_info *fi);
     int cve_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi);
     int cve_write(const char *path, const char *buf, size_t bufsize, off_t offset, struct fuse_file_info *fi);
     int cve_release(const char *path, struct fuse_file_info *fi);
-    int cve_truncate(const char *path, off_t size);
-    int cve_rename(const char *path1, const char * path2);
-    int cnc_getattr(const char *path, struct stat *stbuf);
+    int cve_truncate(const FireNode *pNode, const char *path, off_t size);
+    int cve_rename(const FireNode *pNode1, const char *path1, const FireNode *pNode2, const char * path2);
+    int cnc_getattr(const FireNode *pNode, const char *path, struct stat *stbuf);
     int cnc_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi);
-    int cnc_open(const char *path, struct fuse_file_info *fi);
+    int cnc_open(const FireNode *pNode, const char *path, struct fuse_file_info *fi);
     int cnc_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi);
     int cnc_write(const char *path, const char *buf, size_t bufsize, off_t offset, struct fuse_file_info *fi);
     int cnc_release(const char *path, struct fuse_file_info *fi);
-    int cnc_truncate(const char *path, off_t size);
+    int cnc_truncate(const FireNode *pNode, const char *path, off_t size);
 
     inline bool verifyOpenR_(const char *path, struct fuse_file_info *fi, int *pResult) {
         switch (fi->flags & 3) {
@@ -170,13 +201,10 @@ extern "C" {
 #include <signal.h>
 #include "FireUtils.hpp"
 
-extern int cameraWidth; // config.json provided camera width
-extern int cameraHeight; // config.json provided camera height
-extern string cameraSourceName; // config.json provided camera source name
-extern string cameraSourceConfig; // config.json provided camera souce config
-
 void 	cve_process(const char *path, int *pResult);
 class BackgroundWorker;
+class CameraNode;
+class CalibrateJob;
 
 // firerest.cpp
 string hexFromRFC4648(const char *rfc);
@@ -191,48 +219,157 @@ SmartPointer<char> loadFile(const char *path, int suffixBytes=0); //Return alloc
 typedef class CVE {
     private:
         string name;                                        //
+    private:
+        CameraNode *pCamera;                                // camera that provides CVE images
     private:
         bool _isColor;                                      // TRUE if CVE is a color endpoint, or FALSE if endpoint is grayscale
+    private:
+        std::atomic<int> busy;                              // TRUE while queued or running on a BackgroundWorker CVE thread
+    private:
+        pthread_mutex_t claimMutex;
+    private:
+        pthread_cond_t claimCond;                           // signalled by release()
+    private:
+        double queue_seconds;                               // seconds the last save/process request waited for a CVE thread
+    private:
+        double exec_seconds;                                // seconds the last save/process request took to execute
+    private:
+        firesight::Pipeline *pPipeline;                     // compiled firesight.json
+    private:
+        SmartPointer<char> pipeline_json;                   // firesight.json source of pPipeline
+    private:
+        long pipeline_write_count;                          // src_firesight_json write count of pPipeline
+    private:
+        firesight::ArgMap argMap;                           // prepared properties.json arguments
+    private:
+        json_t *pArgMapJson;                                // parsed properties.json that owns argMap strings
+    private:
+        vector<void*> argMapGC;                             // json_dumps() strings referenced by argMap
+    private:
+        std::atomic<long> argmap_write_count;               // src_properties_json write count of argMap
+    private:
+        string saved_path;                                  // argMap["saved"]
+    private:
+        Rect crop;                                          // properties.json "crop" region processed, or empty for whole frame
+    private:
+        std::atomic<bool> cropped;                          // TRUE if crop is set. Readable without claiming the CVE
+    private:
+        void compile();                                     // rebuild pPipeline and argMap if their sources changed
+    private:
+        void clearArgMap();
+    private:
+        pthread_mutex_t seeMutex;
+    private:
+        pthread_cond_t seeCond;                             // signalled when process() completes see() requests
+    private:
+        long see_requested;                                 // see() requests (guarded by seeMutex)
+    private:
+        long see_done;                                      // see() requests completed by process() (guarded by seeMutex)
+    private:
+        struct timespec see_after;                          // CLOCK_REALTIME of latest see() request (guarded by seeMutex)
+    private:
+        SmartPointer<char> see_result;                      // process.fire of latest completed see() request (guarded by seeMutex)
+    private:
+        CalibrateJob *pCalibrate;                           // calibrate.fire job
 
     public:
-        LIFOCache<SmartPointer<char> > src_saved_png;        // Pointer to https://github.com/firepick1/FireREST/wiki/saved.png
+        LockFreeLIFOCache<SmartPointer<char> > src_saved_png;        // Pointer to https://github.com/firepick1/FireREST/wiki/saved.png
+    public:
+        LockFreeLIFOCache<SmartPointer<char> > src_save_fire;        // Pointer to https://github.com/firepick1/FireREST/wiki/save.fire (grab saved.png when accessed)
     public:
-        LIFOCache<SmartPointer<char> > src_save_fire;        // Pointer to https://github.com/firepick1/FireREST/wiki/save.fire (grab saved.png when accessed)
+        LockFreeLIFOCache<SmartPointer<char> > src_process_fire;     // Pointer to https://github.com/firepick1/FireREST/wiki/process.fire
     public:
-        LIFOCache<SmartPointer<char> > src_process_fire;     // Pointer to https://github.com/firepick1/FireREST/wiki/process.fire
+        LockFreeLIFOCache<SmartPointer<char> > src_firesight_json;   // Pointer to https://github.com/firepick1/FireREST/wiki/firesight.json
     public:
-        LIFOCache<SmartPointer<char> > src_firesight_json;   // Pointer to https://github.com/firepick1/FireREST/wiki/firesight.json
+        LockFreeLIFOCache<SmartPointer<char> > src_properties_json;  // Pointer to https://github.com/firepick1/FireREST/wiki/properties.json
     public:
-        LIFOCache<SmartPointer<char> > src_properties_json;  // Pointer to https://github.com/firepick1/FireREST/wiki/properties.json
+        LockFreeLIFOCache<SmartPointer<char> > src_calibrate_fire;   // Pointer to calibrate.fire (CalibrateJob results)
     public:
         static string cve_path(const char *pPath);          // String containing path to Computer Vision Endpoint
     public:
-        CVE(string name);                                    // Constructor
+        CVE(string name, CameraNode *pCamera);               // Constructor
     public:
         ~CVE();                                              // Destructor
     public:
         inline string getName() {
             return name;
         }
+    public:
+        inline CameraNode& getCamera() {
+            return *pCamera;
+        }
     public:
         int save(BackgroundWorker *pWorker);
     public:
         int process(BackgroundWorker *pWorker);
+    public:
+        Mat frame_mat(long frame, bool clone);              // camera frame or its crop region as processed by the pipeline
+    public:
+        json_t * process_mat(Mat image);                    // run pipeline on image of claimed CVE and return model
+    public:
+        int calibrate(BackgroundWorker *pWorker);           // start CalibrateJob configured by properties.json
+    public:
+        inline CalibrateJob& getCalibrateJob() {
+            return *pCalibrate;
+        }
+    public:
+        void see(const struct timespec &after);             // process() the first frame captured after time
+    public:
+        bool isSeePending();
+    public:
+        bool await_see(int msTimeout, SmartPointer<char> *pResult=NULL); // wait for process() to complete see() requests
     public:
         inline bool isColor() {
             return _isColor;    // TRUE if CVE is a color endpoint, or FALSE if endpoint is grayscale
         }
+    public:
+        inline bool isCropped() { // TRUE if the pipeline only sees the crop region of current properties.json
+            return cropped.load() && argmap_write_count.load() == src_properties_json.getWriteCount();
+        }
+    public:
+        inline bool claim() {   // Return TRUE if caller may queue this CVE for execution
+            int expected = FALSE;
+            return busy.compare_exchange_strong(expected, TRUE);
+        }
+    public:
+        void release();
+    public:
+        bool await_claim(int msTimeout);                    // claim(), waiting up to msTimeout for release()
+    public:
+        inline void setTimes(double queueSeconds, double execSeconds) {
+            queue_seconds = queueSeconds;
+            exec_seconds = execSeconds;
+        }
+    public:
+        inline double getQueueSeconds() {
+            return queue_seconds;
+        }
+    public:
+        inline double getExecSeconds() {
+            return exec_seconds;
+        }
 } CVE, *CVEPtr;
 
 // ****************************************************************************
 // cnc.cpp - Implementation of Device Control Endpoint (https://github.com/firepick1/FireREST/wiki/FireREST-CNC)
+#define DCE_ACK_HISTORY 64 /* serial_ack times retained for frame correlation */
+extern int SERIAL_TIMEOUT_SECS; // longest wait for a serial_ack
+
+typedef struct GcodeSee {
+    long ack;               // serial_ack number that completes the preceding move
+    CVEPtr pCve;            // CVE that processes the first frame captured after that ack, or NULL
+    CameraNode *pCamera;    // camera that captures at that ack
+} GcodeSee;
+
 typedef class DCE {
     private:
         string name;
     private:
         int serial_fd;
     private:
-        bool is_sync;
+        std::atomic<bool> is_sync;
+    private:
+        pthread_mutex_t requestMutex; // serializes gcode.fire requests from concurrent FUSE threads
     private:
         string serial_path;
     private:
@@ -241,12 +378,40 @@ typedef class DCE {
 		string serial_ack;
     private:
         pthread_t tidReader;
+    private:
+        bool reader_active; // TRUE if tidReader must be joined
+    private:
+        int shutdown_fd; // eventfd that stops serial_reader_thread
     public:
         vector<string> serial_device_config;
     private:
         char *jsonBuf;
     private:
-        int activeRequests;
+        int activeRequests; // unacknowledged serial lines (guarded by ackMutex)
+    private:
+        int serial_window; // maximum unacknowledged serial lines in flight (0: unlimited)
+    private:
+        bool streaming; // TRUE while gcode() is sending a request (guarded by ackMutex)
+    private:
+        pthread_mutex_t ackMutex;
+    private:
+        pthread_cond_t ackCond; // signalled on serial_ack and when gcode() finishes a request
+    private:
+        long acks; // serial_ack count since init() (guarded by ackMutex)
+    private:
+        struct timespec ackTimes[DCE_ACK_HISTORY]; // CLOCK_REALTIME of ack n in ackTimes[n % DCE_ACK_HISTORY]
+    private:
+        long sends; // serial lines sent since init() (guarded by ackMutex)
+    private:
+        vector<GcodeSee> sees; // FIREREST_GCODE_SEE requests awaiting their serial_ack (guarded by ackMutex)
+    private:
+        vector<CVEPtr> seen; // CVEs sent see() since the last sync request (guarded by ackMutex)
+    private:
+        void see(CVEPtr pCve, const struct timespec &acked); // caller holds ackMutex
+    private:
+        void gcode_see(BackgroundWorker *pWorker, const string &line, json_t *response);
+    private:
+        void await_window();
     private:
         int jsonLen;
     private:
@@ -264,7 +429,7 @@ typedef class DCE {
     private:
         int serial_send_eol(const char *buf, size_t bufsize);
     private:
-        int serial_send(const char *data, size_t length);
+        int serial_send(const char *data, size_t length, long *pAck=NULL);
     private:
         int serial_read_char(int c);
     private:
@@ -279,9 +444,9 @@ typedef class DCE {
 
         // Common data
     public:
-        LIFOCache<SmartPointer<char> > snk_gcode_fire;
+        LockFreeLIFOCache<SmartPointer<char> > snk_gcode_fire;
     public:
-        LIFOCache<SmartPointer<char> > src_gcode_fire;
+        LockFreeLIFOCache<SmartPointer<char> > src_gcode_fire;
         //public: LIFOCache<SmartPointer<char> > src_properties_json;
 
     public:
@@ -295,10 +460,10 @@ typedef class DCE {
     public:
         void init();
 	public:
-		void send_request(SmartPointer<char> &data);
+		void send_request(SmartPointer<char> &data, bool sync);
     public:
         inline bool isSync() {
-            return is_sync;
+            return is_sync.load();
         }
 	public:
 		void setSync(bool value);
@@ -318,14 +483,34 @@ typedef class DCE {
 		inline const char *get_serial_ack() {
 			return serial_ack.c_str();
 		}
+	public:
+		inline void set_serial_window(int value=0) {
+			serial_window = value;
+		}
+	public:
+		inline int get_serial_window() {
+			return serial_window;
+		}
     public:
         int serial_init();
+    public:
+        void serial_shutdown();                         // stop serial_reader_thread and close serial port
     public:
         inline string getName() {
             return name;
         }
     public:
         int gcode(BackgroundWorker *pWorker);
+    public:
+        long getAcks();                                 // serial_ack count since init()
+    public:
+        long reader_cpu_micros();                       // CPU time used by serial_reader_thread, or -1 if it is not running
+    public:
+        bool ack_time(long ack, struct timespec *pTime, int msTimeout); // wait for time of serial_ack number ack
+    public:
+        long send_gcode(const string &line);            // send line outside gcode.fire and return its serial_ack number or 0
+    public:
+        void capture_on_ack(long ack, CameraNode &camera); // capture as soon as serial_ack number ack arrives
     public:
         inline string getSerialStty() {
             return serial_stty;
@@ -349,9 +534,177 @@ typedef class DCE {
 } DCE, *DCEPtr;
 
 // ****************************************************************************
-// background.cpp - Gets called whenever cve_open() is called.
-// During cve_open (cv.cpp), worker.cameras[] will be populated with a CameraNode object for each camera present.
+// Camera sources that post frames into a CameraNode without raspistill
+typedef class CameraSource {
+    public:
+        virtual ~CameraSource() {}
+    public:
+        virtual int start(int width, int height) = 0;       // start posting frames, or return errno
+    public:
+        virtual void stop() = 0;
+    public:
+        virtual void request() = 0;                         // post the next frame available after this call
+    public:
+        virtual bool isStreaming() = 0;
+} CameraSource;
+
+// ****************************************************************************
+// v4l2.cpp - Video4Linux2 camera source that captures from /dev/videoN with mmap'd streaming buffers
+#define V4L2_BUFFERS 4 /* driver buffers mapped into firefuse */
+
+typedef class V4L2Source : public CameraSource {
+    private:
+        CameraNode *pCamera; // camera that receives captured frames
+    private:
+        string device; // e.g., /dev/video0
+    private:
+        unsigned int pixelformat; // V4L2_PIX_FMT_MJPEG or V4L2_PIX_FMT_YUYV
+    private:
+        int width; // negotiated frame width
+    private:
+        int height; // negotiated frame height
+    private:
+        int bytesperline; // negotiated YUYV row stride
+    private:
+        int fd;
+    private:
+        int nBuffers;
+    private:
+        void *bufferStart[V4L2_BUFFERS];
+    private:
+        size_t bufferLength[V4L2_BUFFERS];
+    private:
+        pthread_t tidStream;
+    private:
+        std::atomic<bool> streaming;
+    private:
+        std::atomic<long long> requestNanos; // CLOCK_MONOTONIC time of pending capture request or 0
+    private:
+        int xioctl(unsigned long request, void *arg);
+    private:
+        void post_frame(int index, size_t bytesused, long long exposed); // exposed: CLOCK_MONOTONIC nanoseconds
+    private:
+        static void * stream_thread(void *arg);
+
+    public:
+        V4L2Source(CameraNode *pCamera, string device, string format);
+    public:
+        ~V4L2Source();
+    public:
+        static unsigned int pixel_format(const char *format); // "MJPG" or "YUYV" or 0 if unsupported
+    public:
+        int start(int width, int height);                   // open device and start streaming
+    public:
+        void stop();
+    public:
+        void request();                                     // post the next frame exposed after this call
+    public:
+        inline bool isStreaming() {
+            return streaming.load();
+        }
+} V4L2Source;
+
+// ****************************************************************************
+// replay.cpp - Camera source that cycles through recorded JPEG frames for benchmarks and tests
+typedef class ReplaySource : public CameraSource {
+    private:
+        CameraNode *pCamera; // camera that receives replayed frames
+    private:
+        string path; // directory of .jpg files or concatenated JPEG frame log
+    private:
+        int msPeriod; // milliseconds between frames or 0 to post on request
+    private:
+        vector<SmartPointer<char> > frames;
+    private:
+        int iFrame; // next frame to post
+    private:
+        pthread_t tidReplay;
+    private:
+        pthread_mutex_t replayMutex;
+    private:
+        pthread_cond_t replayCond;
+    private:
+        bool running; // guarded by replayMutex
+    private:
+        bool requested; // guarded by replayMutex
+    private:
+        std::atomic<long> framesPosted;
+    private:
+        int load_directory();
+    private:
+        int load_frame_log();
+    private:
+        static void * replay_thread(void *arg);
+
+    public:
+        ReplaySource(CameraNode *pCamera, string path, double fps);
+    public:
+        ~ReplaySource();
+    public:
+        static size_t jpeg_length(const char *pData, size_t length); // bytes of first JPEG in pData or 0
+    public:
+        int start(int width, int height);                   // load frames and start replay
+    public:
+        void stop();
+    public:
+        void request();                                     // post the next frame now (or at the next tick)
+    public:
+        inline bool isStreaming() {
+            return !frames.empty() && running;
+        }
+    public:
+        inline int getFrameCount() {
+            return (int) frames.size();
+        }
+    public:
+        inline long getFramesPosted() {
+            return framesPosted.load();
+        }
+} ReplaySource;
+
+// ****************************************************************************
+// background.cpp - Recent camera frames are kept in a ring so that a CVE can
+// ask for the frame captured after a given time instead of the latest one.
+#define FRAME_RING_SIZE 8 /* camera frames retained by each CameraNode */
+
+typedef struct CameraFrame {
+    long sequence;              // src_camera_jpg write count, or 0 if the slot is empty
+    struct timespec captured;   // CLOCK_REALTIME of exposure (or arrival)
+    SmartPointer<char> jpg;
+    Mat bgr;                    // decoded on demand; storage is reused by later frames
+    Mat gray;                   // decoded on demand; storage is reused by later frames
+    bool bgrDecoded;            // TRUE if bgr holds this frame
+    bool grayDecoded;           // TRUE if gray holds this frame
+} CameraFrame;
+
+typedef struct BatchRequest {
+    vector<string> names;       // batch.fire CVE names
+    vector<CVEPtr> cves;        // CVEs that see() frame
+    long frame;                 // frame processed by all CVEs, or 0 if none
+    double started_seconds;     // time batch.fire was written
+    BatchRequest() : frame(0), started_seconds(0) {}
+} BatchRequest;
+
+// ****************************************************************************
+// background.cpp - One CameraNode for each camera_map entry of config.json (e.g., /cv/1)
+// CameraNodes are created by configuration and live as long as the BackgroundWorker.
 typedef class CameraNode {
+    private:
+        string name; // canonical camera path, e.g., /cv/1
+    private:
+        int width; // config.json camera width
+    private:
+        int height; // config.json camera height
+    private:
+        string source_name; // config.json camera source name
+    private:
+        string source_config; // config.json camera source config
+    private:
+        string source_format; // config.json camera source format (v4l2)
+    private:
+        double source_fps; // config.json camera source fps (replay)
+    private:
+        CameraSource *pSource; // v4l2 or replay source, or NULL
     private:
         double camera_idle_capture_seconds;
     private:
@@ -363,34 +716,138 @@ typedef class CameraNode {
     private:
         int min_capture_ms; // minimum number of milliseconds between captures
     private:
-        bool captureActive;
+        std::atomic<bool> captureActive;
     private:
         pid_t raspistillPID;
     private:
-        long msCapture; // earliest time of next capture
+        std::atomic<long> msCapture; // earliest time of next capture
+    private:
+        std::atomic<bool> capture_requested; // request_capture() awaits BackgroundWorker
+    private:
+        pthread_mutex_t captureMutex; // serializes capture() from concurrent FUSE threads
+    private:
+        pthread_mutex_t decodeMutex;
+    private:
+        CameraFrame frameRing[FRAME_RING_SIZE]; // frame n lives in frameRing[n % FRAME_RING_SIZE]
+    private:
+        long ring_frame; // sequence of newest frame in frameRing (guarded by ringMutex)
+    private:
+        pthread_mutex_t ringMutex;
+    private:
+        pthread_cond_t ringCond; // signalled when a frame is added to frameRing
+    private:
+        long post_frame(SmartPointer<char> jpg, const struct timespec *pCaptured, Mat bgr);
+    private:
+        Mat decode_frame(long frame, bool color); // caller holds decodeMutex
+    private:
+        std::atomic<long> decoded_frame; // src_camera_jpg write count of last decoded frame
+    private:
+        std::atomic<long> frames_decoded; // number of camera frames decoded on demand
+    private:
+        std::atomic<long> frames_skipped; // number of camera frames replaced without being decoded
+    private:
+        pthread_mutex_t batchMutex;
+    private:
+        BatchRequest pendingBatch; // async batch awaiting its CVEs (guarded by batchMutex)
+    private:
+        int post_batch(BatchRequest &batch, int msTimeout);
+    private:
+        std::atomic<long> rois_decoded; // number of frame regions decoded without decoding the whole frame
 
         // Common data
     public:
-        LIFOCache<SmartPointer<char> > src_camera_jpg;
+        LockFreeLIFOCache<SmartPointer<char> > src_camera_jpg;
     public:
-        LIFOCache<Mat> src_camera_mat_gray;
+        LockFreeLIFOCache<SmartPointer<char> > src_monitor_jpg;
     public:
-        LIFOCache<Mat> src_camera_mat_bgr;
+        LockFreeLIFOCache<SmartPointer<char> > src_output_jpg;
     public:
-        LIFOCache<SmartPointer<char> > src_monitor_jpg;
-    public:
-        LIFOCache<SmartPointer<char> > src_output_jpg;
+        LockFreeLIFOCache<SmartPointer<char> > src_batch_fire; // combined CVE results of last batch()
 
         // General use
+    public:
+        static string camera_path(const char *pPath);   // String containing path to camera (e.g., /cv/1)
+    public:
+        inline string getName() {
+            return name;
+        }
+    public:
+        inline int getWidth() {
+            return width;
+        }
+    public:
+        inline int getHeight() {
+            return height;
+        }
+    public:
+        inline string getSourceName() {
+            return source_name;
+        }
+    public:
+        inline string getSourceConfig() {
+            return source_config;
+        }
+    public:
+        inline string getSourceFormat() {
+            return source_format;
+        }
+    public:
+        inline double getSourceFps() {
+            return source_fps;
+        }
+    public:
+        inline CameraSource *getSource() {
+            return pSource;
+        }
+    public:
+        inline bool isStreaming() {
+            return pSource && pSource->isStreaming();
+        }
+    public:
+        void configure(int width, int height, string sourceName, string sourceConfig, string sourceFormat="", double sourceFps=0);
     public:
         bool capture();
+    public:
+        Mat get_mat_bgr();                              // Decode current camera frame once, on demand
+    public:
+        Mat get_mat_gray();                             // Decode current camera frame once, on demand
+    public:
+        long frame_after(const struct timespec &after, int msTimeout); // first frame captured at or after time, or 0
+    public:
+        long frame_after_ack(DCE &dce, long ack, int msTimeout); // first frame captured after serial_ack number ack, or 0
+    public:
+        bool get_frame(long frame, CameraFrame *pFrame); // copy frame from ring unless it was overwritten
+    public:
+        Mat get_frame_mat(long frame, bool color);     // Decode frame once, on demand. Empty if overwritten
+    public:
+        Mat get_frame_roi(long frame, bool color, Rect roi); // Decode only roi of frame into its own Mat. Empty if overwritten
+    public:
+        long newest_frame();                            // sequence of newest frame in ring, or 0
+    public:
+        int batch(BackgroundWorker *pWorker, SmartPointer<char> request, bool sync); // process one frame with many CVEs
+    public:
+        inline long get_frames_decoded() {
+            return frames_decoded.load();
+        }
+    public:
+        inline long get_frames_skipped() {
+            return frames_skipped.load();
+        }
+    public:
+        inline long get_rois_decoded() {
+            return rois_decoded.load();
+        }
 
 	public:
 		bool isCapturing();
+    public:
+        void request_capture(); // queue capture() for BackgroundWorker; never blocks the caller
+    public:
+        long get_capture_wait_ms(); // ms until a requested capture may start, or -1 if none is requested
 
         // For BackgroundWorker use
     public:
-        CameraNode();
+        CameraNode(string name);
     public:
         ~CameraNode();
     public:
@@ -402,9 +859,13 @@ typedef class CameraNode {
     public:
         int async_update_camera_jpg();
     public:
-        int accept_new_image(SmartPointer<char> jpg);
+        int accept_new_image(SmartPointer<char> jpg, const struct timespec *pCaptured=NULL);
+    public:
+        int accept_new_mat(Mat bgr, const struct timespec *pCaptured=NULL); // post a raw frame without decoding it again
     public:
         int async_update_monitor_jpg();
+    public:
+        int async_batch_fire();
     public:
         void setOutput(Mat image);
     public:
@@ -413,15 +874,29 @@ typedef class CameraNode {
         }
     public:
         void set_min_capture_ms(int value = 500);
-} CameraNode;
+    public:
+        inline double get_next_capture_seconds() {
+            return camera_seconds + camera_idle_capture_seconds; // earliest idle capture
+        }
+} CameraNode, *CameraNodePtr;
 
-#define MAX_CAMERAS 1 /* TODO: Make code actually work for multiple cameras */
+#define MAX_WORKER_WAIT_MS 1000 /* longest BackgroundWorker sleep between unprompted passes */
 
 // ****************************************************************************
 // background.cpp - singleton class
+typedef struct CVEJob {
+    CVEPtr pCve;
+    int mask;               // 010:process.fire 020:save.fire
+    double queued_seconds;  // time job was queued
+} CVEJob;
+
 typedef class BackgroundWorker {
     private:
         double idle_period; // minimum seconds between idle() execution. Gets set by config.json.
+    private:
+        std::map<string, CameraNodePtr> cameraMap; // cameras are never deleted
+    private:
+        std::atomic<bool> started;  // TRUE after startThreads(). Configuration must finish first: the maps are then read without locks
     private:
         std::map<string, CVEPtr> cveMap;
     private:
@@ -436,9 +911,29 @@ typedef class BackgroundWorker {
         int async_process_fire();
     private:
         int async_gcode_fire();
+    private:
+        int next_wait_ms();
+    private:
+        int cve_threads; // number of threads executing CVE save/process requests. Gets set by config.json.
+    private:
+        int pool_threads; // number of running CVE threads
+    private:
+        bool gcode_threaded; // TRUE if DCE gcode is dispatched by its own thread
+    private:
+        std::deque<CVEJob> cveQueue;
+    private:
+        pthread_mutex_t cveQueueMutex;
+    private:
+        pthread_cond_t cveQueueCond;
+    private:
+        int dispatch_cve(CVEPtr pCve, int mask);
+    private:
+        static void * cve_thread(void *arg);
+    private:
+        static void * gcode_thread(void *arg);
 
     public:
-        CameraNode cameras[MAX_CAMERAS];
+        CacheEvent event; // notified by every cache the worker services
     public:
         static double seconds();
 
@@ -448,10 +943,14 @@ typedef class BackgroundWorker {
         ~BackgroundWorker();
     public:
         static int callSystem(char *cmdbuf); //Execute a system shell command
+    public:
+        CameraNode& camera(string path, bool create=FALSE);
     public:
         CVE& cve(string path, bool create=FALSE);
     public:
         DCE& dce(string path, bool create=FALSE);
+    public:
+        vector<string> getCameraNames();
     public:
         vector<string> getCveNames();
     public:
@@ -468,9 +967,24 @@ typedef class BackgroundWorker {
         inline double getIdlePeriod() {
             return idle_period;
         }
+    public:
+        inline void setCveThreads(int value) {
+            cve_threads = value;
+        }
+    public:
+        inline int getCveThreads() {
+            return cve_threads;
+        }
+    public:
+        inline bool hasCveThreads() {
+            return pool_threads > 0;
+        }
+    public:
+        void run_cve_job(CVEJob &job);
     public:
         inline DCEPtr getSerialDCE(string serialPath) {
-            return serialMap[serialPath];
+            std::map<string, DCEPtr>::iterator it = serialMap.find(serialPath);
+            return it == serialMap.end() ? NULL : it->second;
         }
     public:
         inline void setSerialDCE(string serialPath, DCEPtr pDce) {
@@ -480,6 +994,8 @@ typedef class BackgroundWorker {
         // TESTING ONLY
     public:
         void processInit();
+    public:
+        void startThreads(); // threads run until exit
     public:
         int processLoop();
     public:
@@ -488,6 +1004,47 @@ typedef class BackgroundWorker {
 
 extern BackgroundWorker worker; // BackgroundWorker singleton background worker
 
+// ****************************************************************************
+// firerest.cpp - FireREST resources resolved once by FireREST::configure_json()
+typedef enum FireNodeKind {
+    FIRENODE_DIRECTORY,
+    FIRENODE_CAMERA_JPG,
+    FIRENODE_CAMERA_JPG_TILDE,
+    FIRENODE_OUTPUT_JPG,
+    FIRENODE_MONITOR_JPG,
+    FIRENODE_NEXT_OUTPUT_JPG,
+    FIRENODE_NEXT_MONITOR_JPG,
+    FIRENODE_SAVE_FIRE,
+    FIRENODE_PROCESS_FIRE,
+    FIRENODE_SAVED_PNG,
+    FIRENODE_FIRESIGHT_JSON,
+    FIRENODE_PROPERTIES_JSON,
+    FIRENODE_GCODE_FIRE,
+    FIRENODE_CALIBRATE_FIRE,
+    FIRENODE_BATCH_FIRE,
+} FireNodeKind;
+
+struct FireNode {
+    FireNodeKind kind;
+    bool cnc; // /cnc resource (otherwise /cv)
+    bool sync; // /sync resource
+    int perm;
+    CameraNode *pCamera; // /cv resources
+    CVE *pCve; // /cv/.../cve/<name>/ resources
+    DCE *pDce; // /cnc/<name>/ resources
+};
+
+// cve_open() and cnc_open() store a FireHandle in fuse_file_info.fh
+typedef struct FireHandle {
+    const FireNode *pNode; // endpoint resolved at open
+    SmartPointer<char> data; // snapshot to read or buffer to write
+    bool buffer; // data is a writable buffer
+    int flags; // open flags
+
+    FireHandle(const FireNode *pNode, int flags, SmartPointer<char> data, bool buffer=FALSE)
+        : pNode(pNode), data(std::move(data)), buffer(buffer), flags(flags) {}
+} FireHandle;
+
 // ****************************************************************************
 // firerest.cpp
 typedef class JSONFileSystem {
@@ -523,6 +1080,10 @@ typedef class JSONFileSystem {
         bool isDirectory(const char *path);
     public:
         int perms(const char *path);
+    public:
+        vector<string> dirPaths();
+    public:
+        vector<string> filePaths();
 } JSONFileSystem;
 
 // ****************************************************************************
@@ -535,7 +1096,15 @@ typedef class FireREST {
     private:
         JSONFileSystem files;
     private:
-        string config_camera(const char* cv_path, json_t *pCamera, const char *pCameraName, json_t *pCveMap);
+        std::unordered_map<string, FireNode> nodeMap;
+    private:
+        time_t configured; // time of last configure_json()
+    private:
+        void create_node(string path, FireNodeKind kind, int perm);
+    private:
+        void create_nodes();
+    private:
+        string config_camera(const char* cv_path, json_t *pCamera, const char *pCameraName, json_t *pCveMap, double maxFPS);
     private:
         string config_cv(const char* root_path, json_t *pConfig);
     private:
@@ -572,8 +1141,16 @@ typedef class FireREST {
         bool isFile(const char *path) {
             return files.isFile(path);
         }
+    public:
+        const FireNode * node(const char *path);
+    public:
+        inline time_t configureTime() {
+            return configured;
+        }
     public:
         static bool isSync(const char *path);
+    public:
+        static long nextGeneration(const char *path); // 41 for next/monitor.jpg@41 or -1
     public:
         vector<string> fileNames(const char *path) {
             return files.fileNames(path);
@@ -582,6 +1159,110 @@ typedef class FireREST {
 
 extern FireREST firerest;
 
+LockFreeLIFOCache<SmartPointer<char> > * firenode_cache(const FireNode *pNode); // NULL for directories
+int firenode_getattr(const FireNode *pNode, const char *path, struct stat *stbuf, size_t minSize=0); // mtime of last post
+
+// ****************************************************************************
+// lowlevel.cpp - stable inode numbers for the low-level FUSE front end
+typedef struct FireInode {
+    string path;
+    unsigned long nlookup; // kernel references from lookup and create, released by forget
+} FireInode;
+
+typedef class FireInodes {
+    private:
+        pthread_mutex_t inodeMutex;
+    private:
+        std::unordered_map<string, unsigned long> inoMap; // path => inode
+    private:
+        std::unordered_map<unsigned long, FireInode> inodes; // inode => path
+    private:
+        unsigned long nextIno; // inode numbers are never reused
+    private:
+        unsigned long assign(const char *path); // caller holds inodeMutex
+
+    public:
+        FireInodes();
+    public:
+        ~FireInodes();
+
+    public:
+        unsigned long ino(const char *path); // inode for path, assigned on first use
+    public:
+        unsigned long lookup(const char *path); // inode for path with one more kernel reference
+    public:
+        void forget(unsigned long ino, unsigned long nlookup); // drop kernel references and unused inodes
+    public:
+        size_t size(); // number of assigned inodes
+    public:
+        bool path(unsigned long ino, string &path); // FALSE if inode is not assigned
+    public:
+        string child(unsigned long parent, const char *name); // path of name in parent directory (or "")
+} FireInodes;
+
+extern FireInodes fireinodes;
+
+// ****************************************************************************
+// mjpeg.cpp - HTTP multipart/x-mixed-replace stream of monitor.jpg and output.jpg
+typedef class MJPEGServer {
+    private:
+        int port;
+    private:
+        string host; // IPv4 address of listener
+    private:
+        int listen_fd;
+    private:
+        int shutdown_fd; // eventfd that stops listen_thread
+    private:
+        std::atomic<bool> running;
+    private:
+        std::atomic<int> clients; // connected client threads
+    private:
+        std::atomic<long> frames; // frames sent to all clients
+    private:
+        std::atomic<long> skipped; // frames skipped by stalled clients
+    private:
+        pthread_t tidListen;
+    private:
+        static void * listen_thread(void *arg);
+    private:
+        static void * client_thread(void *arg);
+    private:
+        void serve(int fd);
+
+    public:
+        MJPEGServer();
+    public:
+        ~MJPEGServer();
+
+    public:
+        int start(int port, const char *host=NULL); // 0 or errno; host defaults to loopback; restarts if port or host differs
+    public:
+        void stop(); // close listener and wait for clients to disconnect
+    public:
+        inline bool isRunning() {
+            return running.load();
+        }
+    public:
+        inline int getClients() {
+            return clients.load();
+        }
+    public:
+        inline long getFrames() {
+            return frames.load();
+        }
+    public:
+        inline long getSkipped() {
+            return skipped.load();
+        }
+    public:
+        inline string getHost() {
+            return host;
+        }
+} MJPEGServer;
+
+extern MJPEGServer mjpeg;
+
 // ****************************************************************************
 // Calibrate.cpp
 typedef class SpiralIterator { // simpler than a C++ <iterator>
@@ -638,6 +1319,60 @@ typedef class SpiralIterator { // simpler than a C++ <iterator>
         bool next();
 } SpiralIterator;
 
+// A CalibrateJob moves the DCE along a SpiralIterator and processes one camera
+// frame at each position. The move to position N+1 is sent as soon as frame N
+// has been captured, so motion overlaps with decoding and the FireSight pipeline.
+// The camera captures on the serial_ack of each move.
+typedef class CalibrateJob {
+    private:
+        CVE *pCve;
+    private:
+        DCE *pDce;
+    private:
+        SpiralIterator spiral;
+    private:
+        string move_template;   // gcode move with {x} and {y} placeholders (e.g., G0X{x}Y{y})
+    private:
+        pthread_t tidJob;
+    private:
+        bool joinable;          // TRUE if tidJob must be joined
+    private:
+        bool running;           // guarded by jobMutex
+    private:
+        std::atomic<bool> cancelled;
+    private:
+        pthread_mutex_t jobMutex;
+    private:
+        pthread_cond_t jobCond; // signalled when the job completes
+    private:
+        string results;         // JSON of positions processed so far
+    private:
+        int positions;
+    private:
+        double start_seconds;
+    private:
+        long send_move(float x, float y, struct timespec *pSent);
+    private:
+        void post(const char *status);
+    private:
+        void run();
+    private:
+        static void * calibrate_thread(void *arg);
+
+    public:
+        CalibrateJob(CVE *pCve);
+    public:
+        ~CalibrateJob();
+    public:
+        int start(DCE &dce, SpiralIterator spiral, string moveTemplate="G0X{x}Y{y}"); // or -EAGAIN if running
+    public:
+        void wait();            // wait for job to complete
+    public:
+        void cancel();
+    public:
+        bool isRunning();
+} CalibrateJob;
+
 extern long millis();
 
 #endif // __cplusplus
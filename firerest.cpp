@@ -22,11 +22,6 @@ using namespace std;
 
 const char * fuse_root  = "/dev/firefuse";
 
-int cameraWidth = 800;
-int cameraHeight = 200;
-string cameraSourceName;
-string cameraSourceConfig;
-
 FireREST firerest;
 
 //////////////////////// millis ////////////////////////
@@ -76,28 +71,36 @@ void JSONFileSystem::clear() {
 }
 
 
+/**
+ * Lookup without operator[] so that concurrent FUSE threads never insert
+ */
+static json_t * find_path(std::map<string, json_t *> &pathMap, const char *path) {
+    std::map<string, json_t *>::iterator it = pathMap.find(path);
+    return it == pathMap.end() ? NULL : it->second;
+}
+
 json_t * JSONFileSystem::get(const char *path) {
-    json_t * result = dirMap[path];
+    json_t * result = find_path(dirMap, path);
     if (result == NULL) {
-        result = fileMap[path];
+        result = find_path(fileMap, path);
     }
     return result;
 }
 
 bool JSONFileSystem::isFile(const char *path) {
-    return fileMap[path] ? true : false;
+    return find_path(fileMap, path) ? true : false;
 }
 
 bool JSONFileSystem::isDirectory(const char *path) {
-    return dirMap[path] ? true : false;
+    return find_path(dirMap, path) ? true : false;
 }
 
 int JSONFileSystem::perms(const char *path) {
-    json_t * obj = dirMap[path];
+    json_t * obj = find_path(dirMap, path);
     if (obj != NULL) {
         return 0755; // rwxr_xr_x
     }
-    obj = fileMap[path];
+    obj = find_path(fileMap, path);
     json_t * perms = json_object_get(obj, "perms");
     if (perms == NULL) {
         return 0;
@@ -108,7 +111,7 @@ int JSONFileSystem::perms(const char *path) {
 
 vector<string> JSONFileSystem::fileNames(const char *path) {
     vector<string> result;
-    json_t *dir = dirMap[path];
+    json_t *dir = find_path(dirMap, path);
     if (dir) {
         const char *pName;
         json_t * pFile;
@@ -120,6 +123,26 @@ vector<string> JSONFileSystem::fileNames(const char *path) {
     return result;
 }
 
+vector<string> JSONFileSystem::dirPaths() {
+    vector<string> result;
+    for (std::map<string,json_t*>::iterator it=dirMap.begin(); it!=dirMap.end(); ++it) {
+        if (it->second) {
+            result.push_back(it->first);
+        }
+    }
+    return result;
+}
+
+vector<string> JSONFileSystem::filePaths() {
+    vector<string> result;
+    for (std::map<string,json_t*>::iterator it=fileMap.begin(); it!=fileMap.end(); ++it) {
+        if (it->second) {
+            result.push_back(it->first);
+        }
+    }
+    return result;
+}
+
 vector<string> JSONFileSystem::splitPath(const char *path) {
     assert(path);
     vector<string> result;
@@ -194,6 +217,7 @@ FireREST::FireREST() {
     int rc_mutex = pthread_mutex_init(&processMutex, NULL);
     assert(rc_mutex == 0);
     processCount = 0;
+    configured = time(NULL);
 }
 
 FireREST::~FireREST() {
@@ -231,52 +255,203 @@ void FireREST::create_resource(string path, int perm) {
     files.create_file(path, perm);
 }
 
-string FireREST::config_camera(const char*cv_path, json_t *pCamera, const char *pCameraName, json_t *pCveMap) {
+static const struct {
+    const char *suffix;
+    FireNodeKind kind;
+    int perm;
+} FIRENODE_FILES[] = {
+    {FIREREST_NEXT FIREREST_OUTPUT_JPG, FIRENODE_NEXT_OUTPUT_JPG, 0444},
+    {FIREREST_NEXT FIREREST_MONITOR_JPG, FIRENODE_NEXT_MONITOR_JPG, 0444},
+    {FIREREST_CAMERA_JPG, FIRENODE_CAMERA_JPG, 0666},
+    {FIREREST_OUTPUT_JPG, FIRENODE_OUTPUT_JPG, 0444},
+    {FIREREST_MONITOR_JPG, FIRENODE_MONITOR_JPG, 0444},
+    {FIREREST_SAVE_FIRE, FIRENODE_SAVE_FIRE, 0444},
+    {FIREREST_PROCESS_FIRE, FIRENODE_PROCESS_FIRE, 0444},
+    {FIREREST_CALIBRATE_FIRE, FIRENODE_CALIBRATE_FIRE, 0444},
+    {FIREREST_BATCH_FIRE, FIRENODE_BATCH_FIRE, 0666},
+    {FIREREST_SAVED_PNG, FIRENODE_SAVED_PNG, 0666},
+    {FIREREST_FIRESIGHT_JSON, FIRENODE_FIRESIGHT_JSON, 0444},
+    {FIREREST_PROPERTIES_JSON, FIRENODE_PROPERTIES_JSON, 0666},
+    {FIREREST_GCODE_FIRE, FIRENODE_GCODE_FIRE, 0666},
+};
+
+/**
+ * Return TRUE if path is root (e.g., "/cv") or lies under root, with or without "/sync"
+ */
+static bool is_root_path(const char *path, const char *root) {
+    if (strncmp(path, FIREREST_SYNC "/", strlen(FIREREST_SYNC "/")) == 0) {
+        path += strlen(FIREREST_SYNC);
+    }
+    size_t len = strlen(root);
+    return strncmp(path, root, len) == 0 && (path[len] == '/' || path[len] == 0);
+}
+
+void FireREST::create_node(string path, FireNodeKind kind, int perm) {
+    const char *pPath = path.c_str();
+    FireNode node;
+    node.kind = kind;
+    node.cnc = is_root_path(pPath, FIREREST_CNC);
+    node.sync = isSync(pPath);
+    node.perm = perm;
+    string cameraPath = node.cnc ? string() : CameraNode::camera_path(pPath);
+    node.pCamera = cameraPath.empty() ? NULL : &worker.camera(cameraPath);
+    node.pCve = NULL;
+    node.pDce = NULL;
+    if (kind != FIRENODE_DIRECTORY) {
+        if (node.cnc) {
+            node.pDce = &worker.dce(path);
+        } else if (!CVE::cve_path(pPath).empty()) {
+            node.pCve = &worker.cve(path);
+        }
+    }
+    LOGDEBUG3("FireREST::create_node(%s) kind:%d perm:%o", pPath, kind, perm);
+    nodeMap[path] = node;
+}
+
+/**
+ * Resolve every /cv and /cnc resource once so that FUSE operations need
+ * a single lookup instead of suffix matching on each call
+ */
+void FireREST::create_nodes() {
+    nodeMap.clear();
+    vector<string> dirs = files.dirPaths();
+    for (int i = 0; i < dirs.size(); i++) {
+        const char *pDir = dirs[i].c_str();
+        if (is_root_path(pDir, FIREREST_CV) || is_root_path(pDir, FIREREST_CNC)) {
+            create_node(dirs[i], FIRENODE_DIRECTORY, files.perms(pDir));
+        }
+    }
+    vector<string> paths = files.filePaths();
+    int nKinds = sizeof(FIRENODE_FILES)/sizeof(FIRENODE_FILES[0]);
+    for (int i = 0; i < paths.size(); i++) {
+        const char *pPath = paths[i].c_str();
+        for (int k = 0; k < nKinds; k++) {
+            if (firefuse_isFile(pPath, FIRENODE_FILES[k].suffix)) {
+                create_node(paths[i], FIRENODE_FILES[k].kind, FIRENODE_FILES[k].perm);
+                if (FIRENODE_FILES[k].kind == FIRENODE_CAMERA_JPG) { // raspistill temporary file
+                    create_node(paths[i] + "~", FIRENODE_CAMERA_JPG_TILDE, FIRENODE_FILES[k].perm);
+                }
+                break;
+            }
+        }
+    }
+    LOGINFO1("FireREST::create_nodes() %ld nodes", (long) nodeMap.size());
+}
+
+const FireNode * FireREST::node(const char *path) {
+    std::unordered_map<string, FireNode>::const_iterator it = nodeMap.find(path);
+    if (it != nodeMap.end()) {
+        return &it->second;
+    }
+    const char *pGeneration = strrchr(path, FIREREST_NEXT_GENERATION);
+    if (pGeneration && nextGeneration(path) >= 0) { // next/monitor.jpg@41
+        it = nodeMap.find(string(path, pGeneration - path));
+        if (it != nodeMap.end() && 
+            (it->second.kind == FIRENODE_NEXT_MONITOR_JPG || it->second.kind == FIRENODE_NEXT_OUTPUT_JPG)) {
+            return &it->second;
+        }
+    }
+    return NULL;
+}
+
+long FireREST::nextGeneration(const char *path) {
+    const char *pGeneration = strrchr(path, FIREREST_NEXT_GENERATION);
+    if (!pGeneration || !isdigit(pGeneration[1])) {
+        return -1;
+    }
+    char *pEnd;
+    long generation = strtol(pGeneration+1, &pEnd, 10);
+    return *pEnd ? -1 : generation;
+}
+
+string FireREST::config_camera(const char*cv_path, json_t *pCamera, const char *pCameraName, json_t *pCveMap, double maxFPS) {
     string errMsg;
 
     string cameraPath(cv_path);
     cameraPath += "/";
     cameraPath += pCameraName;
+    CameraNode &camera = worker.camera(cameraPath, TRUE);
 
+    int width = 800;
     json_t *pWidth = json_object_get(pCamera, "width");
     if (json_is_integer(pWidth)) {
-        cameraWidth = json_integer_value(pWidth);
+        width = json_integer_value(pWidth);
     }
 
+    int height = 200;
     json_t *pHeight = json_object_get(pCamera, "height");
     if (json_is_integer(pHeight)) {
-        cameraHeight = json_integer_value(pHeight);
+        height = json_integer_value(pHeight);
     }
-    LOGINFO3("FireREST::config_camera(%s) %dx%d", cameraPath.c_str(), cameraWidth, cameraHeight);
+    LOGINFO3("FireREST::config_camera(%s) %dx%d", cameraPath.c_str(), width, height);
 
-    cameraSourceName = "raspistill";
-    cameraSourceConfig = "";
+    string sourceName = "raspistill";
+    string sourceConfig = "";
+    string sourceFormat = "";
+    double sourceFps = 0;
     json_t *pSource = json_object_get(pCamera, "source");
     if (json_is_object(pSource)) {
         json_t *pSourceName = json_object_get(pSource, "name");
         json_t *pSourceConfig = json_object_get(pSource, "config");
         if (json_is_string(pSourceName)) {
-            cameraSourceName = json_string_value(pSourceName);
+            sourceName = json_string_value(pSourceName);
         }
-        if (cameraSourceName.compare("raspistill") == 0) {
+        if (sourceName.compare("raspistill") == 0) {
             if (json_is_string(pSourceConfig)) {
-                cameraSourceConfig = json_string_value(pSourceConfig);
-                if (cameraSourceConfig.size() == 0) {
-                    cameraSourceConfig = "-t 0 -q 65 -bm -s -o /dev/firefuse/cv/1/camera.jpg";
+                sourceConfig = json_string_value(pSourceConfig);
+                if (sourceConfig.size() == 0) {
+                    sourceConfig = "-t 0 -q 65 -bm -s -o ";
+                    sourceConfig += fuse_root;
+                    sourceConfig += camera.getName();
+                    sourceConfig += "/camera.jpg";
                 }
             }
             char buf[256];
             snprintf(buf, sizeof(buf), "%s -w %d -h %d",
-                     cameraSourceConfig.c_str(), cameraWidth, cameraHeight);
-            cameraSourceConfig = buf;
+                     sourceConfig.c_str(), width, height);
+            sourceConfig = buf;
+        } else if (sourceName.compare("v4l2") == 0) {
+            sourceConfig = json_is_string(pSourceConfig) ? json_string_value(pSourceConfig) : "";
+            if (sourceConfig.size() == 0) {
+                sourceConfig = "/dev/video0";
+            }
+            json_t *pSourceFormat = json_object_get(pSource, "format");
+            sourceFormat = json_is_string(pSourceFormat) ? json_string_value(pSourceFormat) : "MJPG";
+            if (V4L2Source::pixel_format(sourceFormat.c_str()) == 0) {
+                errMsg = "FireREST::config_camera() unsupported v4l2 format: ";
+                errMsg += sourceFormat;
+                errMsg += "\n";
+                return errMsg;
+            }
+        } else if (sourceName.compare("replay") == 0) {
+            if (!json_is_string(pSourceConfig)) {
+                return string("FireREST::config_camera() missing replay source configuration: config\n");
+            }
+            sourceConfig = json_string_value(pSourceConfig);
+            json_t *pSourceFps = json_object_get(pSource, "fps");
+            if (json_is_number(pSourceFps)) {
+                sourceFps = json_number_value(pSourceFps);
+            }
         }
     }
-    LOGINFO3("FireREST::config_camera(%s) source:%s %s",
-             cameraPath.c_str(), cameraSourceName.c_str(), cameraSourceConfig.c_str());
+    LOGINFO4("FireREST::config_camera(%s) source:%s %s %s",
+             cameraPath.c_str(), sourceName.c_str(), sourceConfig.c_str(), sourceFormat.c_str());
+    camera.configure(width, height, sourceName, sourceConfig, sourceFormat, sourceFps);
+
+    json_t *pMaxFPS = json_object_get(pCamera, "maxfps");
+    if (json_is_number(pMaxFPS)) {
+        maxFPS = json_number_value(pMaxFPS); // camera overrides cv maxfps
+    }
+    if (maxFPS > 0) {
+        camera.set_min_capture_ms(1000/maxFPS);
+    }
 
     create_resource(cameraPath + "/camera.jpg", 0666);
     create_resource(cameraPath + "/output.jpg", 0444);
     create_resource(cameraPath + "/monitor.jpg", 0444);
+    create_resource(cameraPath + "/batch.fire", 0666);
+    create_resource(cameraPath + FIREREST_NEXT "/output.jpg", 0444);
+    create_resource(cameraPath + FIREREST_NEXT "/monitor.jpg", 0444);
 
     json_t *pProfileMap = json_object_get(pCamera, "profile_map");
     if (pProfileMap == 0) {
@@ -343,6 +518,7 @@ string FireREST::config_camera(const char*cv_path, json_t *pCamera, const char *
             create_resource(cvePath + "firesight.json", 0444);
             create_resource(cvePath + "save.fire", 0444);
             create_resource(cvePath + "process.fire", 0444);
+            create_resource(cvePath + "calibrate.fire", 0444);
             create_resource(cvePath + "saved.png", 0444);
             create_resource(cvePath + "properties.json", 0666);
         }
@@ -358,10 +534,10 @@ string FireREST::config_cv(const char* varPath, json_t *pConfig) {
     if (pCv == 0) {
         return string("FireREST::config_cv() missing configuration: cv\n");
     }
+    double maxFPS = 0; // default for cameras without their own maxfps
     json_t *pMaxFPS = json_object_get(pCv, "maxfps");
-    if (json_is_real(pMaxFPS)) {
-        double maxFPS = json_real_value(pMaxFPS);
-        worker.cameras[0].set_min_capture_ms(1000/maxFPS);
+    if (json_is_number(pMaxFPS)) {
+        maxFPS = json_number_value(pMaxFPS);
     }
 
     json_t *pCveMap = 0;
@@ -388,7 +564,7 @@ string FireREST::config_cv(const char* varPath, json_t *pConfig) {
     const char *pCameraName;
     json_t *pCamera;
     json_object_foreach(pCameraMap, pCameraName, pCamera) {
-        errMsg += config_camera(cvPath.c_str(), pCamera, pCameraName, pCveMap);
+        errMsg += config_camera(cvPath.c_str(), pCamera, pCameraName, pCveMap, maxFPS);
     }
 
     return errMsg;
@@ -442,6 +618,10 @@ string FireREST::config_cnc_serial(string dcePath, json_t *pSerial) {
 
 	dce.set_serial_ack(config_string(pSerial, "ack", "{\"sr\"").c_str());	// TinyG acknowledgement 
 
+    json_t * pWindow = json_object_get(pSerial, "window"); // controller planner buffer lines
+    dce.set_serial_window(json_is_integer(pWindow) ? json_integer_value(pWindow) : 0);
+    LOGINFO2("FireREST::config_cnc_serial(%s) window:%d", dcePath.c_str(), dce.get_serial_window());
+
     string stty = config_string(pSerial, "stty", "115200 cs8");
     LOGINFO2("FireREST::config_cnc_serial(%s) stty %s", dcePath.c_str(), stty.c_str());
     dce.setSerialStty(stty.c_str());
@@ -535,6 +715,8 @@ bool FireREST::isSync(const char *pJson) {
 void FireREST::configure_json(const char *pJson) {
     string errMsg;
 
+    nodeMap.clear(); // configuration may replace CVEs and DCEs
+    configured = time(NULL);
     json_error_t jerr;
     json_t *pConfig = json_loads(pJson, 0, &jerr);
     if (pConfig == 0) {
@@ -555,6 +737,23 @@ void FireREST::configure_json(const char *pJson) {
             LOGINFO1("FireREST::configure_json() idle_period:%ds", period);
             worker.setIdlePeriod(period);
         }
+        json_t * cve_threads = json_object_get(bgwkr, "cve-threads");
+        if (json_is_number(cve_threads)) {
+            int threads = json_integer_value(cve_threads);
+            LOGINFO1("FireREST::configure_json() cve_threads:%d", threads);
+            worker.setCveThreads(threads);
+        }
+    }
+
+    json_t * pMjpeg = json_object_get(pConfig, "mjpeg");
+    json_t * pMjpegPort = json_object_get(pMjpeg, "port");
+    if (json_is_integer(pMjpegPort)) {
+        int port = json_integer_value(pMjpegPort);
+        const char *host = json_string_value(json_object_get(pMjpeg, "host")); // NULL for loopback
+        LOGINFO2("FireREST::configure_json() mjpeg host:%s port:%d", host ? host : "(loopback)", port);
+        mjpeg.start(port, host); // failure is logged; FUSE does not depend on it
+    } else {
+        mjpeg.stop();
     }
 
     char *p_files_json = json_dumps(files.get("/"), JSON_INDENT(2)|JSON_PRESERVE_ORDER);
@@ -568,6 +767,8 @@ void FireREST::configure_json(const char *pJson) {
         LOGERROR1("FireREST::configure_json() -> %s", errMsg.c_str());
         ASSERTFAIL("configuration error");
     }
+
+    create_nodes();
 }
 
 char * FireREST::configure_path(const char *path) {
@@ -603,7 +804,8 @@ int firerest_getattr_default(const char *path, struct stat *stbuf) {
         memset(stbuf, 0, sizeof(struct stat));
         stbuf->st_uid = getuid();
         stbuf->st_gid = getgid();
-        stbuf->st_atime = stbuf->st_mtime = stbuf->st_ctime = time(NULL);
+        stbuf->st_atime = time(NULL);
+        stbuf->st_mtime = stbuf->st_ctime = firerest.configureTime(); // directories only change on configure
         stbuf->st_nlink = 2;
         stbuf->st_mode = S_IFDIR | firerest.perms(path);
         stbuf->st_size = 4096;
@@ -641,6 +843,84 @@ char * firerest_config(const char * path) {
     return firerest.configure_path(path);
 }
 
+const FireNode * firerest_node(const char *path) {
+    return firerest.node(path);
+}
+
+const FireNode * firehandle_node(struct fuse_file_info *fi) {
+    return fi->fh ? ((FireHandle *) fi->fh)->pNode : NULL;
+}
+
+bool firenode_is_cv(const FireNode *pNode) {
+    return pNode && !pNode->cnc;
+}
+
+bool firenode_is_cnc(const FireNode *pNode) {
+    return pNode && pNode->cnc;
+}
+
+LockFreeLIFOCache<SmartPointer<char> > * firenode_cache(const FireNode *pNode) {
+    if (!pNode) {
+        return NULL;
+    }
+    switch (pNode->kind) {
+    case FIRENODE_CAMERA_JPG:
+    case FIRENODE_CAMERA_JPG_TILDE:
+        return &pNode->pCamera->src_camera_jpg;
+    case FIRENODE_OUTPUT_JPG:
+    case FIRENODE_NEXT_OUTPUT_JPG:
+        return &pNode->pCamera->src_output_jpg;
+    case FIRENODE_MONITOR_JPG:
+    case FIRENODE_NEXT_MONITOR_JPG:
+        return &pNode->pCamera->src_monitor_jpg;
+    case FIRENODE_SAVE_FIRE:
+        return &pNode->pCve->src_save_fire;
+    case FIRENODE_PROCESS_FIRE:
+        return &pNode->pCve->src_process_fire;
+    case FIRENODE_CALIBRATE_FIRE:
+        return &pNode->pCve->src_calibrate_fire;
+    case FIRENODE_BATCH_FIRE:
+        return &pNode->pCamera->src_batch_fire;
+    case FIRENODE_SAVED_PNG:
+        return &pNode->pCve->src_saved_png;
+    case FIRENODE_FIRESIGHT_JSON:
+        return &pNode->pCve->src_firesight_json;
+    case FIRENODE_PROPERTIES_JSON:
+        return &pNode->pCve->src_properties_json;
+    case FIRENODE_GCODE_FIRE:
+        return &pNode->pDce->src_gcode_fire;
+    default:
+        return NULL;
+    }
+}
+
+int firenode_getattr(const FireNode *pNode, const char *path, struct stat *stbuf, size_t minSize) {
+    long generation;
+    struct timespec modified;
+    SmartPointer<char> data(firenode_cache(pNode)->peek(&generation, &modified));
+    int res = firefuse_getattr_file(path, stbuf, max(minSize, data.size()), pNode->perm);
+    stbuf->st_mtim = modified;
+    stbuf->st_ctim = modified;
+    return res;
+}
+
+int firerest_getxattr(const char *path, const char *name, char *value, size_t size) {
+    LockFreeLIFOCache<SmartPointer<char> > *pCache = firenode_cache(firerest_node(path));
+    if (!pCache || strcmp(name, FIREREST_XATTR_GENERATION)) {
+        return -ENODATA;
+    }
+    char generation[32];
+    int len = snprintf(generation, sizeof(generation), "%ld", pCache->getWriteCount());
+    if (size == 0) {
+        return len; // caller is asking for the value size
+    }
+    if (size < (size_t) len) {
+        return -ERANGE;
+    }
+    memcpy(value, generation, len);
+    return len;
+}
+
 static const char *RFC4648 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
 static const char *HEX = "0123456789abcdef";
 
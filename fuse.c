@@ -26,6 +26,9 @@ int jpg_length;
 #define MAX_ECHO 255
 char echoBuf[MAX_ECHO+1];
 
+// FUSE callbacks run on concurrent libfuse threads (unless mounted with -s)
+static pthread_mutex_t fuseMutex = PTHREAD_MUTEX_INITIALIZER; // echoBuf, headcam_image_fstat
+
 /////////////////////// THREADS ////////////////////////
 
 pthread_t tidCamera;
@@ -41,7 +44,7 @@ static char *pConfigJson = NULL;
 
 #define CONFIG_JSON "/var/firefuse/config.json"
 
-static void * firefuse_init(struct fuse_conn_info *conn) {
+void * firefuse_init(struct fuse_conn_info *conn) {
     int rc = 0;
 
     firelog_init(FIRELOG_FILE, FIRELOG_INFO);
@@ -65,7 +68,7 @@ static void * firefuse_init(struct fuse_conn_info *conn) {
     return NULL; /* init */
 }
 
-static void firefuse_destroy(void * initData) {
+void firefuse_destroy(void * initData) {
     if (logFile) {
         LOGINFO("firefuse_destroy()");
         firelog_destroy();
@@ -81,11 +84,12 @@ int firefuse_unlink(const char *path) {
 }
 
 int firefuse_getattr(const char *path, struct stat *stbuf) {
-    if (is_cv_path(path)) {
-        return cve_getattr(path, stbuf);
+    const FireNode *pNode = firerest_node(path);
+    if (firenode_is_cv(pNode)) {
+        return cve_getattr(pNode, path, stbuf);
     }
-    if (is_cnc_path(path)) {
-        return cnc_getattr(path, stbuf);
+    if (firenode_is_cnc(pNode)) {
+        return cnc_getattr(pNode, path, stbuf);
     }
 
     int res = 0;
@@ -115,15 +119,18 @@ int firefuse_getattr(const char *path, struct stat *stbuf) {
         stbuf->st_nlink = 1;
         stbuf->st_size = strlen(status_str);
     } else if (strcmp(path, HOLES_PATH) == 0) {
+        pthread_mutex_lock(&fuseMutex);
         memcpy(&headcam_image_fstat, &headcam_image, sizeof(FuseDataBuffer));
+        stbuf->st_size = headcam_image_fstat.length;
+        pthread_mutex_unlock(&fuseMutex);
         stbuf->st_mode = S_IFREG | 0666;
         stbuf->st_nlink = 1;
-        stbuf->st_size = 1;
-        stbuf->st_size = headcam_image_fstat.length;
     } else if (strcmp(path, ECHO_PATH) == 0) {
         stbuf->st_mode = S_IFREG | 0666;
         stbuf->st_nlink = 1;
+        pthread_mutex_lock(&fuseMutex);
         stbuf->st_size = strlen(echoBuf);
+        pthread_mutex_unlock(&fuseMutex);
     } else if (strcmp(path, FIRELOG_PATH) == 0) {
         stbuf->st_mode = S_IFREG | 0666;
         stbuf->st_nlink = 1;
@@ -146,13 +153,11 @@ int firefuse_getattr(const char *path, struct stat *stbuf) {
     return res;
 }
 
-static int firefuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
-                            off_t offset, struct fuse_file_info *fi)
+int firefuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+                      off_t offset, struct fuse_file_info *fi)
 {
     LOGTRACE1("firefuse_readdir(%s)", path);
-    if (is_cv_path(path) ||
-            is_cnc_path(path) ||
-            0==strcmp(path, FIREREST_SYNC)) {
+    if (firerest_node(path) || 0==strcmp(path, FIREREST_SYNC)) {
         return firerest_readdir(path, buf, filler, offset, fi);
     }
 
@@ -187,11 +192,12 @@ int firefuse_create(const char *path, mode_t mode, struct fuse_file_info *fi) {
 }
 
 int firefuse_open(const char *path, struct fuse_file_info *fi) {
-    if (is_cv_path(path)) {
-        return cve_open(path, fi);
+    const FireNode *pNode = firerest_node(path);
+    if (firenode_is_cv(pNode)) {
+        return cve_open(pNode, path, fi);
     }
-    if (is_cnc_path(path)) {
-        return cnc_open(path, fi);
+    if (firenode_is_cnc(pNode)) {
+        return cnc_open(pNode, path, fi);
     }
     LOGDEBUG1("firefuse_open(%s)", path);
 
@@ -203,8 +209,10 @@ int firefuse_open(const char *path, struct fuse_file_info *fi) {
         verifyOpenR_(path, fi, &result);
     } else if (strcmp(path, HOLES_PATH) == 0) {		// "/holes"
         verifyOpenR_(path, fi, &result);
-        fi->fh = (uint64_t) (size_t) fopen("/var/firefuse/config.json", "r");
-        if (!fi->fh) {
+        FILE *fConfig = fopen(CONFIG_JSON, "r"); // fi->fh is reserved for FireHandle
+        if (fConfig) {
+            fclose(fConfig);
+        } else {
             result = -ENOENT;
         }
     } else if (strcmp(path, ECHO_PATH) == 0) {		// "/echo"
@@ -245,10 +253,11 @@ void firefuse_freeDataBuffer(const char *path, struct fuse_file_info *fi) {
 }
 
 int firefuse_release(const char *path, struct fuse_file_info *fi) {
-    if (is_cv_path(path)) {
+    const FireNode *pNode = firehandle_node(fi);
+    if (firenode_is_cv(pNode)) {
         return cve_release(path, fi);
     }
-    if (is_cnc_path(path)) {
+    if (firenode_is_cnc(pNode)) {
         return cnc_release(path, fi);
     }
 
@@ -258,7 +267,7 @@ int firefuse_release(const char *path, struct fuse_file_info *fi) {
     } else if (strcmp(path, CONFIG_PATH) == 0) {
         // NOP
     } else if (strcmp(path, HOLES_PATH) == 0) {
-        firefuse_freeDataBuffer(path, fi);
+        // NOP
     } else if (strcmp(path, ECHO_PATH) == 0) {
         // NOP
     } else if (strcmp(path, FIRELOG_PATH) == 0) {
@@ -270,17 +279,18 @@ int firefuse_release(const char *path, struct fuse_file_info *fi) {
 }
 
 int firefuse_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
-    if (is_cv_path(path)) {
+    const FireNode *pNode = firehandle_node(fi);
+    if (firenode_is_cv(pNode)) {
         int res = cve_read(path, buf, size, offset, fi);
         if (res > 0) {
-            bytes_read += res;
+            __sync_fetch_and_add(&bytes_read, res);
         }
         return res;
     }
-    if (is_cnc_path(path)) {
+    if (firenode_is_cnc(pNode)) {
         int res = cnc_read(path, buf, size, offset, fi);
         if (res > 0) {
-            bytes_read += res;
+            __sync_fetch_and_add(&bytes_read, res);
         }
         return res;
     }
@@ -299,7 +309,9 @@ int firefuse_read(const char *path, char *buf, size_t size, off_t offset, struct
         const char *holes_str = "holes";
         sizeOut = firefuse_readBuffer(buf, holes_str, size, offset, strlen(holes_str));
     } else if (strcmp(path, ECHO_PATH) == 0) {
+        pthread_mutex_lock(&fuseMutex);
         sizeOut = firefuse_readBuffer(buf, echoBuf, size, offset, strlen(echoBuf));
+        pthread_mutex_unlock(&fuseMutex);
     } else if (strcmp(path, FIRELOG_PATH) == 0) {
         char *str = "Actual log is " FIRELOG_FILE "\n";
         sizeOut = firefuse_readBuffer(buf, str, size, offset, strlen(str));
@@ -312,7 +324,7 @@ int firefuse_read(const char *path, char *buf, size_t size, off_t offset, struct
     }
 
     LOGTRACE3("firefuse_read(%s, %ldB) -> %ldB", path, size, sizeOut);
-    bytes_read += sizeOut;
+    __sync_fetch_and_add(&bytes_read, sizeOut);
     return sizeOut;
 }
 
@@ -321,23 +333,27 @@ int firefuse_write(const char *path, const char *buf, size_t bufsize, off_t offs
         LOGERROR1("firefuse_write %s -> null buffer", path);
         return EINVAL;
     }
-    if (is_cv_path(path)) {
+    const FireNode *pNode = firehandle_node(fi);
+    if (firenode_is_cv(pNode)) {
         return cve_write(path, buf, bufsize, offset, fi);
     }
-    if (is_cnc_path(path)) {
+    if (firenode_is_cnc(pNode)) {
         return cnc_write(path, buf, bufsize, offset, fi);
     }
 
     LOGTRACE1("firefuse_write(%s)", path);
     if (strcmp(path, ECHO_PATH) == 0) {
+        pthread_mutex_lock(&fuseMutex);
         if (bufsize > MAX_ECHO) {
-            sprintf(echoBuf, "firefuse_write %s -> string too long (%ld > %d bytes)", path, bufsize, MAX_ECHO);
+            snprintf(echoBuf, sizeof(echoBuf), "firefuse_write %s -> string too long (%ld > %d bytes)", path, bufsize, MAX_ECHO);
             LOGERROR1("%s", echoBuf);
+            pthread_mutex_unlock(&fuseMutex);
             return EINVAL;
         }
         memcpy(echoBuf, buf, bufsize);
         echoBuf[bufsize] = 0;
         LOGINFO2("firefuse_write %s -> %s", path, echoBuf);
+        pthread_mutex_unlock(&fuseMutex);
     } else if (strcmp(path, FIRELOG_PATH) == 0) {
         switch (buf[0]) {
         case 'E':
@@ -373,12 +389,13 @@ int firefuse_write(const char *path, const char *buf, size_t bufsize, off_t offs
     return bufsize;
 }
 
-static int firefuse_truncate(const char *path, off_t size) {
-    if (is_cv_path(path)) {
-        return cve_truncate(path, size);
+int firefuse_truncate(const char *path, off_t size) {
+    const FireNode *pNode = firerest_node(path);
+    if (firenode_is_cv(pNode)) {
+        return cve_truncate(pNode, path, size);
     }
-    if (is_cnc_path(path)) {
-        return cnc_truncate(path, size);
+    if (firenode_is_cnc(pNode)) {
+        return cnc_truncate(pNode, path, size);
     }
 
     LOGDEBUG1("firefuse_truncate %s", path);
@@ -398,10 +415,12 @@ static int firefuse_truncate(const char *path, off_t size) {
     return 0;
 }
 
-static int firefuse_rename(const char *path1, const char *path2) {
+int firefuse_rename(const char *path1, const char *path2) {
     //LOGTRACE2("firefuse_rename(%s,%s)", path1, path2);
-    if (is_cv_path(path1) && is_cv_path(path2)) {
-        return cve_rename(path1, path2);
+    const FireNode *pNode1 = firerest_node(path1);
+    const FireNode *pNode2 = firerest_node(path2);
+    if (firenode_is_cv(pNode1) && firenode_is_cv(pNode2)) {
+        return cve_rename(pNode1, path1, pNode2, path2);
     }
     LOGERROR2("firefuse_rename(%s,%s) -> -ENOENT", path1, path2);
     return -ENOENT;
@@ -431,6 +450,12 @@ int firefuse_getattr_file(const char *path, struct stat *stbuf, size_t length, i
 }
 
 
+int firefuse_getxattr(const char *path, const char *name, char *value, size_t size) {
+    int res = firerest_getxattr(path, name, value, size);
+    LOGTRACE3("firefuse_getxattr(%s,%s) -> %d", path, name, res);
+    return res;
+}
+
 static struct fuse_operations firefuse_oper = {
     .init      = firefuse_init,
     .destroy   = firefuse_destroy,
@@ -444,10 +469,18 @@ static struct fuse_operations firefuse_oper = {
     .unlink    = firefuse_unlink,
     .write     = firefuse_write,
     .rename    = firefuse_rename,
+    .getxattr  = firefuse_getxattr,
 };
 
 int firefuse_main(int argc, char *argv[]) {
     fuse_root = argv[argc-1];
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], LOWLEVEL_OPTION) == 0) { // not a libfuse option
+            memmove(&argv[i], &argv[i+1], (argc-i) * sizeof(char *));
+            return firefuse_lowlevel_main(argc-1, argv);
+        }
+    }
     return fuse_main(argc, argv, &firefuse_oper, NULL);
 }
 
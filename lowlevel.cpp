@@ -0,0 +1,372 @@
+#include "FireSight.hpp"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <iostream>
+#include "firefuse.h"
+#include <fuse_lowlevel.h>
+
+// Low-level FUSE front end (firefuse --lowlevel ...)
+// Requests are addressed by inode and delegated to the path based firefuse_* callbacks.
+// Reads of an open FireHandle are answered straight from its refcounted SmartPointer
+// snapshot with fuse_reply_data(), avoiding the copies made by the high-level read().
+
+using namespace std;
+
+#define ENTRY_TIMEOUT 1.0 /* seconds the kernel may cache a name lookup (paths are stable) */
+#define STATIC_ATTR_TIMEOUT 1.0 /* seconds the kernel may cache attributes of directories and firesight.json */
+#define FILE_ATTR_TIMEOUT 0.0 /* file sizes change with every image; clients compare st_mtim instead */
+
+FireInodes fireinodes;
+
+FireInodes::FireInodes() {
+    pthread_mutex_init(&inodeMutex, NULL);
+    nextIno = FUSE_ROOT_ID; // inode 0 is not valid
+    assign("/");
+}
+
+FireInodes::~FireInodes() {
+    pthread_mutex_destroy(&inodeMutex);
+}
+
+unsigned long FireInodes::assign(const char *path) {
+    std::unordered_map<string, unsigned long>::iterator it = inoMap.find(path);
+    if (it != inoMap.end()) {
+        return it->second;
+    }
+    unsigned long result = nextIno++;
+    inoMap[path] = result;
+    FireInode &inode = inodes[result];
+    inode.path = path;
+    inode.nlookup = 0;
+    return result;
+}
+
+unsigned long FireInodes::ino(const char *path) {
+    pthread_mutex_lock(&inodeMutex);
+    /////////////// CRITICAL SECTION BEGIN ///////////////
+    unsigned long result = assign(path);
+    /////////////// CRITICAL SECTION END ///////////////
+    pthread_mutex_unlock(&inodeMutex);
+    return result;
+}
+
+unsigned long FireInodes::lookup(const char *path) {
+    pthread_mutex_lock(&inodeMutex);
+    /////////////// CRITICAL SECTION BEGIN ///////////////
+    unsigned long result = assign(path);
+    inodes[result].nlookup++;
+    /////////////// CRITICAL SECTION END ///////////////
+    pthread_mutex_unlock(&inodeMutex);
+    return result;
+}
+
+/**
+ * Release nlookup kernel references to ino. An inode without references is
+ * dropped, so that transient paths such as next/monitor.jpg@41 do not accumulate.
+ * The root inode is never dropped.
+ */
+void FireInodes::forget(unsigned long ino, unsigned long nlookup) {
+    pthread_mutex_lock(&inodeMutex);
+    /////////////// CRITICAL SECTION BEGIN ///////////////
+    std::unordered_map<unsigned long, FireInode>::iterator it = inodes.find(ino);
+    if (it != inodes.end() && ino != FUSE_ROOT_ID) {
+        it->second.nlookup -= min(nlookup, it->second.nlookup);
+        if (it->second.nlookup == 0) {
+            inoMap.erase(it->second.path);
+            inodes.erase(it);
+        }
+    }
+    /////////////// CRITICAL SECTION END ///////////////
+    pthread_mutex_unlock(&inodeMutex);
+}
+
+size_t FireInodes::size() {
+    pthread_mutex_lock(&inodeMutex);
+    size_t result = inodes.size();
+    pthread_mutex_unlock(&inodeMutex);
+    return result;
+}
+
+bool FireInodes::path(unsigned long ino, string &path) {
+    bool result = FALSE;
+    pthread_mutex_lock(&inodeMutex);
+    /////////////// CRITICAL SECTION BEGIN ///////////////
+    std::unordered_map<unsigned long, FireInode>::iterator it = inodes.find(ino);
+    if (it != inodes.end()) {
+        path = it->second.path;
+        result = TRUE;
+    }
+    /////////////// CRITICAL SECTION END ///////////////
+    pthread_mutex_unlock(&inodeMutex);
+    return result;
+}
+
+string FireInodes::child(unsigned long parent, const char *name) {
+    string dir;
+    if (!path(parent, dir)) {
+        return string();
+    }
+    return dir == "/" ? dir + name : dir + "/" + name;
+}
+
+static double lowlevel_attr_timeout(const string &path, const struct stat *stbuf) {
+    if (S_ISDIR(stbuf->st_mode)) {
+        return STATIC_ATTR_TIMEOUT;
+    }
+    const FireNode *pNode = firerest_node(path.c_str());
+    return pNode && pNode->kind == FIRENODE_FIRESIGHT_JSON ? STATIC_ATTR_TIMEOUT : FILE_ATTR_TIMEOUT;
+}
+
+static int lowlevel_entry(const string &path, struct fuse_entry_param *e) {
+    memset(e, 0, sizeof(struct fuse_entry_param));
+    int res = firefuse_getattr(path.c_str(), &e->attr);
+    if (res == 0) {
+        e->ino = fireinodes.lookup(path.c_str()); // released by lowlevel_forget()
+        e->attr.st_ino = e->ino;
+        e->attr_timeout = lowlevel_attr_timeout(path, &e->attr);
+        e->entry_timeout = ENTRY_TIMEOUT;
+    }
+    return res;
+}
+
+static void lowlevel_init(void *userdata, struct fuse_conn_info *conn) {
+    firefuse_init(conn);
+    if (conn->capable & FUSE_CAP_SPLICE_WRITE) { // fd-backed replies bypass user space
+        conn->want |= FUSE_CAP_SPLICE_WRITE;
+    }
+    LOGINFO2("lowlevel_init() capable:%x want:%x", conn->capable, conn->want);
+}
+
+static void lowlevel_destroy(void *userdata) {
+    firefuse_destroy(userdata);
+}
+
+static void lowlevel_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    string path = fireinodes.child(parent, name);
+    struct fuse_entry_param e;
+    int res = path.empty() ? -ENOENT : lowlevel_entry(path, &e);
+    if (res) {
+        fuse_reply_err(req, -res);
+    } else {
+        fuse_reply_entry(req, &e);
+    }
+}
+
+static void lowlevel_forget(fuse_req_t req, fuse_ino_t ino, unsigned long nlookup) {
+    fireinodes.forget(ino, nlookup);
+    fuse_reply_none(req);
+}
+
+static void lowlevel_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    string path;
+    struct stat stbuf;
+    int res = fireinodes.path(ino, path) ? firefuse_getattr(path.c_str(), &stbuf) : -ENOENT;
+    if (res) {
+        fuse_reply_err(req, -res);
+    } else {
+        stbuf.st_ino = ino;
+        fuse_reply_attr(req, &stbuf, lowlevel_attr_timeout(path, &stbuf));
+    }
+}
+
+static void lowlevel_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr, int to_set, struct fuse_file_info *fi) {
+    string path;
+    int res = fireinodes.path(ino, path) ? 0 : -ENOENT;
+    if (res == 0 && (to_set & FUSE_SET_ATTR_SIZE)) {
+        res = firefuse_truncate(path.c_str(), attr->st_size);
+    }
+    struct stat stbuf;
+    if (res == 0) {
+        res = firefuse_getattr(path.c_str(), &stbuf);
+    }
+    if (res) {
+        fuse_reply_err(req, -res);
+    } else {
+        stbuf.st_ino = ino;
+        fuse_reply_attr(req, &stbuf, lowlevel_attr_timeout(path, &stbuf));
+    }
+}
+
+static void lowlevel_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name, size_t size) {
+    string path;
+    vector<char> value(size + 1);
+    int res = fireinodes.path(ino, path) ? firefuse_getxattr(path.c_str(), name, &value[0], size) : -ENOENT;
+    if (res < 0) {
+        fuse_reply_err(req, -res);
+    } else if (size == 0) {
+        fuse_reply_xattr(req, res);
+    } else {
+        fuse_reply_buf(req, &value[0], res);
+    }
+}
+
+static void lowlevel_unlink(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    string path = fireinodes.child(parent, name);
+    int res = path.empty() ? -ENOENT : firefuse_unlink(path.c_str());
+    fuse_reply_err(req, -res);
+}
+
+static void lowlevel_rename(fuse_req_t req, fuse_ino_t parent, const char *name, fuse_ino_t newparent, const char *newname) {
+    string path1 = fireinodes.child(parent, name);
+    string path2 = fireinodes.child(newparent, newname);
+    int res = path1.empty() || path2.empty() ? -ENOENT : firefuse_rename(path1.c_str(), path2.c_str());
+    fuse_reply_err(req, -res);
+}
+
+static void lowlevel_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    string path;
+    int res = fireinodes.path(ino, path) ? firefuse_open(path.c_str(), fi) : -ENOENT;
+    if (res) {
+        fuse_reply_err(req, -res);
+    } else if (fuse_reply_open(req, fi) == -ENOENT) { // interrupted
+        firefuse_release(path.c_str(), fi);
+    }
+}
+
+static void lowlevel_create(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode, struct fuse_file_info *fi) {
+    string path = fireinodes.child(parent, name);
+    struct fuse_entry_param e;
+    int res = path.empty() ? -ENOENT : firefuse_create(path.c_str(), mode, fi);
+    if (res == 0) {
+        res = lowlevel_entry(path, &e);
+    }
+    if (res == 0) {
+        res = firefuse_open(path.c_str(), fi);
+    }
+    if (res) {
+        fuse_reply_err(req, -res);
+    } else if (fuse_reply_create(req, &e, fi) == -ENOENT) { // interrupted
+        firefuse_release(path.c_str(), fi);
+    }
+}
+
+static void lowlevel_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi) {
+    if (fi->fh) { // cve_open() or cnc_open() snapshot
+        SmartPointer<char> &data = ((FireHandle *) fi->fh)->data;
+        size_t sizeOut = off < data.size() ? min(size, (size_t)(data.size() - off)) : 0;
+        struct fuse_bufvec bufv = FUSE_BUFVEC_INIT(sizeOut);
+        bufv.buf[0].mem = sizeOut ? data.data() + off : NULL;
+        // libfuse writes a single memory buffer to /dev/fuse with one writev().
+        // The handle keeps data alive until release(), after this reply has been written.
+        int res = fuse_reply_data(req, &bufv, FUSE_BUF_SPLICE_NONBLOCK);
+        if (res == 0) {
+            __sync_fetch_and_add(&bytes_read, sizeOut);
+        }
+        LOGTRACE4("lowlevel_read(%ld,%ldB,%ld) -> %ldB", (long) ino, (long) size, (long) off, (long) sizeOut);
+        return;
+    }
+
+    string path;
+    if (!fireinodes.path(ino, path)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    vector<char> buf(size + 1);
+    int res = firefuse_read(path.c_str(), &buf[0], size, off, fi);
+    if (res < 0) {
+        fuse_reply_err(req, -res);
+    } else {
+        fuse_reply_buf(req, &buf[0], res);
+    }
+}
+
+static void lowlevel_write(fuse_req_t req, fuse_ino_t ino, const char *buf, size_t size, off_t off, struct fuse_file_info *fi) {
+    string path;
+    int res = fireinodes.path(ino, path) ? firefuse_write(path.c_str(), buf, size, off, fi) : -ENOENT;
+    if (res < 0) {
+        fuse_reply_err(req, -res);
+    } else {
+        fuse_reply_write(req, res);
+    }
+}
+
+static void lowlevel_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    string path;
+    fireinodes.path(ino, path);
+    fuse_reply_err(req, -firefuse_release(path.c_str(), fi));
+}
+
+typedef struct DirEntries {
+    fuse_req_t req;
+    string dir;
+    vector<char> buf;
+} DirEntries;
+
+static int lowlevel_fill(void *buf, const char *name, const struct stat *stbuf, off_t off) {
+    DirEntries *pEntries = (DirEntries *) buf;
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    if (strcmp(name, ".") && strcmp(name, "..")) {
+        string path = pEntries->dir == "/" ? pEntries->dir + name : pEntries->dir + "/" + name;
+        st.st_ino = fireinodes.ino(path.c_str());
+    }
+    size_t oldSize = pEntries->buf.size();
+    size_t entrySize = fuse_add_direntry(pEntries->req, NULL, 0, name, NULL, 0);
+    pEntries->buf.resize(oldSize + entrySize);
+    fuse_add_direntry(pEntries->req, &pEntries->buf[oldSize], entrySize, name, &st, oldSize + entrySize);
+    return 0;
+}
+
+static void lowlevel_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi) {
+    DirEntries entries;
+    entries.req = req;
+    int res = fireinodes.path(ino, entries.dir) ?
+              firefuse_readdir(entries.dir.c_str(), &entries, lowlevel_fill, 0, fi) : -ENOENT;
+    if (res) {
+        fuse_reply_err(req, -res);
+    } else if (off < entries.buf.size()) {
+        fuse_reply_buf(req, &entries.buf[off], min(size, (size_t)(entries.buf.size() - off)));
+    } else {
+        fuse_reply_buf(req, NULL, 0);
+    }
+}
+
+int firefuse_lowlevel_main(int argc, char *argv[]) {
+    struct fuse_lowlevel_ops lowlevel_oper;
+    memset(&lowlevel_oper, 0, sizeof(lowlevel_oper));
+    lowlevel_oper.init = lowlevel_init;
+    lowlevel_oper.destroy = lowlevel_destroy;
+    lowlevel_oper.lookup = lowlevel_lookup;
+    lowlevel_oper.forget = lowlevel_forget;
+    lowlevel_oper.getattr = lowlevel_getattr;
+    lowlevel_oper.setattr = lowlevel_setattr;
+    lowlevel_oper.getxattr = lowlevel_getxattr;
+    lowlevel_oper.unlink = lowlevel_unlink;
+    lowlevel_oper.rename = lowlevel_rename;
+    lowlevel_oper.open = lowlevel_open;
+    lowlevel_oper.create = lowlevel_create;
+    lowlevel_oper.read = lowlevel_read;
+    lowlevel_oper.write = lowlevel_write;
+    lowlevel_oper.release = lowlevel_release;
+    lowlevel_oper.readdir = lowlevel_readdir;
+
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    char *mountpoint = NULL;
+    int multithreaded = 0;
+    int foreground = 0;
+    int err = -1;
+    if (fuse_parse_cmdline(&args, &mountpoint, &multithreaded, &foreground) != -1 && mountpoint) {
+        struct fuse_chan *ch = fuse_mount(mountpoint, &args);
+        if (ch) {
+            struct fuse_session *se = fuse_lowlevel_new(&args, &lowlevel_oper, sizeof(lowlevel_oper), NULL);
+            if (se) {
+                if (fuse_set_signal_handlers(se) != -1) {
+                    fuse_session_add_chan(se, ch);
+                    fuse_daemonize(foreground);
+                    err = multithreaded ? fuse_session_loop_mt(se) : fuse_session_loop(se);
+                    fuse_remove_signal_handlers(se);
+                    fuse_session_remove_chan(ch);
+                }
+                fuse_session_destroy(se);
+            }
+            fuse_unmount(mountpoint, ch);
+        }
+    }
+    free(mountpoint);
+    fuse_opt_free_args(&args);
+    return err ? 1 : 0;
+}
@@ -0,0 +1,311 @@
+#include "FireSight.hpp"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <time.h>
+#include <iostream>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "firefuse.h"
+
+// Embedded HTTP listener that streams monitor.jpg and output.jpg as
+// multipart/x-mixed-replace MJPEG, e.g.:
+//   curl http://localhost:8081/cv/1/monitor.jpg
+// Each client thread sends the cached SmartPointer of the current frame,
+// so all clients share one frame buffer.
+// There is no authentication, so the listener binds the loopback interface
+// unless configured with another address, e.g. "mjpeg":{"port":8081,"host":"0.0.0.0"}.
+// A client that stalls for MJPEG_MSTIMEOUT skips frames instead of being disconnected.
+
+#define MJPEG_BOUNDARY "firefuse"
+#define MJPEG_MSTIMEOUT 1000 /* client threads check for shutdown at least this often */
+#define MJPEG_MAX_STALLS 10 /* MJPEG_MSTIMEOUT stalls before a partly sent frame disconnects its client */
+#define MJPEG_LOOPBACK "127.0.0.1"
+#define MJPEG_MAX_REQUEST 1024
+
+MJPEGServer mjpeg;
+
+typedef struct MJPEGClient {
+    MJPEGServer *pServer;
+    int fd;
+} MJPEGClient;
+
+MJPEGServer::MJPEGServer() {
+    port = 0;
+    host = MJPEG_LOOPBACK;
+    listen_fd = -1;
+    shutdown_fd = -1;
+    running.store(FALSE);
+    clients.store(0);
+    frames.store(0);
+    skipped.store(0);
+}
+
+MJPEGServer::~MJPEGServer() {
+    stop();
+}
+
+int MJPEGServer::start(int port, const char *host) {
+    if (host == NULL) {
+        host = MJPEG_LOOPBACK;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        LOGERROR1("MJPEGServer::start() invalid IPv4 host:%s", host);
+        return EINVAL;
+    }
+    addr.sin_port = htons(port);
+    if (running.load()) {
+        if (this->port == port && this->host.compare(host) == 0) {
+            return 0;
+        }
+        stop();
+    }
+    int rc = 0;
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        rc = errno;
+        LOGERROR1("MJPEGServer::start() socket failed -> %d", rc);
+        return rc;
+    }
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) || listen(listen_fd, SOMAXCONN)) {
+        rc = errno;
+        LOGERROR3("MJPEGServer::start(%s:%d) bind/listen failed -> %d", host, port, rc);
+        close(listen_fd);
+        listen_fd = -1;
+        return rc;
+    }
+    shutdown_fd = eventfd(0, EFD_CLOEXEC);
+    if (shutdown_fd < 0) {
+        rc = errno;
+        LOGERROR1("MJPEGServer::start() eventfd failed -> %d", rc);
+        close(listen_fd);
+        listen_fd = -1;
+        return rc;
+    }
+    this->port = port;
+    this->host = host;
+    running.store(TRUE);
+    LOGRC(rc, "pthread_create(MJPEGServer::listen_thread) -> ", pthread_create(&tidListen, NULL, &listen_thread, this));
+    if (rc) {
+        running.store(FALSE);
+        close(shutdown_fd);
+        close(listen_fd);
+        shutdown_fd = listen_fd = -1;
+        return rc;
+    }
+    LOGINFO2("MJPEGServer::start() listening on %s:%d", host, port);
+    return 0;
+}
+
+void MJPEGServer::stop() {
+    if (!running.load()) {
+        return;
+    }
+    LOGINFO2("MJPEGServer::stop() %s:%d", host.c_str(), port);
+    running.store(FALSE);
+    uint64_t one = 1;
+    if (write(shutdown_fd, &one, sizeof(one)) != sizeof(one)) {
+        LOGERROR("MJPEGServer::stop() eventfd write failed");
+    }
+    pthread_join(tidListen, NULL);
+    while (clients.load() > 0) {
+        usleep(10*1000); // client threads exit within MJPEG_MSTIMEOUT
+    }
+    close(shutdown_fd);
+    close(listen_fd);
+    shutdown_fd = listen_fd = -1;
+}
+
+void * MJPEGServer::listen_thread(void *arg) {
+    MJPEGServer *pServer = (MJPEGServer *) arg;
+    struct pollfd fds[2];
+    fds[0].fd = pServer->listen_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = pServer->shutdown_fd;
+    fds[1].events = POLLIN;
+    for (;;) {
+        int nfds = poll(fds, 2, -1); // block until connection or shutdown
+        if (nfds < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOGERROR1("MJPEGServer::listen_thread() poll [ERRNO:%d]", errno);
+            break;
+        }
+        if (fds[1].revents) {
+            LOGINFO("MJPEGServer::listen_thread() shutdown");
+            break;
+        }
+        int fd = accept4(pServer->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            LOGERROR1("MJPEGServer::listen_thread() accept [ERRNO:%d]", errno);
+            continue;
+        }
+        struct timeval tv;
+        tv.tv_sec = MJPEG_MSTIMEOUT / 1000;
+        tv.tv_usec = (MJPEG_MSTIMEOUT % 1000) * 1000;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        MJPEGClient *pClient = new MJPEGClient();
+        pClient->pServer = pServer;
+        pClient->fd = fd;
+        pServer->clients.fetch_add(1);
+        pthread_t tid;
+        int rc = pthread_create(&tid, NULL, &client_thread, pClient);
+        if (rc) {
+            LOGERROR1("MJPEGServer::listen_thread() pthread_create -> %d", rc);
+            pServer->clients.fetch_sub(1);
+            close(fd);
+            delete pClient;
+        } else {
+            pthread_detach(tid);
+        }
+    }
+    return NULL;
+}
+
+void * MJPEGServer::client_thread(void *arg) {
+    MJPEGClient *pClient = (MJPEGClient *) arg;
+    pClient->pServer->serve(pClient->fd);
+    close(pClient->fd);
+    pClient->pServer->clients.fetch_sub(1);
+    delete pClient;
+    return NULL;
+}
+
+/**
+ * Send all of iov. If the client stalls for MJPEG_MSTIMEOUT (SO_SNDTIMEO) before
+ * any byte is sent, return EAGAIN so that the caller can skip the frame. A partly
+ * sent frame cannot be skipped without corrupting the stream, so it is completed
+ * unless the server stops or the client stalls MJPEG_MAX_STALLS times. Return 0 or errno.
+ */
+static int send_all(int fd, struct iovec *iov, int iovcnt, std::atomic<bool> &running) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+    bool started = FALSE;
+    int stalls = 0;
+    while (msg.msg_iovlen) {
+        ssize_t rc = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (rc < 0) {
+            int err = errno;
+            if (err == EINTR) {
+                continue;
+            }
+            if (err == EAGAIN || err == EWOULDBLOCK) {
+                if (!started) {
+                    return EAGAIN;
+                }
+                if (running.load() && ++stalls < MJPEG_MAX_STALLS) {
+                    continue;
+                }
+                return ETIMEDOUT;
+            }
+            return err;
+        }
+        started = TRUE;
+        while (msg.msg_iovlen && rc >= (ssize_t) msg.msg_iov->iov_len) {
+            rc -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen) {
+            msg.msg_iov->iov_base = (char *) msg.msg_iov->iov_base + rc;
+            msg.msg_iov->iov_len -= rc;
+        }
+    }
+    return 0;
+}
+
+static int send_string(int fd, const char *str, std::atomic<bool> &running) {
+    struct iovec iov;
+    iov.iov_base = (void *) str;
+    iov.iov_len = strlen(str);
+    return send_all(fd, &iov, 1, running);
+}
+
+void MJPEGServer::serve(int fd) {
+    char request[MJPEG_MAX_REQUEST+1];
+    int len = 0;
+    while (len < MJPEG_MAX_REQUEST) {
+        int rc = recv(fd, request+len, MJPEG_MAX_REQUEST-len, 0);
+        if (rc <= 0) {
+            break;
+        }
+        len += rc;
+        request[len] = 0;
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) {
+            break;
+        }
+    }
+    request[len] = 0;
+    char path[MJPEG_MAX_REQUEST+1];
+    if (sscanf(request, "GET %s HTTP/", path) != 1) {
+        LOGERROR1("MJPEGServer::serve() bad request:%s", request);
+        send_string(fd, "HTTP/1.0 400 Bad Request\r\nConnection: close\r\n\r\n", running);
+        return;
+    }
+    const FireNode *pNode = firerest_node(path);
+    if (!pNode || pNode->kind != FIRENODE_MONITOR_JPG && pNode->kind != FIRENODE_OUTPUT_JPG) {
+        LOGERROR1("MJPEGServer::serve(%s) not found", path);
+        send_string(fd, "HTTP/1.0 404 Not Found\r\nConnection: close\r\n\r\n", running);
+        return;
+    }
+    LockFreeLIFOCache<SmartPointer<char> > &cache = *firenode_cache(pNode);
+    if (send_string(fd,
+                    "HTTP/1.0 200 OK\r\n"
+                    "Connection: close\r\n"
+                    "Cache-Control: no-cache\r\n"
+                    "Content-Type: multipart/x-mixed-replace; boundary=" MJPEG_BOUNDARY "\r\n"
+                    "\r\n", running)) {
+        return;
+    }
+    LOGINFO1("MJPEGServer::serve(%s) streaming", path);
+
+    long sent = 0; // generation of last frame sent
+    while (running.load()) {
+        long generation;
+        SmartPointer<char> frame(cache.peek(&generation));
+        if (generation > sent) {
+            cache.get(); // consuming monitor.jpg lets the background worker post the next one
+            sent = generation;
+            if (frame.size()) {
+                char header[128];
+                snprintf(header, sizeof(header),
+                         "--" MJPEG_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %ld\r\n\r\n",
+                         (long) frame.size());
+                struct iovec iov[3];
+                iov[0].iov_base = header;
+                iov[0].iov_len = strlen(header);
+                iov[1].iov_base = frame.data();
+                iov[1].iov_len = frame.size();
+                iov[2].iov_base = (void *) "\r\n";
+                iov[2].iov_len = 2;
+                int rc = send_all(fd, iov, 3, running);
+                if (rc == EAGAIN) {
+                    LOGDEBUG2("MJPEGServer::serve(%s) client stalled, frame %ld skipped", path, generation);
+                    skipped.fetch_add(1);
+                } else if (rc) {
+                    LOGINFO2("MJPEGServer::serve(%s) client closed [ERRNO:%d]", path, rc);
+                    break;
+                } else {
+                    frames.fetch_add(1);
+                }
+            }
+        }
+        cache.wait_post(sent, MJPEG_MSTIMEOUT);
+    }
+}
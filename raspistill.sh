@@ -1,6 +1,8 @@
 #!/bin/bash
 
-sudo rm -f /var/firefuse/raspistill.PID
+# FireFUSE sets RASPISTILL_PID to a PID file of the launching camera
+PIDFILE=${RASPISTILL_PID:-/var/firefuse/raspistill.PID}
+sudo rm -f $PIDFILE
 
 if [ "$1" == "--launch" ]; then
   shift
@@ -30,9 +32,9 @@ else
   echo "PID	: $PID"
 
   mkdir -p /var/firefuse
-  echo "COMMAND	: echo $PID > /var/firefuse/raspistill.PID"
-  echo $PID > /var/firefuse/raspistill.PID
+  echo "COMMAND	: echo $PID > $PIDFILE"
+  echo $PID > $PIDFILE
   RC=$?
   if [ $RC -ne 0 ]; then echo "ERROR	: $RC"; exit $RC; fi
-  echo "SUCCESS	: $PID saved to /var/firefuse/raspistill.PID"
+  echo "SUCCESS	: $PID saved to $PIDFILE"
 fi
@@ -0,0 +1,209 @@
+#include "FireSight.hpp"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <time.h>
+#include <iostream>
+#include <algorithm>
+#include <sys/stat.h>
+#include "firefuse.h"
+
+// Replay camera source for benchmarks and tests on machines without a camera:
+//   "source":{"name":"replay", "config":"/home/pi/frames", "fps":10}
+// config names a directory of .jpg files (replayed in name order) or a frame
+// log of concatenated JPEG frames (e.g., a saved MJPEG stream). Frames are
+// loaded once and posted by reference, so replay measures the pipeline and
+// not the disk. With fps 0 each capture() request posts the next frame at once.
+
+ReplaySource::ReplaySource(CameraNode *pCamera, string path, double fps) {
+    this->pCamera = pCamera;
+    this->path = path;
+    msPeriod = fps > 0 ? max(1, (int) (1000/fps + 0.5)) : 0;
+    iFrame = 0;
+    running = FALSE;
+    requested = FALSE;
+    framesPosted.store(0);
+    ASSERTZERO(pthread_mutex_init(&replayMutex, NULL));
+    ASSERTZERO(pthread_cond_init(&replayCond, NULL));
+}
+
+ReplaySource::~ReplaySource() {
+    stop();
+    pthread_cond_destroy(&replayCond);
+    pthread_mutex_destroy(&replayMutex);
+}
+
+/**
+ * Return the byte length of the JPEG at pData, following marker segments
+ * so that embedded EXIF thumbnails do not end the frame early.
+ * Return 0 if pData does not start with a complete JPEG.
+ */
+size_t ReplaySource::jpeg_length(const char *pData, size_t length) {
+    const uchar *p = (const uchar *) pData;
+    if (length < 4 || p[0] != 0xff || p[1] != 0xd8) {
+        return 0;
+    }
+    size_t i = 2;
+    while (i + 1 < length) {
+        if (p[i] != 0xff) {
+            return 0;
+        }
+        uchar marker = p[i+1];
+        if (marker == 0xff) { // fill byte
+            i++;
+            continue;
+        }
+        if (marker == 0xd9) { // EOI
+            return i + 2;
+        }
+        if (marker == 0x01 || (0xd0 <= marker && marker <= 0xd7)) { // no length
+            i += 2;
+            continue;
+        }
+        if (i + 3 >= length) {
+            return 0;
+        }
+        i += 2 + ((p[i+2] << 8) | p[i+3]);
+        if (marker == 0xda) { // skip entropy-coded data up to the next marker
+            while (i + 1 < length && (p[i] != 0xff || p[i+1] == 0 || p[i+1] == 0xff ||
+                                      (0xd0 <= p[i+1] && p[i+1] <= 0xd7))) {
+                i++;
+            }
+        }
+    }
+    return 0;
+}
+
+int ReplaySource::load_directory() {
+    DIR *pDir = opendir(path.c_str());
+    if (pDir == NULL) {
+        LOGERROR2("ReplaySource::load_directory(%s) opendir [ERRNO:%d]", path.c_str(), errno);
+        return errno;
+    }
+    vector<string> names;
+    struct dirent *pEntry;
+    while ((pEntry = readdir(pDir)) != NULL) {
+        const char *pDot = strrchr(pEntry->d_name, '.');
+        if (pDot && (strcasecmp(pDot, ".jpg") == 0 || strcasecmp(pDot, ".jpeg") == 0)) {
+            names.push_back(pEntry->d_name);
+        }
+    }
+    closedir(pDir);
+    std::sort(names.begin(), names.end());
+    for (int i = 0; i < names.size(); i++) {
+        frames.push_back(loadFile((path + "/" + names[i]).c_str()));
+    }
+    return 0;
+}
+
+int ReplaySource::load_frame_log() {
+    SmartPointer<char> log = loadFile(path.c_str());
+    const char *pData = log.data();
+    size_t length = log.size();
+    size_t offset = 0;
+    while (offset < length) {
+        size_t bytes = jpeg_length(pData + offset, length - offset);
+        if (bytes) {
+            frames.push_back(SmartPointer<char>((char *) pData + offset, bytes));
+            offset += bytes;
+        } else { // resynchronize on the next SOI
+            const char *pSOI = (const char *) memmem(pData + offset + 1, length - offset - 1, "\xff\xd8", 2);
+            if (pSOI == NULL) {
+                break;
+            }
+            LOGWARN2("ReplaySource::load_frame_log(%s) skipping %ldB", path.c_str(), (long) (pSOI - pData - offset));
+            offset = pSOI - pData;
+        }
+    }
+    return 0;
+}
+
+int ReplaySource::start(int width, int height) {
+    struct stat pathStat;
+    if (stat(path.c_str(), &pathStat)) {
+        LOGERROR2("ReplaySource::start(%s) stat [ERRNO:%d]", path.c_str(), errno);
+        return errno;
+    }
+    frames.clear();
+    int rc = S_ISDIR(pathStat.st_mode) ? load_directory() : load_frame_log();
+    if (rc == 0 && frames.empty()) {
+        LOGERROR1("ReplaySource::start(%s) no JPEG frames", path.c_str());
+        rc = ENOENT;
+    }
+    if (rc) {
+        return rc;
+    }
+    running = TRUE;
+    LOGRC(rc, "pthread_create(ReplaySource::replay_thread) -> ", pthread_create(&tidReplay, NULL, &replay_thread, this));
+    if (rc) {
+        running = FALSE;
+        return rc;
+    }
+    LOGINFO3("ReplaySource::start(%s) frames:%d period:%dms", path.c_str(), (int) frames.size(), msPeriod);
+    return 0;
+}
+
+void ReplaySource::stop() {
+    pthread_mutex_lock(&replayMutex);
+    /////////////// CRITICAL SECTION BEGIN ///////////////
+    bool wasRunning = running;
+    running = FALSE;
+    pthread_cond_broadcast(&replayCond);
+    /////////////// CRITICAL SECTION END /////////////////
+    pthread_mutex_unlock(&replayMutex);
+    if (wasRunning) {
+        pthread_join(tidReplay, NULL);
+        LOGINFO2("ReplaySource::stop(%s) posted:%ld", path.c_str(), framesPosted.load());
+    }
+}
+
+void ReplaySource::request() {
+    pthread_mutex_lock(&replayMutex);
+    /////////////// CRITICAL SECTION BEGIN ///////////////
+    requested = TRUE;
+    pthread_cond_broadcast(&replayCond);
+    /////////////// CRITICAL SECTION END /////////////////
+    pthread_mutex_unlock(&replayMutex);
+}
+
+void * ReplaySource::replay_thread(void *arg) {
+    ReplaySource *pSource = (ReplaySource *) arg;
+    struct timespec tick; // when the next frame is due
+    clock_gettime(CLOCK_REALTIME, &tick);
+    for (;;) {
+        pthread_mutex_lock(&pSource->replayMutex);
+        /////////////// CRITICAL SECTION BEGIN ///////////////
+        int rc = 0;
+        while (pSource->running && rc != ETIMEDOUT && (pSource->msPeriod || !pSource->requested)) {
+            rc = pSource->msPeriod ?
+                 pthread_cond_timedwait(&pSource->replayCond, &pSource->replayMutex, &tick) :
+                 pthread_cond_wait(&pSource->replayCond, &pSource->replayMutex);
+        }
+        bool running = pSource->running;
+        pSource->requested = FALSE;
+        /////////////// CRITICAL SECTION END /////////////////
+        pthread_mutex_unlock(&pSource->replayMutex);
+        if (!running) {
+            break;
+        }
+
+        pSource->pCamera->accept_new_image(pSource->frames[pSource->iFrame]);
+        pSource->pCamera->endCapture();
+        pSource->iFrame = (pSource->iFrame + 1) % pSource->frames.size();
+        pSource->framesPosted++;
+
+        if (pSource->msPeriod) {
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            tick.tv_nsec += (pSource->msPeriod % 1000) * 1000000L;
+            tick.tv_sec += pSource->msPeriod / 1000 + tick.tv_nsec / 1000000000L;
+            tick.tv_nsec %= 1000000000L;
+            if (tick.tv_sec < now.tv_sec || (tick.tv_sec == now.tv_sec && tick.tv_nsec < now.tv_nsec)) {
+                tick = now; // fell behind: do not post a burst to catch up
+            }
+        }
+    }
+    return NULL;
+}
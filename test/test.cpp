@@ -9,6 +9,12 @@
 #include <fstream>
 #include <sstream>
 #include <unistd.h>
+#include <pty.h>
+#include <termios.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include "firefuse.h"
 #include "version.h"
 #include <assert.h>
@@ -113,9 +119,9 @@ bool testFile(const char * title, const char * path, SmartPointer<char> &content
     assert(rc == 0);
     assert(file_stat.st_uid == getuid());
     assert(file_stat.st_gid == getgid());
-    assert(file_stat.st_atime == file_stat.st_mtime);
-    assert(file_stat.st_atime == file_stat.st_ctime);
-    assert(file_stat.st_atime);
+    assert(file_stat.st_atime >= file_stat.st_mtime);
+    assert(file_stat.st_mtime == file_stat.st_ctime);
+    assert(file_stat.st_mtime);
     assert(file_stat.st_nlink == 1);
     assert(file_stat.st_mode==(S_IFREG|0666) || !pWriteData && file_stat.st_mode==(S_IFREG|0444));
     memset(&file_info, 0, sizeof(fuse_file_info));
@@ -323,6 +329,92 @@ int testSmartPointer_CopyData( ) {
     return 0;
 }
 
+#define SHARE_THREADS 8
+#define SHARE_COPIES 100000
+
+static void * smartpointer_share_thread(void *arg) {
+    SmartPointer<char> *pShared = (SmartPointer<char> *) arg;
+    for (int i = 0; i < SHARE_COPIES; i++) {
+        SmartPointer<char> copy(*pShared);
+        SmartPointer<char> moved(std::move(copy));
+        assert(!copy.data());
+        assert(moved.data() == pShared->data());
+    }
+    return NULL;
+}
+
+int testSmartPointer_Threads( ) {
+    cout << "testSmartPointer_Threads() ------------------------" << endl;
+    SmartPointer<char> shared(NULL, 100);
+    assert(1 == shared.getReferences());
+
+    SmartPointer<char> moved(std::move(shared));
+    assert(NULL == shared.data());
+    assert(0 == shared.getReferences());
+    assert(1 == moved.getReferences());
+    shared = std::move(moved);
+    assert(NULL == moved.data());
+    assert(1 == shared.getReferences());
+
+    pthread_t tids[SHARE_THREADS];
+    for (int i = 0; i < SHARE_THREADS; i++) {
+        assert(0 == pthread_create(&tids[i], NULL, &smartpointer_share_thread, &shared));
+    }
+    for (int i = 0; i < SHARE_THREADS; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    assert(testNumber(1, shared.getReferences()));
+
+    cout << "testSmartPointer_Threads() PASSED" << endl;
+    cout << endl;
+
+    return 0;
+}
+
+int testBufferPool() {
+    cout << "testBufferPool() ------------------------" << endl;
+    BufferPool &pool = BufferPool::instance();
+    long hits = pool.getHits();
+    long misses = pool.getMisses();
+
+    char *pBlock;
+    {
+        SmartPointer<char> image(NULL, 3000000, SmartPointer<char>::POOL);
+        assert(3000000 == image.size());
+        assert(3000000 == image.allocated_size());
+        pBlock = image.data();
+        memset(pBlock, 'x', image.size());
+    }
+    {
+        SmartPointer<char> image(NULL, 2500000, SmartPointer<char>::POOL);
+        assert(pBlock == image.data()); // same size class is recycled
+        assert(hits+1 <= pool.getHits());
+        SmartPointer<char> copy(image);
+        char abc[] = {'a','b','c'};
+        SmartPointer<char> small(abc, sizeof(abc), SmartPointer<char>::POOL);
+        assert(0 == memcmp(abc, small.data(), sizeof(abc)));
+        assert(pBlock != small.data());
+    }
+    assert(misses < pool.getMisses());
+
+    void *pBig = pool.allocate(64*1024*1024); // beyond largest size class
+    assert(NULL != pBig);
+    pool.release(pBig, 64*1024*1024);
+
+    const char *caughtExStr = NULL;
+    try {
+        SmartPointer<char> huge(NULL, SIZE_MAX/2, SmartPointer<char>::POOL); // malloc fails
+    } catch (const char * ex) {
+        caughtExStr = ex;
+    }
+    ASSERTEQUALS("BufferPool::allocate() out of memory", caughtExStr);
+
+    cout << "testBufferPool() PASSED" << endl;
+    cout << endl;
+
+    return 0;
+}
+
 typedef SmartPointer<char> CharPtr;
 
 LIFOCache<int> bgCache;
@@ -489,6 +581,185 @@ int testLIFOCache() {
     return 0;
 }
 
+#define CONTENTION_READERS 8
+#define CONTENTION_MS 500
+
+template <class C> struct ContentionBench {
+    C cache;
+    std::atomic<int> running;
+    long readerOps[CONTENTION_READERS];
+    int readerIndex;
+    pthread_mutex_t indexMutex;
+};
+
+template <class C> static void * contention_reader(void *arg) {
+    ContentionBench<C> *pBench = (ContentionBench<C> *) arg;
+    pthread_mutex_lock(&pBench->indexMutex);
+    int index = pBench->readerIndex++;
+    pthread_mutex_unlock(&pBench->indexMutex);
+    long ops = 0;
+    size_t bytes = 0;
+    while (pBench->running) {
+        bytes += pBench->cache.peek().size(); // stat
+        bytes += pBench->cache.get().size(); // open/read
+        ops += 2;
+    }
+    pBench->readerOps[index] = bytes ? ops : 0;
+    return NULL;
+}
+
+template <class C> static long contention_benchmark(const char *name) {
+    ContentionBench<C> *pBench = new ContentionBench<C>();
+    pBench->running = TRUE;
+    pBench->readerIndex = 0;
+    pthread_mutex_init(&pBench->indexMutex, NULL);
+    pBench->cache.post(SmartPointer<char>(NULL, 100000));
+
+    pthread_t tids[CONTENTION_READERS];
+    for (int i = 0; i < CONTENTION_READERS; i++) {
+        pBench->readerOps[i] = 0;
+        assert(0 == pthread_create(&tids[i], NULL, &contention_reader<C>, pBench));
+    }
+    long posts = 0;
+    long msEnd = millis() + CONTENTION_MS;
+    while (millis() < msEnd) {
+        pBench->cache.post(SmartPointer<char>(NULL, 100000)); // simulate camera at 1000fps
+        posts++;
+        usleep(1000);
+    }
+    pBench->running = FALSE;
+    long ops = 0;
+    for (int i = 0; i < CONTENTION_READERS; i++) {
+        pthread_join(tids[i], NULL);
+        ops += pBench->readerOps[i];
+    }
+    pthread_mutex_destroy(&pBench->indexMutex);
+    delete pBench;
+
+    long opsPerSec = (ops * 1000) / CONTENTION_MS;
+    cout << "testLockFreeLIFOCache() " << name << " readers:" << CONTENTION_READERS
+         << " posts:" << posts << " stat+read/s:" << opsPerSec << endl;
+    return opsPerSec;
+}
+
+static void * get_sync_thread(void *pCache) {
+    ((LockFreeLIFOCache<SmartPointer<char> > *) pCache)->get_sync(2000);
+    return NULL;
+}
+
+int testLockFreeLIFOCache() {
+    cout << "testLockFreeLIFOCache() ------------------------" << endl;
+    {
+        LockFreeLIFOCache<MockValue<int> > bufInt;
+        assert(!bufInt.isFresh());
+        bufInt.post(MockValue<int>(1));
+        assert(bufInt.isFresh());
+        assert(1 == bufInt.peek().getValue());
+        assert(bufInt.isFresh());
+        assert(1 == bufInt.get().getValue());
+        assert(!bufInt.isFresh());
+        assert(1 == bufInt.get().getValue());
+        assert(1 == bufInt.peek().getValue());
+        bufInt.post(MockValue<int>(2));
+        bufInt.post(MockValue<int>(3));
+        assert(bufInt.isFresh());
+        assert(3 == bufInt.get().getValue());
+        assert(!bufInt.isFresh());
+        assert(testNumber(3l, bufInt.getWriteCount()));
+        assert(testNumber(3l, bufInt.getReadCount()));
+
+        char *one = (char *) malloc(123456);
+        strcpy(one, "one");
+        char *two = (char *) malloc(123456);
+        strcpy(two, "two");
+        {
+            CharPtr spOne(one);
+            CharPtr spTwo(two);
+            LockFreeLIFOCache<CharPtr> bufCharPtr;
+            assert(NULL == (char *)bufCharPtr.peek());
+            assert(NULL == (char *)bufCharPtr.get());
+            bufCharPtr.post(spOne);
+            assert(2 == spOne.getReferences());
+            assert(one == (char *)bufCharPtr.get());
+            bufCharPtr.post(spTwo);
+            assert(1 == spOne.getReferences()); // stale values are released by post()
+            assert(2 == spTwo.getReferences());
+            assert(two == (char *)bufCharPtr.peek());
+            assert(bufCharPtr.isFresh());
+            assert(two == (char *)bufCharPtr.get());
+            assert(!bufCharPtr.isFresh());
+        }
+    }
+
+    {   // post() wakes every get_sync() caller
+        LockFreeLIFOCache<SmartPointer<char> > cache;
+        pthread_t tids[3];
+        for (int i = 0; i < 3; i++) {
+            assert(0 == pthread_create(&tids[i], NULL, get_sync_thread, &cache));
+        }
+        usleep(50*1000);
+        long msStart = millis();
+        cache.post(SmartPointer<char>((char *) "hi", 2));
+        for (int i = 0; i < 3; i++) {
+            pthread_join(tids[i], NULL);
+        }
+        long msWake = millis() - msStart;
+        cout << "testLockFreeLIFOCache() get_sync wake:" << msWake << "ms" << endl;
+        assert(msWake < 500);
+    }
+
+    long mutexOps = contention_benchmark<LIFOCache<SmartPointer<char> > >("LIFOCache");
+    long lockFreeOps = contention_benchmark<LockFreeLIFOCache<SmartPointer<char> > >("LockFreeLIFOCache");
+    assert(mutexOps > 0);
+    assert(lockFreeOps > 0);
+
+    cout << "testLockFreeLIFOCache() PASS" << endl;
+    cout << endl;
+
+    return 0;
+}
+
+static void * cache_event_poster(void *arg) {
+    LockFreeLIFOCache<int> *pCache = (LockFreeLIFOCache<int> *) arg;
+    usleep(50*1000);
+    pCache->post(2);
+    return NULL;
+}
+
+int testCacheEvent() {
+    cout << "testCacheEvent() ------------------------" << endl;
+    CacheEvent event;
+    LockFreeLIFOCache<int> cache;
+    cache.setEvent(&event);
+
+    long count = event.getCount();
+    assert(FALSE == event.wait(count, 10)); // timeout
+    cache.post(1);
+    assert(TRUE == event.wait(count, 1000));
+    count = event.getCount();
+    assert(1 == cache.peek());
+    assert(count == event.getCount()); // peek does not consume
+    assert(1 == cache.get());
+    assert(count+1 == event.getCount()); // get of fresh value
+    assert(1 == cache.get());
+    assert(count+1 == event.getCount()); // get of stale value
+
+    count = event.getCount();
+    pthread_t tid;
+    assert(0 == pthread_create(&tid, NULL, &cache_event_poster, &cache));
+    long msStart = millis();
+    assert(TRUE == event.wait(count, 5000));
+    long msElapsed = millis() - msStart;
+    assert(msElapsed < 1000);
+    assert(2 == cache.peek());
+    assert(0 == pthread_join(tid, NULL));
+
+    cout << "testCacheEvent() PASSED" << endl;
+    cout << endl;
+
+    return 0;
+}
+
 static void assert_headcam(SmartPointer<char> jpg, int headcam) {
     char message[100];
     snprintf(message, sizeof(message), "jpg.data()[1520] %0x", jpg.data()[1520]);
@@ -518,46 +789,44 @@ int testCamera() {
     cout << "testCamera() --------------------------" << endl;
     SmartPointer<char> jpg;
     worker.processInit();
-    assert(!worker.cameras[0].src_camera_jpg.isFresh());
-    assert(!worker.cameras[0].src_camera_mat_gray.isFresh());
-    assert(!worker.cameras[0].src_camera_mat_bgr.isFresh());
-    assert(!worker.cameras[0].src_monitor_jpg.isFresh());
-    assert(!worker.cameras[0].src_output_jpg.isFresh());
+    assert(!worker.camera("/cv/1").src_camera_jpg.isFresh());
+    assert(!worker.camera("/cv/1").src_monitor_jpg.isFresh());
+    assert(!worker.camera("/cv/1").src_output_jpg.isFresh());
+    long framesDecoded = worker.camera("/cv/1").get_frames_decoded();
+    long framesSkipped = worker.camera("/cv/1").get_frames_skipped();
 
     // simulate raspistill
     SmartPointer<char> image0 = loadFile("test/headcam0.jpg");
-    assert(testNumber(00006l, (long)worker.cameras[0].accept_new_image(image0)));
+    assert(testNumber(0l, (long)worker.camera("/cv/1").accept_new_image(image0)));
 
     assert(testProcess(02000));
-    assert(!worker.cameras[0].src_camera_jpg.isFresh());
-    assert(worker.cameras[0].src_camera_mat_gray.isFresh());
-    assert(worker.cameras[0].src_camera_mat_bgr.isFresh());
-    assert(worker.cameras[0].src_monitor_jpg.isFresh());
-    assert(!worker.cameras[0].src_output_jpg.isFresh());
-    jpg = worker.cameras[0].src_camera_jpg.peek();
+    assert(!worker.camera("/cv/1").src_camera_jpg.isFresh());
+    assert(testNumber(framesDecoded, worker.camera("/cv/1").get_frames_decoded())); // nothing asked for a Mat
+    assert(worker.camera("/cv/1").src_monitor_jpg.isFresh());
+    assert(!worker.camera("/cv/1").src_output_jpg.isFresh());
+    jpg = worker.camera("/cv/1").src_camera_jpg.peek();
     assert_headcam(jpg, 0);
 
     assert(testProcess(01));
 
     // simulate raspistill
     SmartPointer<char> image1 = loadFile("test/headcam1.jpg");
-    assert(testNumber(00006l, (long)worker.cameras[0].accept_new_image(image1)));
-
-    assert(worker.cameras[0].src_camera_jpg.isFresh());
-    assert(worker.cameras[0].src_camera_mat_gray.isFresh());
-    assert(worker.cameras[0].src_camera_mat_bgr.isFresh());
-    assert(worker.cameras[0].src_monitor_jpg.isFresh());
-    assert(!worker.cameras[0].src_output_jpg.isFresh());
-    jpg = worker.cameras[0].src_camera_jpg.peek();
+    assert(testNumber(0l, (long)worker.camera("/cv/1").accept_new_image(image1)));
+    assert(testNumber(framesSkipped+1, worker.camera("/cv/1").get_frames_skipped())); // image0 was never decoded
+
+    assert(worker.camera("/cv/1").src_camera_jpg.isFresh());
+    assert(testNumber(framesDecoded, worker.camera("/cv/1").get_frames_decoded())); // nothing asked for a Mat
+    assert(worker.camera("/cv/1").src_monitor_jpg.isFresh());
+    assert(!worker.camera("/cv/1").src_output_jpg.isFresh());
+    jpg = worker.camera("/cv/1").src_camera_jpg.peek();
     assert_headcam(jpg, 1);
 
     assert(testProcess(0));
-    assert(worker.cameras[0].src_camera_jpg.isFresh());
-    assert(worker.cameras[0].src_camera_mat_gray.isFresh());
-    assert(worker.cameras[0].src_camera_mat_bgr.isFresh());
-    assert(worker.cameras[0].src_monitor_jpg.isFresh());
-    assert(!worker.cameras[0].src_output_jpg.isFresh());
-    jpg = worker.cameras[0].src_camera_jpg.peek();
+    assert(worker.camera("/cv/1").src_camera_jpg.isFresh());
+    assert(testNumber(framesDecoded, worker.camera("/cv/1").get_frames_decoded())); // nothing asked for a Mat
+    assert(worker.camera("/cv/1").src_monitor_jpg.isFresh());
+    assert(!worker.camera("/cv/1").src_output_jpg.isFresh());
+    jpg = worker.camera("/cv/1").src_camera_jpg.peek();
     assert_headcam(jpg, 1);
 
     worker.setIdlePeriod(0.1d);
@@ -565,52 +834,58 @@ int testCamera() {
     assert(0.1d == worker.getIdlePeriod());
     usleep(100000);
     assert(testProcess(04000));
-    assert(worker.cameras[0].src_camera_jpg.isFresh());
-    assert(worker.cameras[0].src_camera_mat_gray.isFresh());
-    assert(worker.cameras[0].src_camera_mat_bgr.isFresh());
-    assert(!worker.cameras[0].src_monitor_jpg.isFresh());  // consumed by idle()
-    assert(!worker.cameras[0].src_output_jpg.isFresh());
-    jpg = worker.cameras[0].src_camera_jpg.peek();
+    assert(worker.camera("/cv/1").src_camera_jpg.isFresh());
+    assert(testNumber(framesDecoded, worker.camera("/cv/1").get_frames_decoded())); // nothing asked for a Mat
+    assert(!worker.camera("/cv/1").src_monitor_jpg.isFresh());  // consumed by idle()
+    assert(!worker.camera("/cv/1").src_output_jpg.isFresh());
+    jpg = worker.camera("/cv/1").src_camera_jpg.peek();
     assert_headcam(jpg, 1);
     worker.setIdlePeriod(0);
 
     assert(testProcess(02000));
-    assert(!worker.cameras[0].src_camera_jpg.isFresh());
-    assert(worker.cameras[0].src_camera_mat_gray.isFresh());
-    assert(worker.cameras[0].src_camera_mat_bgr.isFresh());
-    assert(worker.cameras[0].src_monitor_jpg.isFresh());
-    assert(!worker.cameras[0].src_output_jpg.isFresh());
-    jpg = worker.cameras[0].src_camera_jpg.peek();
+    assert(!worker.camera("/cv/1").src_camera_jpg.isFresh());
+    assert(testNumber(framesDecoded, worker.camera("/cv/1").get_frames_decoded())); // nothing asked for a Mat
+    assert(worker.camera("/cv/1").src_monitor_jpg.isFresh());
+    assert(!worker.camera("/cv/1").src_output_jpg.isFresh());
+    jpg = worker.camera("/cv/1").src_camera_jpg.peek();
     assert_headcam(jpg, 1);
 
     // simulate raspistill
-    assert(testNumber(00006l, (long)worker.cameras[0].accept_new_image(image0)));
+    assert(testNumber(0l, (long)worker.camera("/cv/1").accept_new_image(image0)));
+    assert(testNumber(framesSkipped+2, worker.camera("/cv/1").get_frames_skipped())); // image1 was never decoded
 
     assert(testProcess(00));
-    assert(worker.cameras[0].src_camera_jpg.isFresh());
-    assert(worker.cameras[0].src_camera_mat_gray.isFresh());
-    assert(worker.cameras[0].src_camera_mat_bgr.isFresh());
-    assert(worker.cameras[0].src_monitor_jpg.isFresh());
-    assert(!worker.cameras[0].src_output_jpg.isFresh());
-    jpg = worker.cameras[0].src_camera_jpg.peek();
+    assert(worker.camera("/cv/1").src_camera_jpg.isFresh());
+    assert(testNumber(framesDecoded, worker.camera("/cv/1").get_frames_decoded())); // nothing asked for a Mat
+    assert(worker.camera("/cv/1").src_monitor_jpg.isFresh());
+    assert(!worker.camera("/cv/1").src_output_jpg.isFresh());
+    jpg = worker.camera("/cv/1").src_camera_jpg.peek();
     assert_headcam(jpg, 0);
 
-    Mat grayImage = worker.cameras[0].src_camera_mat_gray.get();
+    assert(testNumber(framesDecoded, worker.camera("/cv/1").get_frames_decoded()));
+    Mat grayImage = worker.camera("/cv/1").get_mat_gray();
     cout << "grayImage: " << grayImage.rows << "x" << grayImage.cols << endl;
     assert(200 == grayImage.rows);
     assert(800 == grayImage.cols);
+    assert(testNumber(framesDecoded+1, worker.camera("/cv/1").get_frames_decoded()));
+    Mat grayImage2 = worker.camera("/cv/1").get_mat_gray();
+    assert(grayImage2.data == grayImage.data); // memoized for current frame
+    assert(testNumber(framesDecoded+1, worker.camera("/cv/1").get_frames_decoded()));
 
     // simulate raspistill
-    assert(testNumber(00004l, (long)worker.cameras[0].accept_new_image(image1)));
+    assert(testNumber(0l, (long)worker.camera("/cv/1").accept_new_image(image1)));
+    assert(testNumber(framesSkipped+2, worker.camera("/cv/1").get_frames_skipped())); // image0 was decoded
 
     assert(testProcess(00));
-    assert(worker.cameras[0].src_camera_jpg.isFresh());
-    assert(worker.cameras[0].src_camera_mat_gray.isFresh());
-    assert(worker.cameras[0].src_camera_mat_bgr.isFresh()); // fresh but older than camera_jpg
-    assert(worker.cameras[0].src_monitor_jpg.isFresh());
-    assert(!worker.cameras[0].src_output_jpg.isFresh());
-    jpg = worker.cameras[0].src_camera_jpg.peek();
+    assert(worker.camera("/cv/1").src_camera_jpg.isFresh());
+    assert(testNumber(framesDecoded+1, worker.camera("/cv/1").get_frames_decoded())); // image1 not decoded yet
+    assert(worker.camera("/cv/1").src_monitor_jpg.isFresh());
+    assert(!worker.camera("/cv/1").src_output_jpg.isFresh());
+    jpg = worker.camera("/cv/1").src_camera_jpg.peek();
     assert_headcam(jpg, 1);
+    Mat bgrImage = worker.camera("/cv/1").get_mat_bgr(); // first access decodes image1
+    ASSERTEQUAL(3, bgrImage.channels());
+    assert(testNumber(framesDecoded+2, worker.camera("/cv/1").get_frames_decoded()));
 
     cout << "testCamera() PASS" << endl;
     cout << endl;
@@ -655,10 +930,14 @@ int testConfig() {
     assert(testString("TEST testConfig()", "mock", worker.dce("/cnc/tinyg").getSerialPath().c_str()));
     SmartPointer<char> one_json(worker.cve("/cv/1/gray/cve/one").src_firesight_json.get());
     assert(testString("firesight.json GET","[{\"op\":\"putText\",\"text\":\"one\"}]", one_json));
-    assert(200 == cameraWidth);
-    assert(800 == cameraHeight);
-    assert(testString("config.json cameraSourceName", "raspistill", cameraSourceName.c_str()));
-    assert(testString("config.json cameraSourceConfig", "", cameraSourceConfig.c_str()));
+    CameraNode &camera = worker.camera("/sync/cv/1/gray/cve/one");
+    assert(&worker.camera("/cv/1") == &camera);
+    assert(&worker.cve("/cv/1/gray/cve/one").getCamera() == &camera);
+    assert(testString("camera name", "/cv/1", camera.getName().c_str()));
+    assert(200 == camera.getWidth());
+    assert(800 == camera.getHeight());
+    assert(testString("config.json camera source name", "raspistill", camera.getSourceName().c_str()));
+    assert(testString("config.json camera source config", "", camera.getSourceConfig().c_str()));
 
     //////////////// properties test
     const char * twoPath = "/cv/1/bgr/cve/two/properties.json";
@@ -694,6 +973,29 @@ int testConfig() {
     assert(firerest.isFile("/cnc/tinyg/gcode.fire"));
     assert(!firerest.isDirectory("/cnc/tinyg/gcode.fire"));
 
+    //////////////// resolved nodes
+    const FireNode *pNode = firerest.node("/sync/cv/1/gray/cve/one/save.fire");
+    assert(NULL != pNode);
+    assert(FIRENODE_SAVE_FIRE == pNode->kind);
+    assert(pNode->sync && !pNode->cnc);
+    assert(&worker.cve("/cv/1/gray/cve/one") == pNode->pCve);
+    assert(&worker.camera("/cv/1") == pNode->pCamera);
+    pNode = firerest.node("/cv/1/camera.jpg~");
+    assert(NULL != pNode);
+    assert(FIRENODE_CAMERA_JPG_TILDE == pNode->kind);
+    assert(!pNode->sync && NULL == pNode->pCve);
+    pNode = firerest.node("/cv/1/bgr/cve/one");
+    assert(NULL != pNode);
+    assert(FIRENODE_DIRECTORY == pNode->kind);
+    pNode = firerest.node("/cnc/tinyg/gcode.fire");
+    assert(NULL != pNode);
+    assert(FIRENODE_GCODE_FIRE == pNode->kind);
+    assert(pNode->cnc);
+    assert(&worker.dce("/cnc/tinyg") == pNode->pDce);
+    assert(NULL == firerest.node("/cv/1/gray/cve/one/nothing.json"));
+    assert(NULL == firerest.node("/sync"));
+    assert(NULL == firerest.node(STATUS_PATH));
+
     cout << "testConfig() PASS" << endl;
     cout << endl;
     return 0;
@@ -723,6 +1025,162 @@ int testSerial() {
     return 0;
 } // testSerial()
 
+/**
+ * Open a raw pty and connect dce to its slave with "ok" acks.
+ * The pty master stands in for TinyG/Marlin. serial_init() leaves VMIN=0
+ * for the shipped "stty" configurations, so a drained read() returns 0.
+ */
+static void open_pty_dce(DCE &dce, int *pMaster, int *pSlave, int vmin=1) {
+    char slavePath[64];
+    assert(0 == openpty(pMaster, pSlave, slavePath, NULL, NULL));
+    struct termios tio;
+    assert(0 == tcgetattr(*pSlave, &tio));
+    cfmakeraw(&tio);
+    tio.c_cc[VMIN] = vmin;
+    tio.c_cc[VTIME] = 0;
+    assert(0 == tcsetattr(*pSlave, TCSANOW, &tio));
+    dce.setSerialPath(slavePath);
+    dce.set_serial_ack("ok");
+    assert(0 == dce.serial_init());
+}
+
+static void close_pty_dce(DCE &dce, int master, int slave) {
+    dce.serial_shutdown();
+    close(master);
+    close(slave);
+}
+
+int testSerialPty() {
+    cout << "testSerialPty() --------------------------" << endl;
+    DCE dce("/cnc/pty");
+    int master;
+    int slave;
+    open_pty_dce(dce, &master, &slave);
+
+    // idle reader must block instead of spinning, which would use about 1s of CPU
+    long usStart = dce.reader_cpu_micros();
+    assert(usStart >= 0);
+    usleep(1000*1000);
+    long usIdle = dce.reader_cpu_micros() - usStart;
+    cout << "testSerialPty() idle reader cpu:" << usIdle << "us" << endl;
+    assert(usIdle < 100000);
+
+    // the reader wakes on the ack
+    long count = dce.src_gcode_fire.getWriteCount();
+    long msStart = millis();
+    assert(3 == write(master, "ok\n", 3));
+    while (dce.src_gcode_fire.getWriteCount() == count && millis() - msStart < 5000) {
+        usleep(1000);
+    }
+    long msLatency = millis() - msStart;
+    cout << "testSerialPty() ack latency:" << msLatency << "ms" << endl;
+    ASSERTEQUAL(count+1, dce.src_gcode_fire.getWriteCount());
+    ASSERTEQUAL(1, dce.getAcks());
+    assert(testString("testSerialPty() ack", "{\"status\":\"ACK\",\"response\":\"ok\"}", dce.src_gcode_fire.peek()));
+    assert(msLatency < 1000);
+    close_pty_dce(dce, master, slave);
+
+    // a drained VMIN=0 port is not a hangup, even after a response of whole read buffers
+    open_pty_dce(dce, &master, &slave, 0);
+    string response(199, 'r'); // 200 bytes with newline
+    response += "\n";
+    count = dce.src_gcode_fire.getWriteCount();
+    assert(response.size() == write(master, response.c_str(), response.size()));
+    msStart = millis();
+    while (dce.src_gcode_fire.getWriteCount() == count && millis() - msStart < 5000) {
+        usleep(1000);
+    }
+    ASSERTEQUAL(count+1, dce.src_gcode_fire.getWriteCount());
+    assert(3 == write(master, "ok\n", 3));
+    msStart = millis();
+    while (dce.src_gcode_fire.getWriteCount() == count+1 && millis() - msStart < 5000) {
+        usleep(1000);
+    }
+    assert(testString("testSerialPty() ack after long response", "{\"status\":\"ACK\",\"response\":\"ok\"}",
+                      dce.src_gcode_fire.peek()));
+
+    // shutdown wakes the blocked reader instead of waiting for a read timeout
+    msStart = millis();
+    close_pty_dce(dce, master, slave);
+    assert(millis() - msStart < 1000);
+
+    cout << "testSerialPty() PASS" << endl;
+    cout << endl;
+    return 0;
+}
+
+static int read_lines(int fd, int msTimeout) {
+    int lines = 0;
+    struct pollfd pfd = {fd, POLLIN, 0};
+    while (poll(&pfd, 1, msTimeout) > 0) {
+        char buf[256];
+        int n = read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+        lines += count(buf, buf+n, '\r');
+    }
+    return lines;
+}
+
+static void * gcode_thread(void *pDce) {
+    ((DCE *)pDce)->gcode(NULL);
+    return NULL;
+}
+
+static void * sync_thread(void *pDce) {
+    const char *gcode = "G0X0\n";
+    SmartPointer<char> request((char *)gcode, strlen(gcode));
+    ((DCE *)pDce)->send_request(request, TRUE);
+    return NULL;
+}
+
+int testSerialWindow() {
+    cout << "testSerialWindow() --------------------------" << endl;
+    DCE dce("/cnc/pty");
+    dce.set_serial_window(2);
+    int master;
+    int slave;
+    open_pty_dce(dce, &master, &slave);
+
+    // only serial_window lines may be unacknowledged
+    const char *gcode = "G0X1\nG0X2\nG0X3\nG0X4\n";
+    dce.snk_gcode_fire.post(SmartPointer<char>((char *)gcode, strlen(gcode)));
+    pthread_t tidGcode;
+    assert(0 == pthread_create(&tidGcode, NULL, gcode_thread, &dce));
+    ASSERTEQUAL(2, read_lines(master, 100));
+    assert(3 == write(master, "ok\n", 3));
+    ASSERTEQUAL(1, read_lines(master, 100));
+    assert(6 == write(master, "ok\nok\n", 6));
+    ASSERTEQUAL(1, read_lines(master, 100));
+    assert(6 == write(master, "ok\nok\n", 6));
+    pthread_join(tidGcode, NULL);
+
+    // sync writers wake on the final ack
+    dce.setSync(TRUE);
+    pthread_t tidSync;
+    assert(0 == pthread_create(&tidSync, NULL, sync_thread, &dce));
+    long msStart = millis();
+    while (!dce.snk_gcode_fire.isFresh() && millis() - msStart < 1000) {
+        usleep(1000);
+    }
+    dce.gcode(NULL);
+    ASSERTEQUAL(1, read_lines(master, 100));
+    long acks = dce.getAcks();
+    long msAck = millis();
+    assert(3 == write(master, "ok\n", 3));
+    pthread_join(tidSync, NULL);
+    long msWake = millis() - msAck;
+    cout << "testSerialWindow() sync wake:" << msWake << "ms" << endl;
+    ASSERTEQUAL(acks+1, dce.getAcks()); // woken by the ack...
+    assert(msWake < 500); // ...long before SERIAL_TIMEOUT_SECS
+
+    close_pty_dce(dce, master, slave);
+    cout << "testSerialWindow() PASS" << endl;
+    cout << endl;
+    return 0;
+}
+
 int testCve() {
     char buf[100];
     /////////// process.fire test
@@ -783,11 +1241,12 @@ int testCve() {
 
     /////////// save.fire test
     string savePath = "/cv/1/gray/cve/calc-offset/save.fire";
-    assert(worker.cameras[0].src_camera_mat_gray.isFresh());
-    assert(worker.cameras[0].src_camera_mat_bgr.isFresh());
+    // Only this gray CVE decodes camera frames, so gray is always decoded as luma by libjpeg
+    // and never converted from BGR with cvtColor, which keeps the exact sizes below stable.
+    assert(worker.camera("/cv/1").src_camera_jpg.peek().size() > 0); // decoded on demand by save.fire
     assert(worker.cve(savePath).src_save_fire.isFresh()); // {}
-    assert(!worker.cameras[0].src_output_jpg.isFresh());
-    assert(testNumber((size_t)0, worker.cameras[0].src_output_jpg.peek().size()));
+    assert(!worker.camera("/cv/1").src_output_jpg.isFresh());
+    assert(testNumber((size_t)0, worker.camera("/cv/1").src_output_jpg.peek().size()));
     assert(testString("save.fire BEFORE", "{}",worker.cve(savePath).src_save_fire.peek()));
     assert(testNumber((size_t) 0, worker.cve(savePath).src_saved_png.peek().size()));
     assert(worker.cve(savePath).src_save_fire.isFresh());
@@ -799,7 +1258,7 @@ int testCve() {
     /*ASYNC*/
     assert(testProcess(01020)); // monitor + save
     assert(worker.cve(savePath).src_save_fire.isFresh());
-    assert(testNumber((size_t) 43249, worker.cameras[0].src_monitor_jpg.peek().size()));
+    assert(testNumber((size_t) 43249, worker.camera("/cv/1").src_monitor_jpg.peek().size()));
     save_fire = worker.cve(savePath).src_save_fire.peek();
     size_t saveSize = worker.cve(savePath).src_saved_png.peek().size();
     assert(saveSize > 0);
@@ -808,33 +1267,38 @@ int testCve() {
     SmartPointer<char> save_fire_contents = worker.cve(savePath).src_save_fire.peek();
     assert(testString("save.fire BEFORE", "{\"bytes\":72944}", save_fire_contents));
     assert(worker.cve(savePath).src_save_fire.isFresh());
-    assert(worker.cameras[0].src_monitor_jpg.isFresh());
-    assert(testNumber((size_t)43249, worker.cameras[0].src_output_jpg.peek().size()));
-    assert(testNumber((size_t) 43249, worker.cameras[0].src_monitor_jpg.peek().size()));
+    assert(worker.camera("/cv/1").src_monitor_jpg.isFresh());
+    assert(testNumber((size_t)43249, worker.camera("/cv/1").src_output_jpg.peek().size()));
+    assert(testNumber((size_t) 43249, worker.camera("/cv/1").src_monitor_jpg.peek().size()));
 
     /*ASYNC*/
     assert(testProcess(00)); // camera + mat_gray
-    assert(testNumber((size_t) 43249, worker.cameras[0].src_monitor_jpg.peek().size()));
+    assert(testNumber((size_t) 43249, worker.camera("/cv/1").src_monitor_jpg.peek().size()));
 
     /////////// process.fire test
     string processPath = "/cv/1/gray/cve/calc-offset/process.fire";
     assert(testString("process.fire BEFORE", "{}",worker.cve(processPath).src_process_fire.peek()));
     assert(worker.cve(processPath).src_process_fire.isFresh());
-    assert(testNumber((size_t)43249, worker.cameras[0].src_output_jpg.peek().size()));
+    assert(testNumber((size_t)43249, worker.camera("/cv/1").src_output_jpg.peek().size()));
     /*GET*/
     SmartPointer<char> process_fire_json(worker.cve(processPath).src_process_fire.get());
-    assert(testNumber((size_t)43249, worker.cameras[0].src_output_jpg.peek().size()));
+    assert(testNumber((size_t)43249, worker.camera("/cv/1").src_output_jpg.peek().size()));
     assert(testString("process.fire GET", "{}",worker.cve(processPath).src_process_fire.peek()));
     assert(!worker.cve(processPath).src_process_fire.isFresh());
     /*ASYNC*/
     assert(testProcess(01010)); // monitor + process + camera + mat_gray
-    assert(testNumber((size_t) 43940, worker.cameras[0].src_output_jpg.peek().size()));
-    assert(testNumber((size_t) 43940, worker.cameras[0].src_monitor_jpg.peek().size()));
+    assert(testNumber((size_t) 43940, worker.camera("/cv/1").src_output_jpg.peek().size()));
+    assert(testNumber((size_t) 43940, worker.camera("/cv/1").src_monitor_jpg.peek().size()));
     /*ASYNC*/
     assert(testProcess(00)); // monitor + camera + mat_gray
-    assert(testNumber((size_t) 43940, worker.cameras[0].src_monitor_jpg.peek().size()));
+    assert(testNumber((size_t) 43940, worker.camera("/cv/1").src_monitor_jpg.peek().size()));
     assert(worker.cve(processPath).src_process_fire.isFresh());
     assert(testString("process.fire processLoop", "{\"s1\":{}}", worker.cve(processPath).src_process_fire.peek()));
+    assert(worker.cve(processPath).getExecSeconds() > 0);
+    assert(worker.cve(processPath).getQueueSeconds() >= 0);
+    assert(worker.cve(processPath).claim()); // idle CVE can be queued
+    assert(!worker.cve(processPath).claim()); // busy CVE cannot be queued twice
+    worker.cve(processPath).release();
 
     ///////////// saved.png test
     string savedPath = "/cv/1/gray/cve/calc-offset/saved.png";
@@ -1052,6 +1516,1052 @@ int testCnc() {
     }
 }
 
+#define FUSE_THREAD_READS 200
+
+static void * fuse_read_thread(void *pPath) {
+    const char *path = (const char *) pPath;
+    long errors = 0;
+    for (int i = 0; i < FUSE_THREAD_READS; i++) {
+        struct stat file_stat;
+        struct fuse_file_info file_info;
+        memset(&file_info, 0, sizeof(fuse_file_info));
+        file_info.flags = O_RDONLY;
+        char buf[256];
+        if (firefuse_getattr(path, &file_stat) || firefuse_open(path, &file_info)) {
+            errors++;
+            continue;
+        }
+        int rc = firefuse_read(path, buf, sizeof(buf)-1, 0, &file_info);
+        firefuse_release(path, &file_info);
+        if (rc <= 0) {
+            errors++;
+        } else if (strncmp(buf, "frame", 5) && strncmp(buf, "{", 1) && strncmp(buf, "echo", 4)) {
+            errors++;
+        }
+    }
+    return (void *) errors;
+}
+
+static void * fuse_echo_thread(void *arg) {
+    for (int i = 0; i < FUSE_THREAD_READS; i++) {
+        struct fuse_file_info file_info;
+        memset(&file_info, 0, sizeof(fuse_file_info));
+        file_info.flags = O_WRONLY;
+        char buf[32];
+        snprintf(buf, sizeof(buf), "echo%d", i);
+        firefuse_open(ECHO_PATH, &file_info);
+        firefuse_write(ECHO_PATH, buf, strlen(buf), 0, &file_info);
+        firefuse_release(ECHO_PATH, &file_info);
+    }
+    return NULL;
+}
+
+int testFuseThreads() {
+    cout << "testFuseThreads() --------------------------" << endl;
+    worker.clear();
+    worker.processInit();
+    char * configJson = firerest.configure_path("test/testconfig.json");
+    free(configJson);
+    CameraNode &camera = worker.camera("/cv/1");
+    camera.src_monitor_jpg.post(SmartPointer<char>((char *) "frame0", 6));
+    const char *echo = "echo";
+    struct fuse_file_info echo_info;
+    memset(&echo_info, 0, sizeof(fuse_file_info));
+    echo_info.flags = O_WRONLY;
+    firefuse_write(ECHO_PATH, echo, strlen(echo), 0, &echo_info);
+
+    // concurrent readers as with the default multithreaded libfuse loop
+    const char *paths[] = {
+        "/cv/1/monitor.jpg",
+        "/cv/1/gray/cve/one/properties.json",
+        ECHO_PATH,
+    };
+    int nPaths = sizeof(paths)/sizeof(paths[0]);
+    pthread_t tids[sizeof(paths)/sizeof(paths[0])];
+    for (int i = 0; i < nPaths; i++) {
+        assert(0 == pthread_create(&tids[i], NULL, fuse_read_thread, (void *) paths[i]));
+    }
+    pthread_t tidEcho;
+    assert(0 == pthread_create(&tidEcho, NULL, fuse_echo_thread, NULL));
+    for (int i = 1; i <= FUSE_THREAD_READS; i++) {
+        char frame[32];
+        snprintf(frame, sizeof(frame), "frame%d", i);
+        camera.src_monitor_jpg.post(SmartPointer<char>(frame, strlen(frame)));
+    }
+    pthread_join(tidEcho, NULL);
+    long errors = 0;
+    for (int i = 0; i < nPaths; i++) {
+        void *result;
+        pthread_join(tids[i], &result);
+        errors += (long) result;
+    }
+    ASSERTEQUAL(0, errors);
+
+    cout << "testFuseThreads() PASS" << endl;
+    cout << endl;
+    return 0;
+}
+
+int testInodes() {
+    cout << "testInodes() --------------------------" << endl;
+    FireInodes inodes;
+    string path;
+    ASSERTEQUAL(1, inodes.ino("/"));
+    unsigned long inoCv = inodes.ino("/cv");
+    unsigned long inoMonitor = inodes.ino("/cv/1/monitor.jpg");
+    ASSERT(inoCv > 1);
+    ASSERT(inoMonitor != inoCv);
+    ASSERTEQUAL(inoCv, inodes.ino("/cv"));
+    ASSERTEQUAL(inoMonitor, inodes.ino("/cv/1/monitor.jpg"));
+    ASSERT(inodes.path(inoMonitor, path));
+    ASSERTEQUALS("/cv/1/monitor.jpg", path.c_str());
+    ASSERT(!inodes.path(0, path));
+    ASSERT(!inodes.path(inoMonitor+1, path));
+    ASSERTEQUALS("/cv", inodes.child(1, "cv").c_str());
+    ASSERTEQUALS("/cv/1", inodes.child(inoCv, "1").c_str());
+    ASSERTEQUALS("", inodes.child(inoMonitor+1, "x").c_str());
+
+    // lookups of next/monitor.jpg@N are dropped when the kernel forgets them
+    size_t size = inodes.size();
+    unsigned long inoNext = inodes.lookup("/cv/1/next/monitor.jpg");
+    ASSERTEQUAL(inoNext, inodes.lookup("/cv/1/next/monitor.jpg"));
+    for (int generation = 1; generation <= 1000; generation++) {
+        char generationPath[64];
+        snprintf(generationPath, sizeof(generationPath), "/cv/1/next/monitor.jpg@%d", generation);
+        unsigned long ino = inodes.lookup(generationPath);
+        ASSERT(ino > inoNext); // never reused
+        ASSERT(inodes.path(ino, path));
+        inodes.forget(ino, 1);
+        ASSERT(!inodes.path(ino, path));
+    }
+    ASSERTEQUAL(size+1, inodes.size());
+    inodes.forget(inoNext, 1);
+    ASSERT(inodes.path(inoNext, path)); // one lookup remains
+    inodes.forget(inoNext, 1);
+    ASSERT(!inodes.path(inoNext, path));
+    ASSERTEQUAL(size, inodes.size());
+    inodes.forget(1, 1);
+    ASSERT(inodes.path(1, path)); // root is never forgotten
+
+    cout << "testInodes() PASS" << endl;
+    cout << endl;
+    return 0;
+}
+
+int testFileTimes() {
+    cout << "testFileTimes() --------------------------" << endl;
+    worker.clear();
+    char * configJson = firerest.configure_path("test/testconfig.json");
+    free(configJson);
+    CameraNode &camera = worker.camera("/cv/1");
+    const char *path = "/cv/1/monitor.jpg";
+    struct stat stat1;
+    struct stat stat2;
+    char value[32];
+
+    camera.src_monitor_jpg.post(SmartPointer<char>((char *) "frame1", 6));
+    ASSERTEQUAL(0, firefuse_getattr(path, &stat1));
+    usleep(2*1000);
+    ASSERTEQUAL(0, firefuse_getattr(path, &stat2));
+    ASSERTEQUAL(stat1.st_mtim.tv_sec, stat2.st_mtim.tv_sec); // unchanged image
+    ASSERTEQUAL(stat1.st_mtim.tv_nsec, stat2.st_mtim.tv_nsec);
+    int len = firefuse_getxattr(path, FIREREST_XATTR_GENERATION, NULL, 0);
+    ASSERT(len > 0);
+    ASSERTEQUAL(len, firefuse_getxattr(path, FIREREST_XATTR_GENERATION, value, sizeof(value)));
+    value[len] = 0;
+    long generation = atol(value);
+    ASSERTEQUAL(camera.src_monitor_jpg.getWriteCount(), generation);
+
+    camera.src_monitor_jpg.post(SmartPointer<char>((char *) "frame22", 7));
+    ASSERTEQUAL(0, firefuse_getattr(path, &stat2));
+    ASSERTEQUAL(7, stat2.st_size);
+    ASSERT(stat2.st_mtim.tv_sec > stat1.st_mtim.tv_sec ||
+           stat2.st_mtim.tv_sec == stat1.st_mtim.tv_sec && stat2.st_mtim.tv_nsec > stat1.st_mtim.tv_nsec);
+    len = firefuse_getxattr(path, FIREREST_XATTR_GENERATION, value, sizeof(value));
+    value[len] = 0;
+    ASSERTEQUAL(generation+1, atol(value));
+
+    ASSERTEQUAL(-ERANGE, firefuse_getxattr(path, FIREREST_XATTR_GENERATION, value, 1));
+    ASSERTEQUAL(-ENODATA, firefuse_getxattr(path, "user.other", value, sizeof(value)));
+    ASSERTEQUAL(-ENODATA, firefuse_getxattr("/cv/1", FIREREST_XATTR_GENERATION, value, sizeof(value)));
+
+    ASSERTEQUAL(0, firefuse_getattr("/cv/1", &stat1)); // directories change only on configure
+    ASSERTEQUAL(firerest.configureTime(), stat1.st_mtime);
+
+    cout << "testFileTimes() PASS" << endl;
+    cout << endl;
+    return 0;
+}
+
+static void * next_frame_thread(void *pPath) {
+    const char *path = (const char *) pPath;
+    struct fuse_file_info file_info;
+    memset(&file_info, 0, sizeof(fuse_file_info));
+    file_info.flags = O_RDONLY;
+    assert(0 == firefuse_open(path, &file_info));
+    char *buf = (char *) calloc(1, 32);
+    firefuse_read(path, buf, 31, 0, &file_info);
+    firefuse_release(path, &file_info);
+    return buf;
+}
+
+int testNextFrame() {
+    cout << "testNextFrame() --------------------------" << endl;
+    worker.clear();
+    char * configJson = firerest.configure_path("test/testconfig.json");
+    free(configJson);
+    CameraNode &camera = worker.camera("/cv/1");
+    struct stat file_stat;
+    char path[64];
+    void *result;
+    pthread_t tid;
+
+    ASSERTEQUAL(0, firefuse_getattr("/cv/1/next/monitor.jpg", &file_stat));
+    ASSERTEQUAL(0, firefuse_getattr("/cv/1/next/output.jpg@0", &file_stat));
+    ASSERTEQUAL(-ENOENT, firefuse_getattr("/cv/1/next/monitor.jpg@", &file_stat));
+    ASSERTEQUAL(-ENOENT, firefuse_getattr("/cv/1/next/monitor.jpg@4x", &file_stat));
+    ASSERTEQUAL(-ENOENT, firefuse_getattr("/cv/1/monitor.jpg@4", &file_stat));
+
+    // open blocks until a frame newer than the given generation is posted
+    camera.src_monitor_jpg.post(SmartPointer<char>((char *) "frame1", 7));
+    long generation = camera.src_monitor_jpg.getWriteCount();
+    snprintf(path, sizeof(path), "/cv/1/next/monitor.jpg@%ld", generation);
+    assert(0 == pthread_create(&tid, NULL, next_frame_thread, path));
+    usleep(50*1000);
+    camera.src_monitor_jpg.post(SmartPointer<char>((char *) "frame2", 7));
+    pthread_join(tid, &result);
+    ASSERTEQUALS("frame2", (char *) result);
+    free(result);
+
+    // open returns at once when a newer frame already exists
+    result = next_frame_thread(path);
+    ASSERTEQUALS("frame2", (char *) result);
+    free(result);
+
+    // without a generation, open waits for the frame after the current one
+    assert(0 == pthread_create(&tid, NULL, next_frame_thread, (void *) "/cv/1/next/output.jpg"));
+    usleep(50*1000);
+    camera.src_output_jpg.post(SmartPointer<char>((char *) "output3", 8));
+    pthread_join(tid, &result);
+    ASSERTEQUALS("output3", (char *) result);
+    free(result);
+
+    cout << "testNextFrame() PASS" << endl;
+    cout << endl;
+    return 0;
+}
+
+#define MJPEG_TEST_PORT 18081
+
+static int mjpeg_connect(const char *path) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port = htons(MJPEG_TEST_PORT);
+    assert(0 == connect(fd, (struct sockaddr *) &addr, sizeof(addr)));
+    char request[256];
+    snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: localhost\r\n\r\n", path);
+    assert(strlen(request) == write(fd, request, strlen(request)));
+    return fd;
+}
+
+// Append socket input to response until it contains count occurrences of needle
+static int mjpeg_read(int fd, string &response, const char *needle, int count, int msTimeout=2000) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    for (;;) {
+        int found = 0;
+        for (size_t pos = response.find(needle); pos != string::npos; pos = response.find(needle, pos+1)) {
+            found++;
+        }
+        if (found >= count || poll(&pfd, 1, msTimeout) <= 0) {
+            return found;
+        }
+        char buf[256];
+        int n = read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            return found;
+        }
+        response.append(buf, n);
+    }
+}
+
+int testMJPEG() {
+    cout << "testMJPEG() --------------------------" << endl;
+    worker.clear();
+    char * configJson = firerest.configure_path("test/testconfig.json");
+    free(configJson);
+    assert(!mjpeg.isRunning());
+    ASSERTEQUAL(0, mjpeg.start(MJPEG_TEST_PORT));
+    assert(mjpeg.isRunning());
+    ASSERTEQUALS("127.0.0.1", mjpeg.getHost().c_str()); // streams are not authenticated
+    ASSERTEQUAL(EINVAL, mjpeg.start(MJPEG_TEST_PORT, "camera.local"));
+    assert(mjpeg.isRunning());
+    ASSERTEQUALS("127.0.0.1", mjpeg.getHost().c_str());
+    CameraNode &camera = worker.camera("/cv/1");
+    camera.src_monitor_jpg.post(SmartPointer<char>((char *) "frame0", 6));
+    long framesSent = mjpeg.getFrames();
+
+    string missing;
+    int fdMissing = mjpeg_connect("/cv/1/camera.mjpg");
+    mjpeg_read(fdMissing, missing, "\r\n\r\n", 1);
+    ASSERTEQUAL(0, missing.find("HTTP/1.0 404"));
+    close(fdMissing);
+
+    // two clients share each posted frame
+    string response1;
+    string response2;
+    int fd1 = mjpeg_connect("/cv/1/monitor.jpg");
+    int fd2 = mjpeg_connect("/cv/1/monitor.jpg");
+    ASSERTEQUAL(1, mjpeg_read(fd1, response1, "frame0", 1));
+    ASSERTEQUAL(1, mjpeg_read(fd2, response2, "frame0", 1));
+    ASSERTEQUAL(0, response1.find("HTTP/1.0 200 OK"));
+    assert(string::npos != response1.find("Content-Type: multipart/x-mixed-replace; boundary=firefuse"));
+    assert(string::npos != response1.find("--firefuse\r\nContent-Type: image/jpeg\r\nContent-Length: 6\r\n\r\nframe0\r\n"));
+    const int FRAMES = 10;
+    for (int i = 1; i <= FRAMES; i++) {
+        char frame[32];
+        snprintf(frame, sizeof(frame), "frame%d", i);
+        camera.src_monitor_jpg.post(SmartPointer<char>(frame, strlen(frame)));
+        string needle = string(frame) + "\r\n";
+        ASSERTEQUAL(1, mjpeg_read(fd1, response1, needle.c_str(), 1)); // pushed without polling
+        ASSERTEQUAL(1, mjpeg_read(fd2, response2, needle.c_str(), 1));
+    }
+    ASSERTEQUAL(FRAMES+1, mjpeg_read(fd1, response1, "--firefuse\r\n", FRAMES+1, 0));
+    ASSERTEQUAL(FRAMES+1, mjpeg_read(fd2, response2, "--firefuse\r\n", FRAMES+1, 0));
+    ASSERTEQUAL(framesSent + 2*(FRAMES+1), mjpeg.getFrames());
+    ASSERTEQUAL(0, mjpeg.getSkipped());
+    ASSERTEQUAL(2, mjpeg.getClients());
+
+    close(fd1);
+    close(fd2);
+    mjpeg.stop();
+    assert(!mjpeg.isRunning());
+    ASSERTEQUAL(0, mjpeg.getClients());
+
+    cout << "testMJPEG() PASS" << endl;
+    cout << endl;
+    return 0;
+}
+
+int testCameras() {
+    cout << "testCameras() --------------------------" << endl;
+    worker.clear();
+    char * configJson = firerest.configure_path("test/testconfig-cameras.json");
+    free(configJson);
+    vector<string> cameraNames = worker.getCameraNames();
+    ASSERTEQUAL(2, cameraNames.size());
+    ASSERTEQUALS("/cv/1", cameraNames[0].c_str());
+    ASSERTEQUALS("/cv/2", cameraNames[1].c_str());
+    ASSERTEQUALS("/cv/2", CameraNode::camera_path("/dev/firefuse/sync/cv/2/bgr/cve/two/save.fire").c_str());
+    ASSERTEQUALS("", CameraNode::camera_path("/cv/").c_str());
+    ASSERTEQUALS("", CameraNode::camera_path("/cnc/tinyg").c_str());
+
+    // each camera has its own configuration
+    CameraNode &head = worker.camera("/cv/1");
+    CameraNode &up = worker.camera("/sync/cv/2");
+    assert(&head != &up);
+    ASSERTEQUAL(200, head.getWidth());
+    ASSERTEQUAL(800, head.getHeight());
+    ASSERTEQUAL(250, head.get_min_capture_ms()); // cv maxfps
+    ASSERTEQUALS("raspistill", head.getSourceName().c_str());
+    ASSERTEQUAL(640, up.getWidth());
+    ASSERTEQUAL(480, up.getHeight());
+    ASSERTEQUAL(500, up.get_min_capture_ms()); // camera maxfps
+    ASSERTEQUALS("none", up.getSourceName().c_str());
+
+    // CVEs and resources bind to their camera by path
+    assert(&worker.cve("/cv/1/gray/cve/one").getCamera() == &head);
+    assert(&worker.cve("/cv/2/bgr/cve/two").getCamera() == &up);
+    assert(firerest.node("/cv/1/monitor.jpg")->pCamera == &head);
+    assert(firerest.node("/sync/cv/2/monitor.jpg")->pCamera == &up);
+    assert(firerest.node("/cv/2/bgr/cve/two/process.fire")->pCamera == &up);
+    assert(NULL == firerest.node("/cv/2/gray/cve/one/process.fire"));
+
+    // camera images and CVE output stay with their camera
+    long headOutput = head.src_output_jpg.getWriteCount();
+    long upOutput = up.src_output_jpg.getWriteCount();
+    SmartPointer<char> image1 = loadFile("test/headcam1.jpg");
+    up.accept_new_image(image1);
+    worker.processLoop();
+    assert(up.src_monitor_jpg.isFresh());
+    assert(up.src_monitor_jpg.peek().data() == image1.data());
+    assert(head.src_monitor_jpg.peek().data() != image1.data());
+    worker.cve("/cv/2/bgr/cve/two").src_process_fire.get();
+    worker.processLoop();
+    assert(worker.cve("/cv/2/bgr/cve/two").src_process_fire.isFresh());
+    ASSERTEQUAL(upOutput+1, up.src_output_jpg.getWriteCount());
+    ASSERTEQUAL(headOutput, head.src_output_jpg.getWriteCount());
+    assert(up.get_frames_decoded() > 0);
+
+    cout << "testCameras() PASS" << endl;
+    cout << endl;
+    return 0;
+}
+
+int testV4L2() {
+    cout << "testV4L2() --------------------------" << endl;
+    worker.clear();
+    char * configJson = firerest.configure_path("test/testconfig-v4l2.json");
+    free(configJson);
+    CameraNode &camera = worker.camera("/cv/1");
+    ASSERTEQUALS("v4l2", camera.getSourceName().c_str());
+    ASSERTEQUALS("/dev/video-missing", camera.getSourceConfig().c_str());
+    ASSERTEQUALS("YUYV", camera.getSourceFormat().c_str());
+    assert(V4L2Source::pixel_format("MJPG") == V4L2Source::pixel_format(""));
+    assert(V4L2Source::pixel_format("YUYV") != 0);
+    assert(V4L2Source::pixel_format("H264") == 0);
+
+    // a missing device leaves the camera without a source
+    worker.processInit();
+    assert(!camera.isStreaming());
+    assert(!camera.capture());
+
+    // raw frames are posted without a jpg decode
+    long framesDecoded = camera.get_frames_decoded();
+    Mat bgr(240, 320, CV_8UC3, Scalar(0, 0, 255));
+    ASSERTEQUAL(0, camera.accept_new_mat(bgr));
+    assert(camera.src_camera_jpg.isFresh());
+    SmartPointer<char> jpg = camera.src_camera_jpg.peek();
+    assert(jpg.size() > 2);
+    ASSERTEQUAL(0xff, (uchar) jpg.data()[0]);
+    ASSERTEQUAL(0xd8, (uchar) jpg.data()[1]);
+    Mat image = camera.get_mat_bgr();
+    assert(image.data == bgr.data);
+    ASSERTEQUAL(framesDecoded, camera.get_frames_decoded());
+    Mat gray = camera.get_mat_gray();
+    ASSERTEQUAL(240, gray.rows);
+    ASSERTEQUAL(framesDecoded, camera.get_frames_decoded());
+
+    // e.g., FIREFUSE_V4L2_DEVICE=/dev/video0 with "modprobe vivid"
+    const char *device = getenv("FIREFUSE_V4L2_DEVICE");
+    if (device) {
+        const char *formats[] = {"MJPG", "YUYV"};
+        for (int i = 0; i < 2; i++) {
+            camera.configure(320, 240, "v4l2", device, formats[i]);
+            camera.init();
+            if (!camera.isStreaming()) {
+                LOGWARN2("TEST testV4L2() %s does not stream %s", device, formats[i]);
+                continue;
+            }
+            long frame = camera.src_camera_jpg.getWriteCount();
+            assert(camera.capture());
+            camera.src_camera_jpg.get_sync(5000);
+            assert(frame < camera.src_camera_jpg.getWriteCount());
+            assert(camera.src_camera_jpg.peek().size() > 0);
+            assert(camera.get_mat_bgr().rows > 0);
+        }
+        camera.configure(320, 240, "none", "");
+        camera.init();
+    }
+
+    cout << "testV4L2() PASS" << endl;
+    cout << endl;
+    return 0;
+}
+
+int testReplay() {
+    cout << "testReplay() --------------------------" << endl;
+    const char *synthetic = "\xff\xd8" "\xff\xe1\x00\x06\xff\xd8\xff\xd9" "\xff\xda\x00\x02" "\x12\xff\x00\x34" "\xff\xd9" "tail";
+    ASSERTEQUAL(20, ReplaySource::jpeg_length(synthetic, 24)); // thumbnail and stuffed 0xff do not end the frame
+    ASSERTEQUAL(0, ReplaySource::jpeg_length(synthetic, 19));
+    ASSERTEQUAL(0, ReplaySource::jpeg_length(synthetic+2, 22));
+    SmartPointer<char> headcam0 = loadFile("test/headcam0.jpg");
+    SmartPointer<char> headcam1 = loadFile("test/headcam1.jpg");
+    ASSERTEQUAL(headcam0.size(), ReplaySource::jpeg_length(headcam0.data(), headcam0.size()));
+
+    // directory replay posts one frame per capture request
+    worker.clear();
+    char * configJson = firerest.configure_path("test/testconfig-replay.json");
+    free(configJson);
+    CameraNode &camera = worker.camera("/cv/1");
+    ASSERTEQUALS("replay", camera.getSourceName().c_str());
+    ASSERTEQUALS("test", camera.getSourceConfig().c_str());
+    worker.processInit();
+    assert(camera.isStreaming());
+    ReplaySource *pReplay = (ReplaySource *) camera.getSource();
+    ASSERTEQUAL(2, pReplay->getFrameCount());
+    int minCaptureMs = camera.get_min_capture_ms();
+    camera.set_min_capture_ms(0);
+    size_t expected[] = {headcam0.size(), headcam1.size()};
+    for (int i = 0; i < 4; i++) {
+        long frame = camera.src_camera_jpg.getWriteCount();
+        assert(camera.capture());
+        SmartPointer<char> jpg = camera.src_camera_jpg.get_sync(1000);
+        assert(frame < camera.src_camera_jpg.getWriteCount());
+        ASSERTEQUAL(expected[i%2], jpg.size());
+    }
+    ASSERTEQUAL(4, pReplay->getFramesPosted());
+
+    // frame log replay runs at the configured fps
+    const char *logPath = "/tmp/firefuse-replay.mjpeg";
+    FILE *fLog = fopen(logPath, "w");
+    assert(fLog);
+    fwrite("junk", 1, 4, fLog);
+    fwrite(headcam0.data(), 1, headcam0.size(), fLog);
+    fwrite(headcam1.data(), 1, headcam1.size(), fLog);
+    fclose(fLog);
+    camera.configure(320, 240, "replay", logPath, "", 100);
+    camera.init();
+    assert(camera.isStreaming());
+    pReplay = (ReplaySource *) camera.getSource();
+    ASSERTEQUAL(2, pReplay->getFrameCount());
+    usleep(200*1000);
+    long posted = pReplay->getFramesPosted();
+    LOGINFO1("TEST testReplay() 100fps posted %ld frames in 200ms", posted);
+    assert(5 <= posted && posted <= 30);
+    assert(camera.src_camera_jpg.peek().size() == headcam0.size() ||
+           camera.src_camera_jpg.peek().size() == headcam1.size());
+
+    camera.configure(320, 240, "replay", "/tmp/firefuse-replay-missing", "", 0);
+    camera.init();
+    assert(!camera.isStreaming());
+    assert(!camera.capture());
+    camera.set_min_capture_ms(minCaptureMs);
+    unlink(logPath);
+
+    cout << "testReplay() PASS" << endl;
+    cout << endl;
+    return 0;
+}
+
+static void * delayed_frame_thread(void *pCamera) {
+    usleep(20*1000);
+    ((CameraNode *)pCamera)->accept_new_image(loadFile("test/headcam1.jpg"));
+    return NULL;
+}
+
+int testFrameRing() {
+    cout << "testFrameRing() --------------------------" << endl;
+    CameraNode camera("/cv/ring");
+    SmartPointer<char> headcam0 = loadFile("test/headcam0.jpg");
+
+    // one frame per second, starting at t0
+    struct timespec t0;
+    clock_gettime(CLOCK_REALTIME, &t0);
+    t0.tv_sec -= 100;
+    struct timespec captured = t0;
+    long frames[FRAME_RING_SIZE+2];
+    for (int i = 0; i < FRAME_RING_SIZE+2; i++) {
+        captured.tv_sec = t0.tv_sec + i;
+        assert(0 == camera.accept_new_image(headcam0, &captured));
+        camera.src_camera_jpg.peek(&frames[i]);
+    }
+    CameraFrame frame;
+    assert(!camera.get_frame(frames[0], &frame)); // overwritten
+    assert(!camera.get_frame(frames[1], &frame)); // overwritten
+    assert(camera.get_frame(frames[2], &frame));
+    ASSERTEQUAL(frames[2], frame.sequence);
+    ASSERTEQUAL(t0.tv_sec+2, frame.captured.tv_sec);
+    assert(frame.jpg.data() == headcam0.data()); // posted by reference
+
+    // first frame captured at or after a given time
+    struct timespec after = t0;
+    ASSERTEQUAL(frames[2], camera.frame_after(after, 0)); // oldest retained frame
+    after.tv_sec = t0.tv_sec + 5;
+    ASSERTEQUAL(frames[5], camera.frame_after(after, 0));
+    after.tv_sec = t0.tv_sec + 4;
+    after.tv_nsec = t0.tv_nsec + 1;
+    ASSERTEQUAL(frames[5], camera.frame_after(after, 0));
+    after.tv_sec = t0.tv_sec + FRAME_RING_SIZE + 2;
+    long msStart = millis();
+    ASSERTEQUAL(0, camera.frame_after(after, 50));
+    assert(millis() - msStart >= 40);
+
+    // frame_after() waits for the next frame
+    clock_gettime(CLOCK_REALTIME, &after);
+    pthread_t tidFrame;
+    assert(0 == pthread_create(&tidFrame, NULL, delayed_frame_thread, &camera));
+    long frameNext = camera.frame_after(after, 1000);
+    pthread_join(tidFrame, NULL);
+    ASSERTEQUAL(frames[FRAME_RING_SIZE+1]+1, frameNext);
+
+    // frames are decoded once, on demand
+    long decoded = camera.get_frames_decoded();
+    Mat gray = camera.get_frame_mat(frames[3], FALSE);
+    ASSERTEQUAL(200, gray.rows);
+    ASSERTEQUAL(800, gray.cols);
+    ASSERTEQUAL(decoded+1, camera.get_frames_decoded());
+    assert(camera.get_frame_mat(frames[3], FALSE).data == gray.data);
+    ASSERTEQUAL(decoded+1, camera.get_frames_decoded());
+    assert(camera.get_frame_mat(frames[0], TRUE).empty()); // overwritten
+    ASSERTEQUAL(decoded+1, camera.get_frames_decoded());
+
+    // overwritten frames lend their storage to new frames
+    uchar *pixels = gray.data;
+    gray.release();
+    for (int i = 0; i < FRAME_RING_SIZE; i++) {
+        camera.accept_new_image(headcam0);
+    }
+    long frameReused = frames[3] + FRAME_RING_SIZE;
+    assert(camera.get_frame_mat(frameReused, FALSE).data == pixels);
+    ASSERTEQUAL(decoded+2, camera.get_frames_decoded());
+
+    // frame_after_ack() matches frames with serial acks
+    DCE dce("/cnc/pty");
+    int master;
+    int slave;
+    open_pty_dce(dce, &master, &slave);
+    ASSERTEQUAL(0, dce.getAcks());
+    struct timespec acked;
+    assert(!dce.ack_time(1, &acked, 10));
+    assert(3 == write(master, "ok\n", 3));
+    assert(dce.ack_time(1, &acked, 1000));
+    ASSERTEQUAL(1, dce.getAcks());
+    assert(0 == pthread_create(&tidFrame, NULL, delayed_frame_thread, &camera));
+    long frameAck = camera.frame_after_ack(dce, 1, 1000);
+    pthread_join(tidFrame, NULL);
+    ASSERTEQUAL(camera.src_camera_jpg.getWriteCount(), frameAck);
+    assert(camera.get_frame(frameAck, &frame));
+    assert(frame.captured.tv_sec > acked.tv_sec ||
+           (frame.captured.tv_sec == acked.tv_sec && frame.captured.tv_nsec >= acked.tv_nsec));
+    ASSERTEQUAL(0, camera.frame_after_ack(dce, 2, 10));
+    close_pty_dce(dce, master, slave);
+
+    cout << "testFrameRing() PASS" << endl;
+    cout << endl;
+    return 0;
+}
+
+static void * process_loop_thread(void *pRunning) {
+    while (((std::atomic<bool> *)pRunning)->load()) {
+        if (worker.processLoop() == 0) {
+            usleep(1000);
+        }
+    }
+    return NULL;
+}
+
+static void * see_thread(void *pDce) {
+    const char *gcode = "G0X1\n" FIREREST_GCODE_SEE "/cv/1/bgr/cve/one\n";
+    SmartPointer<char> request((char *)gcode, strlen(gcode));
+    ((DCE *)pDce)->send_request(request, TRUE);
+    return NULL;
+}
+
+int testGcodeSee() {
+    cout << "testGcodeSee() --------------------------" << endl;
+    worker.clear();
+    char * configJson = firerest.configure_path("test/testconfig-replay.json");
+    free(configJson);
+    worker.processInit();
+    CameraNode &camera = worker.camera("/cv/1");
+    assert(camera.isStreaming());
+    int minCaptureMs = camera.get_min_capture_ms();
+    camera.set_min_capture_ms(0);
+    CVE &cve = worker.cve("/cv/1/bgr/cve/one");
+
+    DCE dce("/cnc/pty");
+    int master;
+    int slave;
+    open_pty_dce(dce, &master, &slave);
+
+    // the move is sent and the CVE waits for its ack
+    pthread_t tidSee;
+    assert(0 == pthread_create(&tidSee, NULL, see_thread, &dce));
+    long msStart = millis();
+    while (!dce.snk_gcode_fire.isFresh() && millis() - msStart < 1000) {
+        usleep(1000);
+    }
+    dce.gcode(NULL);
+    ASSERTEQUAL(1, read_lines(master, 100)); // process.fire line is not sent
+    assert(!cve.isSeePending());
+    worker.processLoop();
+    long frame = camera.src_camera_jpg.getWriteCount();
+    long processed = cve.src_process_fire.getWriteCount();
+
+    // the ack queues a capture for the worker and the CVE processes that frame
+    assert(3 == write(master, "ok\n", 3));
+    msStart = millis();
+    while (camera.get_capture_wait_ms() < 0 && millis() - msStart < 1000) {
+        usleep(1000);
+    }
+    assert(camera.get_capture_wait_ms() >= 0);
+    ASSERTEQUAL(frame, camera.src_camera_jpg.getWriteCount()); // serial reader does not capture
+    while (cve.src_process_fire.getWriteCount() == processed && millis() - msStart < 1000) {
+        worker.processLoop();
+        usleep(1000);
+    }
+    pthread_join(tidSee, NULL); // sync request returns after the CVE has seen the move
+    assert(!cve.isSeePending());
+    assert(processed < cve.src_process_fire.getWriteCount());
+    assert(frame < camera.src_camera_jpg.getWriteCount());
+    struct timespec acked;
+    assert(dce.ack_time(1, &acked, 0));
+    assert(frame < camera.frame_after(acked, 0));
+
+    // unknown CVEs are reported and nothing is sent
+    const char *gcode = FIREREST_GCODE_SEE "/cv/1/bgr/cve/missing\n";
+    dce.snk_gcode_fire.post(SmartPointer<char>((char *)gcode, strlen(gcode)));
+    dce.gcode(NULL);
+    ASSERTEQUAL(0, read_lines(master, 50));
+    assert(testString("testGcodeSee() missing",
+                      "{\"status\":\"ERROR\",\"gcode\":\";process.fire /cv/1/bgr/cve/missing\",\"response\":\"Unknown CVE\"}",
+                      dce.src_gcode_fire.peek()));
+
+    close_pty_dce(dce, master, slave);
+    camera.set_min_capture_ms(minCaptureMs);
+    cout << "testGcodeSee() PASS" << endl;
+    cout << endl;
+    return 0;
+}
+
+typedef struct MockMachine {
+    int fd;                     // pty master
+    int msMove;                 // simulated duration of each move
+    std::atomic<bool> running;
+    vector<string> lines;       // gcode received
+    LockFreeLIFOCache<SmartPointer<char> > *pProgress; // optional cache whose write count is recorded for each line
+    vector<long> progress;      // pProgress write count when each line arrived
+} MockMachine;
+
+static void * mock_machine_thread(void *arg) {
+    MockMachine *pMachine = (MockMachine *) arg;
+    struct pollfd pfd = {pMachine->fd, POLLIN, 0};
+    string line;
+    while (pMachine->running.load()) {
+        char buf[256];
+        if (poll(&pfd, 1, 10) <= 0) {
+            continue;
+        }
+        int n = read(pMachine->fd, buf, sizeof(buf));
+        for (int i = 0; i < n; i++) {
+            if (buf[i] != '\r' && buf[i] != '\n') {
+                line += buf[i];
+            } else if (!line.empty()) {
+                pMachine->lines.push_back(line);
+                if (pMachine->pProgress) {
+                    pMachine->progress.push_back(pMachine->pProgress->getWriteCount());
+                }
+                line.clear();
+                usleep(pMachine->msMove * 1000);
+                assert(3 == write(pMachine->fd, "ok\n", 3));
+            }
+        }
+    }
+    return NULL;
+}
+
+int testCalibrate() {
+    cout << "testCalibrate() --------------------------" << endl;
+    worker.clear();
+    char * configJson = firerest.configure_path("test/testconfig-replay.json");
+    free(configJson);
+    worker.processInit();
+    CameraNode &camera = worker.camera("/cv/1");
+    assert(camera.isStreaming());
+    int minCaptureMs = camera.get_min_capture_ms();
+    camera.set_min_capture_ms(0);
+    CVE &cve = worker.cve("/cv/1/bgr/cve/one");
+    const FireNode *pNode = firerest.node("/sync/cv/1/bgr/cve/one/calibrate.fire");
+    assert(pNode);
+    ASSERTEQUAL(FIRENODE_CALIBRATE_FIRE, pNode->kind);
+    assert(pNode->pCve == &cve);
+
+    DCE dce("/cnc/pty");
+    int master;
+    int slave;
+    open_pty_dce(dce, &master, &slave);
+    MockMachine machine;
+    machine.fd = master;
+    machine.msMove = 100;
+    machine.running.store(TRUE);
+    machine.pProgress = &cve.src_calibrate_fire;
+    pthread_t tidMachine;
+    assert(0 == pthread_create(&tidMachine, NULL, mock_machine_thread, &machine));
+
+    // the pipeline takes as long as a move
+    SmartPointer<char> firesight = cve.src_firesight_json.peek();
+    const char *sleepJson = "[{\"op\":\"sleep\",\"ms\":100}]";
+    cve.src_firesight_json.post(SmartPointer<char>((char *)sleepJson, strlen(sleepJson)));
+    assert(cve.claim());
+    long msStart = millis();
+    json_decref(cve.process_mat(cve.frame_mat(camera.newest_frame(), TRUE)));
+    long msProcess = millis() - msStart;
+    cve.release();
+    assert(msProcess >= 100);
+
+    // one job at a time, moving while the previous position is processed
+    std::atomic<bool> running(TRUE);
+    pthread_t tidWorker;
+    assert(0 == pthread_create(&tidWorker, NULL, process_loop_thread, &running)); // captures after acks
+    long frame = camera.src_camera_jpg.getWriteCount();
+    long posted = cve.src_calibrate_fire.getWriteCount() + 1; // start() posts ACTIVE
+    msStart = millis();
+    assert(0 == cve.getCalibrateJob().start(dce, SpiralIterator(3,3), "G0X{x}Y{y}"));
+    ASSERTEQUAL(-EAGAIN, cve.getCalibrateJob().start(dce, SpiralIterator(3,3)));
+    cve.getCalibrateJob().wait();
+    LOGINFO3("TEST testCalibrate() 3x3 spiral %ldms move:%dms process:%ldms", millis() - msStart, machine.msMove, msProcess);
+    cve.src_firesight_json.post(firesight);
+    assert(!cve.getCalibrateJob().isRunning());
+    machine.running.store(FALSE);
+    pthread_join(tidMachine, NULL);
+    ASSERTEQUAL(9, dce.getAcks());
+    ASSERTEQUAL(9, machine.progress.size());
+    for (int i = 1; i < 9; i++) { // a serial scan posts position i-1 before it moves to position i
+        assert(machine.progress[i] - posted < i); // moved before position i-1 was posted
+    }
+
+    // one move, frame and model for each position in spiral order
+    SmartPointer<char> calibrate = cve.src_calibrate_fire.peek();
+    string calibrateString(calibrate.data(), calibrate.size());
+    json_error_t jerr;
+    json_t *pCalibrate = json_loads(calibrateString.c_str(), 0, &jerr);
+    assert(pCalibrate);
+    ASSERTEQUALS("DONE", json_string_value(json_object_get(pCalibrate, "status")));
+    ASSERTEQUAL(9, json_integer_value(json_object_get(pCalibrate, "positions")));
+    json_t *pResults = json_object_get(pCalibrate, "results");
+    ASSERTEQUAL(9, json_array_size(pResults));
+    ASSERTEQUAL(9, machine.lines.size());
+    SpiralIterator spiral(3,3);
+    for (int i = 0; i < 9; i++) {
+        json_t *pPosition = json_array_get(pResults, i);
+        ASSERTEQUAL(spiral.getX(), json_real_value(json_object_get(pPosition, "x")));
+        ASSERTEQUAL(spiral.getY(), json_real_value(json_object_get(pPosition, "y")));
+        char move[32];
+        snprintf(move, sizeof(move), "G0X%gY%g", spiral.getX(), spiral.getY());
+        ASSERTEQUALS(move, machine.lines[i].c_str());
+        long positionFrame = json_integer_value(json_object_get(pPosition, "frame"));
+        assert(frame < positionFrame); // captured after the move
+        frame = positionFrame;
+        assert(json_object_get(pPosition, "model"));
+        assert(!json_object_get(pPosition, "error"));
+        spiral.next();
+    }
+    json_decref(pCalibrate);
+    close_pty_dce(dce, master, slave);
+
+    // properties.json configures calibrate.fire jobs
+    const char *properties = "{\"calibrate\":{\"dce\":\"/cnc/tinyg\",\"xSteps\":1,\"ySteps\":3,\"yScale\":2}}";
+    cve.src_properties_json.post(SmartPointer<char>((char *)properties, strlen(properties)));
+    assert(0 == cve.calibrate(&worker));
+    cve.getCalibrateJob().wait();
+    calibrate = cve.src_calibrate_fire.peek();
+    calibrateString = string(calibrate.data(), calibrate.size());
+    pCalibrate = json_loads(calibrateString.c_str(), 0, &jerr);
+    assert(pCalibrate);
+    ASSERTEQUALS("DONE", json_string_value(json_object_get(pCalibrate, "status")));
+    pResults = json_object_get(pCalibrate, "results");
+    ASSERTEQUAL(3, json_array_size(pResults));
+    ASSERTEQUAL(-2, json_real_value(json_object_get(json_array_get(pResults, 0), "y")));
+    ASSERTEQUAL(2, json_real_value(json_object_get(json_array_get(pResults, 2), "y")));
+    json_decref(pCalibrate);
+
+    properties = "{\"caps\":\"ONE\"}";
+    cve.src_properties_json.post(SmartPointer<char>((char *)properties, strlen(properties)));
+    assert(0 == cve.calibrate(&worker));
+    assert(strstr(cve.src_calibrate_fire.peek().data(), "\"error\""));
+
+    running.store(FALSE);
+    pthread_join(tidWorker, NULL);
+    camera.set_min_capture_ms(minCaptureMs);
+    cout << "testCalibrate() PASS" << endl;
+    cout << endl;
+    return 0;
+}
+
+static json_t * batch_result(CameraNode &camera) {
+    SmartPointer<char> batch = camera.src_batch_fire.peek();
+    string batchString(batch.data(), batch.size());
+    json_error_t jerr;
+    json_t *pBatch = json_loads(batchString.c_str(), 0, &jerr);
+    assert(pBatch);
+    return pBatch;
+}
+
+int testBatch() {
+    cout << "testBatch() --------------------------" << endl;
+    worker.clear();
+    char * configJson = firerest.configure_path("test/testconfig-replay.json");
+    free(configJson);
+    worker.processInit();
+    CameraNode &camera = worker.camera("/cv/1");
+    assert(camera.isStreaming());
+    int minCaptureMs = camera.get_min_capture_ms();
+    camera.set_min_capture_ms(0);
+    const FireNode *pNode = firerest.node("/sync/cv/1/batch.fire");
+    assert(pNode);
+    ASSERTEQUAL(FIRENODE_BATCH_FIRE, pNode->kind);
+    assert(pNode->pCamera == &camera);
+    assert(pNode->pCve == NULL);
+    std::atomic<bool> running(TRUE);
+    pthread_t tidWorker;
+    assert(0 == pthread_create(&tidWorker, NULL, process_loop_thread, &running));
+
+    // a sync batch captures and decodes one frame for all CVEs
+    long frame = camera.src_camera_jpg.getWriteCount();
+    long decoded = camera.get_frames_decoded();
+    const char *path = "/sync/cv/1/batch.fire";
+    const char *request = "[\"bgr/one\",\"bgr/two\",\"/cv/1/gray/cve/one\"]";
+    struct fuse_file_info file_info;
+    memset(&file_info, 0, sizeof(fuse_file_info));
+    file_info.flags = O_RDWR;
+    ASSERTEQUAL(0, firefuse_open(path, &file_info));
+    ASSERTEQUAL(strlen(request), firefuse_write(path, request, strlen(request), 0, &file_info));
+    ASSERTEQUAL(decoded+1, camera.get_frames_decoded()); // gray is converted from bgr
+    SmartPointer<char> result = camera.src_batch_fire.peek();
+    char resultBuf[4096];
+    assert(result.size() < sizeof(resultBuf));
+    ASSERTEQUAL(result.size(), firefuse_read(path, resultBuf, sizeof(resultBuf), 0, &file_info));
+    ASSERTEQUAL(0, memcmp(result.data(), resultBuf, result.size())); // the handle reads this batch
+    ASSERTEQUAL(0, firefuse_release(path, &file_info));
+    json_t *pBatch = batch_result(camera);
+    ASSERTEQUALS("DONE", json_string_value(json_object_get(pBatch, "status")));
+    long batchFrame = json_integer_value(json_object_get(pBatch, "frame"));
+    assert(frame < batchFrame);
+    json_t *pCves = json_object_get(pBatch, "cve");
+    ASSERTEQUAL(3, json_object_size(pCves));
+    const char *names[] = {"bgr/one", "bgr/two", "/cv/1/gray/cve/one"};
+    for (int i = 0; i < 3; i++) {
+        json_t *pCve = json_object_get(pCves, names[i]);
+        assert(json_is_object(pCve));
+        assert(!json_object_get(pCve, "error"));
+    }
+    json_decref(pBatch);
+
+    // an async batch uses the newest frame, which is already decoded
+    const char *request2 = "[\"bgr/two\"]";
+    ASSERTEQUAL(1, camera.batch(&worker, SmartPointer<char>((char *)request2, strlen(request2)), FALSE));
+    ASSERTEQUAL(decoded+1, camera.get_frames_decoded());
+    pBatch = batch_result(camera); // the write returns before the CVEs complete
+    ASSERTEQUALS("ACTIVE", json_string_value(json_object_get(pBatch, "status")));
+    ASSERTEQUAL(batchFrame, json_integer_value(json_object_get(pBatch, "frame")));
+    json_decref(pBatch);
+    long posted = camera.src_batch_fire.getWriteCount();
+    for (int ms = 0; posted == camera.src_batch_fire.getWriteCount() && ms < PROCESS_MSTIMEOUT; ms += 10) {
+        usleep(10000);
+    }
+    pBatch = batch_result(camera); // posted by the worker when the last CVE completes
+    ASSERTEQUALS("DONE", json_string_value(json_object_get(pBatch, "status")));
+    ASSERTEQUAL(batchFrame, json_integer_value(json_object_get(pBatch, "frame")));
+    ASSERTEQUAL(1, json_object_size(json_object_get(pBatch, "cve")));
+    assert(!json_object_get(json_object_get(json_object_get(pBatch, "cve"), "bgr/two"), "error"));
+    json_decref(pBatch);
+
+    // unknown CVEs and malformed requests are reported
+    const char *missing = "[\"bgr/one\",\"bgr/missing\"]";
+    frame = camera.src_camera_jpg.getWriteCount();
+    ASSERTEQUAL(0, camera.batch(&worker, SmartPointer<char>((char *)missing, strlen(missing)), TRUE));
+    ASSERTEQUAL(frame, camera.src_camera_jpg.getWriteCount()); // nothing captured
+    pBatch = batch_result(camera);
+    assert(json_is_string(json_object_get(pBatch, "error")));
+    json_decref(pBatch);
+    const char *notArray = "{\"cve\":\"bgr/one\"}";
+    ASSERTEQUAL(0, camera.batch(&worker, SmartPointer<char>((char *)notArray, strlen(notArray)), TRUE));
+    pBatch = batch_result(camera);
+    assert(json_is_string(json_object_get(pBatch, "error")));
+    json_decref(pBatch);
+
+    running.store(FALSE);
+    pthread_join(tidWorker, NULL);
+    camera.set_min_capture_ms(minCaptureMs);
+    cout << "testBatch() PASS" << endl;
+    cout << endl;
+    return 0;
+}
+
+int testDecodeOnce() {
+    cout << "testDecodeOnce() --------------------------" << endl;
+    CameraNode camera("/cv/pair");
+    CVE bgrCve("/cv/pair/bgr/cve/one", &camera);
+    CVE grayCve("/cv/pair/gray/cve/one", &camera);
+    camera.accept_new_image(loadFile("test/headcam0.jpg"));
+    long frame = camera.newest_frame();
+
+    // a bgr and a gray CVE on one frame decode the JPEG once
+    long decoded = camera.get_frames_decoded();
+    ASSERTEQUAL(0, bgrCve.process(&worker));
+    ASSERTEQUAL(decoded+1, camera.get_frames_decoded());
+    ASSERTEQUAL(0, grayCve.process(&worker));
+    ASSERTEQUAL(decoded+1, camera.get_frames_decoded()); // gray is converted from bgr
+    Mat gray;
+    cvtColor(camera.get_frame_mat(frame, TRUE), gray, CV_BGR2GRAY);
+    ASSERTEQUAL(0, norm(gray, camera.get_frame_mat(frame, FALSE), NORM_INF));
+    ASSERTEQUAL(decoded+1, camera.get_frames_decoded());
+
+    cout << "testDecodeOnce() PASS" << endl;
+    cout << endl;
+    return 0;
+}
+
+int testCropDecode() {
+    cout << "testCropDecode() --------------------------" << endl;
+    CameraNode camera("/cv/crop");
+    SmartPointer<char> headcam0 = loadFile("test/headcam0.jpg");
+    camera.accept_new_image(headcam0);
+    long frame = camera.newest_frame();
+    Rect roi(350, 50, 100, 100);
+
+    // only the region is decoded
+    long decoded = camera.get_frames_decoded();
+    Mat grayRoi = camera.get_frame_roi(frame, FALSE, roi);
+    Mat bgrRoi = camera.get_frame_roi(frame, TRUE, roi);
+    ASSERTEQUAL(100, grayRoi.rows);
+    ASSERTEQUAL(100, grayRoi.cols);
+    ASSERTEQUAL(1, grayRoi.channels());
+    ASSERTEQUAL(100, bgrRoi.rows);
+    ASSERTEQUAL(100, bgrRoi.cols);
+    ASSERTEQUAL(3, bgrRoi.channels());
+#ifdef HAVE_JPEG_SKIP_SCANLINES
+    ASSERTEQUAL(2, camera.get_rois_decoded());
+    ASSERTEQUAL(decoded, camera.get_frames_decoded());
+#else
+    ASSERTEQUAL(0, camera.get_rois_decoded()); // whole frame decoded and cropped
+#endif
+
+    // the region matches the decoded frame, up to chroma upsampling at its edges
+    Mat gray = camera.get_frame_mat(frame, FALSE);
+    Mat bgr = camera.get_frame_mat(frame, TRUE);
+    assert(norm(grayRoi, gray(roi), NORM_INF) <= 8);
+    assert(norm(bgrRoi, bgr(roi), NORM_INF) <= 8);
+
+    // decoded frames are cropped instead of decoded again
+    long rois = camera.get_rois_decoded();
+    ASSERTEQUAL(0, norm(camera.get_frame_roi(frame, TRUE, roi), bgr(roi), NORM_INF));
+    ASSERTEQUAL(rois, camera.get_rois_decoded());
+    Mat clipped = camera.get_frame_roi(frame, FALSE, Rect(780, 190, 100, 100));
+    ASSERTEQUAL(10, clipped.rows);
+    ASSERTEQUAL(20, clipped.cols);
+    assert(camera.get_frame_roi(frame+FRAME_RING_SIZE, TRUE, roi).empty()); // not in ring
+
+    // a CVE with a crop property processes and saves only its region
+    CVE cve("/cv/crop/gray/cve/crop", &camera);
+    const char *properties = "{\"crop\":[350,50,100,100]}";
+    cve.src_properties_json.post(SmartPointer<char>((char *)properties, strlen(properties)));
+    camera.accept_new_image(headcam0);
+    decoded = camera.get_frames_decoded();
+    ASSERTEQUAL(0, cve.process(&worker));
+    assert(cve.isCropped());
+#ifdef HAVE_JPEG_SKIP_SCANLINES
+    ASSERTEQUAL(3, camera.get_rois_decoded());
+    ASSERTEQUAL(decoded, camera.get_frames_decoded());
+#endif
+    ASSERTEQUAL(0, cve.save(&worker));
+    SmartPointer<char> png = cve.src_saved_png.peek();
+    const uchar *pIHDR = (const uchar *) png.data() + 16; // PNG width and height
+    ASSERTEQUAL(100, (pIHDR[0]<<24) | (pIHDR[1]<<16) | (pIHDR[2]<<8) | pIHDR[3]);
+    ASSERTEQUAL(100, (pIHDR[4]<<24) | (pIHDR[5]<<16) | (pIHDR[6]<<8) | pIHDR[7]);
+
+    // invalid crops are reported instead of processing an empty image
+    const char *negative = "{\"crop\":[0,0,-10,-10]}";
+    cve.src_properties_json.post(SmartPointer<char>((char *)negative, strlen(negative)));
+    assert(!cve.isCropped()); // properties.json changed since compile()
+    ASSERTEQUAL(0, cve.process(&worker));
+    assert(!cve.isCropped());
+    assert(strstr(cve.src_process_fire.peek().data(), "\"error\""));
+    const char *outside = "{\"crop\":[900,300,10,10]}";
+    cve.src_properties_json.post(SmartPointer<char>((char *)outside, strlen(outside)));
+    ASSERTEQUAL(0, cve.process(&worker));
+    assert(cve.isCropped());
+    assert(strstr(cve.src_process_fire.peek().data(), "\"error\""));
+
+    cout << "testCropDecode() PASS" << endl;
+    cout << endl;
+    return 0;
+}
+
 int testSplit() {
     try {
         char buf[100];
@@ -1275,12 +2785,13 @@ int testRaspistill() {
     assert(testString("TEST testConfig()", "mock", worker.dce("/cnc/tinyg").getSerialPath().c_str()));
     SmartPointer<char> one_json(worker.cve("/cv/1/gray/cve/one").src_firesight_json.get());
     assert(testString("firesight.json GET","[{\"op\":\"putText\",\"text\":\"one\"}]", one_json));
-    assert(200 == cameraWidth);
-    assert(800 == cameraHeight);
-    assert(testString("config.json cameraSourceName", "raspistill", cameraSourceName.c_str()));
-    assert(testString("config.json cameraSourceConfig",
+    CameraNode &camera = worker.camera("/cv/1");
+    assert(200 == camera.getWidth());
+    assert(800 == camera.getHeight());
+    assert(testString("config.json camera source name", "raspistill", camera.getSourceName().c_str()));
+    assert(testString("config.json camera source config",
                       "-t 0 -q 45 -bm -s -o /dev/firefuse/cv/1/camera/jpg -w 200 -h 800",
-                      cameraSourceConfig.c_str()));
+                      camera.getSourceConfig().c_str()));
 
     cout << "testRaspistill() PASS" << endl;
 
@@ -1312,6 +2823,55 @@ int test_gfilter() {
     return 0;
 }
 
+int testCveThreads() {
+    cout << "testCveThreads() --------------------------" << endl;
+    worker.clear();
+    char * configJson = firerest.configure_path("test/testconfig-threads.json");
+    free(configJson);
+    worker.processInit();
+    ASSERTEQUAL(2, worker.getCveThreads());
+    worker.startThreads();
+    assert(worker.hasCveThreads());
+    bool configured = TRUE;
+    try {
+        worker.camera("/cv/9", TRUE); // maps are read without locks once threads run
+    } catch (string ex) {
+        configured = FALSE;
+    }
+    assert(!configured);
+    CVE &one = worker.cve("/cv/1/bgr/cve/one");
+    CVE &two = worker.cve("/cv/1/bgr/cve/two");
+    const char *sleepJson = "[{\"op\":\"sleep\",\"ms\":500}]";
+    one.src_firesight_json.post(SmartPointer<char>((char *)sleepJson, strlen(sleepJson)));
+    two.src_firesight_json.post(SmartPointer<char>((char *)sleepJson, strlen(sleepJson)));
+
+    // both CVEs are queued by one worker pass and run at the same time
+    long oneWrites = one.src_process_fire.getWriteCount();
+    long twoWrites = two.src_process_fire.getWriteCount();
+    one.src_process_fire.get();
+    two.src_process_fire.get();
+    ASSERTEQUAL(010, worker.processLoop() & 010);
+    ASSERTEQUAL(oneWrites, one.src_process_fire.getWriteCount()); // not run on the worker thread
+    ASSERTEQUAL(twoWrites, two.src_process_fire.getWriteCount());
+    for (int ms = 0; ms < PROCESS_MSTIMEOUT; ms += 10) {
+        if (oneWrites < one.src_process_fire.getWriteCount() && twoWrites < two.src_process_fire.getWriteCount()) {
+            break;
+        }
+        usleep(10000);
+    }
+    ASSERTEQUAL(oneWrites+1, one.src_process_fire.getWriteCount());
+    ASSERTEQUAL(twoWrites+1, two.src_process_fire.getWriteCount());
+    LOGINFO2("TEST testCveThreads() queue one:%.3fs two:%.3fs", one.getQueueSeconds(), two.getQueueSeconds());
+    assert(one.getQueueSeconds() < 0.25); // neither waited for the other's 0.5s pipeline
+    assert(two.getQueueSeconds() < 0.25);
+    assert(one.getExecSeconds() >= 0.5);
+    assert(two.getExecSeconds() >= 0.5);
+
+    cout << "testCveThreads() PASS" << endl;
+    cout << endl;
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     worker.setIdlePeriod(0);
     firelog_level(FIRELOG_TRACE);
@@ -1324,13 +2884,34 @@ int main(int argc, char *argv[]) {
             testFireREST() == 0 &&
             testConfig()==0 &&
             testSerial()==0 &&
+            testSerialPty()==0 &&
+            testSerialWindow()==0 &&
             testCamera()==0 &&
             testSmartPointer()==0 &&
             testSmartPointer_CopyData()==0 &&
+            testSmartPointer_Threads()==0 &&
+            testBufferPool()==0 &&
             testLIFOCache()==0 &&
+            testLockFreeLIFOCache()==0 &&
+            testCacheEvent()==0 &&
             testCve()==0 &&
             testCnc()==0 &&
+            testFuseThreads()==0 &&
+            testInodes()==0 &&
+            testFileTimes()==0 &&
+            testNextFrame()==0 &&
+            testMJPEG()==0 &&
+            testCameras()==0 &&
+            testV4L2()==0 &&
+            testReplay()==0 &&
+            testFrameRing()==0 &&
+            testGcodeSee()==0 &&
+            testCalibrate()==0 &&
+            testBatch()==0 &&
+            testDecodeOnce()==0 &&
+            testCropDecode()==0 &&
             testSpiralSearch() &&
+            testCveThreads()==0 && // last: leaves the worker threads running
             TRUE) {
             cout << "ALL TESTS PASS!!!" << endl;
 
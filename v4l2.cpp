@@ -0,0 +1,274 @@
+#include "FireSight.hpp"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <time.h>
+#include <iostream>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+#include "firefuse.h"
+
+#include "opencv2/imgproc/imgproc.hpp"
+
+using namespace cv;
+
+// Video4Linux2 camera source. The driver fills mmap'd buffers that are
+// dequeued by stream_thread and requeued at once, so the camera keeps
+// streaming. Only the first frame exposed after a capture request is
+// posted to the CameraNode:
+//   MJPG frames are copied once into a pooled SmartPointer for src_camera_jpg
+//   YUYV frames are converted once into the bgr Mat of the frame ring
+// Frames are stamped with their exposure time so that frame_after() can
+// match them with serial acks.
+
+#define V4L2_MSTIMEOUT 1000 /* stream_thread checks for stop() at least this often */
+
+static long long monotonic_nanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+V4L2Source::V4L2Source(CameraNode *pCamera, string device, string format) {
+    this->pCamera = pCamera;
+    this->device = device;
+    pixelformat = pixel_format(format.c_str());
+    width = 0;
+    height = 0;
+    bytesperline = 0;
+    fd = -1;
+    nBuffers = 0;
+    streaming.store(FALSE);
+    requestNanos.store(0);
+}
+
+V4L2Source::~V4L2Source() {
+    stop();
+}
+
+unsigned int V4L2Source::pixel_format(const char *format) {
+    if (format == NULL || *format == 0 || strcmp("MJPG", format) == 0) {
+        return V4L2_PIX_FMT_MJPEG;
+    }
+    if (strcmp("YUYV", format) == 0) {
+        return V4L2_PIX_FMT_YUYV;
+    }
+    return 0;
+}
+
+int V4L2Source::xioctl(unsigned long request, void *arg) {
+    int rc;
+    do {
+        rc = ioctl(fd, request, arg);
+    } while (rc == -1 && errno == EINTR);
+    return rc;
+}
+
+int V4L2Source::start(int width, int height) {
+    int rc = 0;
+    if (pixelformat == 0) {
+        LOGERROR1("V4L2Source::start(%s) unsupported format", device.c_str());
+        return EINVAL;
+    }
+    fd = open(device.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        rc = errno;
+        LOGERROR2("V4L2Source::start(%s) open failed [ERRNO:%d]", device.c_str(), rc);
+        return rc;
+    }
+
+    struct v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if (xioctl(VIDIOC_QUERYCAP, &cap)) {
+        rc = errno;
+        LOGERROR2("V4L2Source::start(%s) VIDIOC_QUERYCAP [ERRNO:%d]", device.c_str(), rc);
+        stop();
+        return rc;
+    }
+    unsigned int caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_CAPTURE) || !(caps & V4L2_CAP_STREAMING)) {
+        LOGERROR2("V4L2Source::start(%s) not a streaming capture device caps:%x", device.c_str(), caps);
+        stop();
+        return ENODEV;
+    }
+
+    struct v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = width;
+    fmt.fmt.pix.height = height;
+    fmt.fmt.pix.pixelformat = pixelformat;
+    fmt.fmt.pix.field = V4L2_FIELD_ANY;
+    if (xioctl(VIDIOC_S_FMT, &fmt)) {
+        rc = errno;
+        LOGERROR2("V4L2Source::start(%s) VIDIOC_S_FMT [ERRNO:%d]", device.c_str(), rc);
+        stop();
+        return rc;
+    }
+    if (fmt.fmt.pix.pixelformat != pixelformat) {
+        LOGERROR2("V4L2Source::start(%s) format %x is not supported", device.c_str(), pixelformat);
+        stop();
+        return EINVAL;
+    }
+    this->width = fmt.fmt.pix.width; // drivers choose the nearest supported size
+    this->height = fmt.fmt.pix.height;
+    bytesperline = fmt.fmt.pix.bytesperline ? fmt.fmt.pix.bytesperline : 2*this->width;
+
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = V4L2_BUFFERS;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(VIDIOC_REQBUFS, &req) || req.count < 2) {
+        rc = req.count < 2 ? ENOMEM : errno;
+        LOGERROR2("V4L2Source::start(%s) VIDIOC_REQBUFS [ERRNO:%d]", device.c_str(), rc);
+        stop();
+        return rc;
+    }
+    for (nBuffers = 0; nBuffers < (int) req.count && nBuffers < V4L2_BUFFERS; nBuffers++) {
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = nBuffers;
+        if (xioctl(VIDIOC_QUERYBUF, &buf)) {
+            rc = errno;
+            LOGERROR2("V4L2Source::start(%s) VIDIOC_QUERYBUF [ERRNO:%d]", device.c_str(), rc);
+            stop();
+            return rc;
+        }
+        void *pStart = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buf.m.offset);
+        if (pStart == MAP_FAILED) {
+            rc = errno;
+            LOGERROR2("V4L2Source::start(%s) mmap [ERRNO:%d]", device.c_str(), rc);
+            stop();
+            return rc;
+        }
+        bufferStart[nBuffers] = pStart;
+        bufferLength[nBuffers] = buf.length;
+        if (xioctl(VIDIOC_QBUF, &buf)) {
+            rc = errno;
+            nBuffers++; // unmap this buffer too
+            LOGERROR2("V4L2Source::start(%s) VIDIOC_QBUF [ERRNO:%d]", device.c_str(), rc);
+            stop();
+            return rc;
+        }
+    }
+
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(VIDIOC_STREAMON, &type)) {
+        rc = errno;
+        LOGERROR2("V4L2Source::start(%s) VIDIOC_STREAMON [ERRNO:%d]", device.c_str(), rc);
+        stop();
+        return rc;
+    }
+    streaming.store(TRUE);
+    LOGRC(rc, "pthread_create(V4L2Source::stream_thread) -> ", pthread_create(&tidStream, NULL, &stream_thread, this));
+    if (rc) {
+        streaming.store(FALSE);
+        stop();
+        return rc;
+    }
+    LOGINFO4("V4L2Source::start(%s) %dx%d buffers:%d", device.c_str(), this->width, this->height, nBuffers);
+    return 0;
+}
+
+void V4L2Source::stop() {
+    if (streaming.exchange(FALSE)) {
+        pthread_join(tidStream, NULL);
+    }
+    if (fd >= 0) {
+        enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        xioctl(VIDIOC_STREAMOFF, &type);
+    }
+    for (int i = 0; i < nBuffers; i++) {
+        munmap(bufferStart[i], bufferLength[i]);
+    }
+    nBuffers = 0;
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+        LOGINFO1("V4L2Source::stop(%s)", device.c_str());
+    }
+}
+
+void V4L2Source::request() {
+    requestNanos.store(monotonic_nanos());
+}
+
+void V4L2Source::post_frame(int index, size_t bytesused, long long exposed) {
+    struct timespec captured; // CLOCK_REALTIME of CLOCK_MONOTONIC exposure
+    clock_gettime(CLOCK_REALTIME, &captured);
+    long long nanos = captured.tv_sec * 1000000000LL + captured.tv_nsec - (monotonic_nanos() - exposed);
+    captured.tv_sec = nanos / 1000000000LL;
+    captured.tv_nsec = nanos % 1000000000LL;
+    if (pixelformat == V4L2_PIX_FMT_MJPEG) {
+        SmartPointer<char> jpg((char *) bufferStart[index], bytesused, SmartPointer<char>::POOL);
+        pCamera->accept_new_image(jpg, &captured);
+    } else {
+        Mat yuyv(height, width, CV_8UC2, bufferStart[index], bytesperline);
+        Mat bgr;
+        cvtColor(yuyv, bgr, CV_YUV2BGR_YUYV);
+        pCamera->accept_new_mat(bgr, &captured);
+    }
+    pCamera->endCapture();
+    LOGDEBUG3("V4L2Source::post_frame(%s) buffer:%d %ldB", device.c_str(), index, (long) bytesused);
+}
+
+void * V4L2Source::stream_thread(void *arg) {
+    V4L2Source *pSource = (V4L2Source *) arg;
+    LOGINFO1("V4L2Source::stream_thread(%s) start", pSource->device.c_str());
+    struct pollfd pfd;
+    pfd.fd = pSource->fd;
+    pfd.events = POLLIN;
+    while (pSource->streaming.load()) {
+        int rc = poll(&pfd, 1, V4L2_MSTIMEOUT);
+        if (rc < 0 && errno != EINTR) {
+            LOGERROR2("V4L2Source::stream_thread(%s) poll [ERRNO:%d]", pSource->device.c_str(), errno);
+            break;
+        }
+        if (rc <= 0) {
+            continue;
+        }
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (pSource->xioctl(VIDIOC_DQBUF, &buf)) {
+            if (errno == EAGAIN) {
+                continue;
+            }
+            LOGERROR2("V4L2Source::stream_thread(%s) VIDIOC_DQBUF [ERRNO:%d]", pSource->device.c_str(), errno);
+            break;
+        }
+        long long exposed = monotonic_nanos(); // frames may wait in the driver queue
+        if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+            exposed = buf.timestamp.tv_sec * 1000000000LL + buf.timestamp.tv_usec * 1000LL;
+        }
+        long long requested = pSource->requestNanos.load();
+        if (requested && exposed >= requested && !(buf.flags & V4L2_BUF_FLAG_ERROR) &&
+                pSource->requestNanos.compare_exchange_strong(requested, 0)) {
+            try { // a bad frame must not end streaming or leak its buffer
+                pSource->post_frame(buf.index, buf.bytesused, exposed);
+            } catch (const char * ex) {
+                LOGERROR2("V4L2Source::stream_thread(%s) EXCEPTION: %s", pSource->device.c_str(), ex);
+            } catch (string ex) {
+                LOGERROR2("V4L2Source::stream_thread(%s) EXCEPTION: %s", pSource->device.c_str(), ex.c_str());
+            } catch (std::exception &ex) { // cv::Exception
+                LOGERROR2("V4L2Source::stream_thread(%s) EXCEPTION: %s", pSource->device.c_str(), ex.what());
+            } catch (...) {
+                LOGERROR1("V4L2Source::stream_thread(%s) UNKNOWN EXCEPTION", pSource->device.c_str());
+            }
+        }
+        if (pSource->xioctl(VIDIOC_QBUF, &buf)) {
+            LOGERROR2("V4L2Source::stream_thread(%s) VIDIOC_QBUF [ERRNO:%d]", pSource->device.c_str(), errno);
+            break;
+        }
+    }
+    LOGINFO1("V4L2Source::stream_thread(%s) exit", pSource->device.c_str());
+    return NULL;
+}